@@ -0,0 +1,131 @@
+#include <stdio.h>
+#include "bench.h"
+#include "bus.h"
+#include "apu.h"
+#include "cpu/cpu.h"
+
+#define BENCH_SECONDS 5
+#define SAMPLE_RATE 48000
+#define FRAMES_PER_READ 1024
+
+static const uint8_t idle_body[] = {0x04, 0x0C, 0x14, 0x1C}; // INC B, INC C, INC D, INC E
+static const uint8_t write_body[] = {0x3C, 0xE0, 0x13}; // INC A, LDH (NR13), A
+
+static int16_t samples[FRAMES_PER_READ * 2];
+
+enum scenario
+{
+    SCENARIO_NO_APU, // CPU only, the baseline the APU cost is measured against.
+    SCENARIO_STEADY, // Four channels playing, no register writes.
+    SCENARIO_WRITES, // Four channels playing while the CPU keeps rewriting NR13.
+    SCENARIO_STEADY_NO_OUTPUT, // As above, with APU_OUTPUT_NONE.
+    SCENARIO_WRITES_NO_OUTPUT,
+    NUM_SCENARIOS
+};
+
+static const char *scenario_names[NUM_SCENARIOS] = {"no apu", "steady", "writes", "steady (no output)", "writes (no output)"};
+
+static void start_channels()
+{
+    uint8_t i;
+
+    bus_write(0x80, NR11_ADDR);
+    bus_write(0xF0, NR12_ADDR);
+    bus_write(0x00, NR13_ADDR);
+    bus_write(0x86, NR14_ADDR);
+
+    bus_write(0x40, NR21_ADDR);
+    bus_write(0xA0, NR22_ADDR);
+    bus_write(0x80, NR23_ADDR);
+    bus_write(0x87, NR24_ADDR);
+
+    for (i = 0; i < WAVE_RAM_SIZE; i++)
+    {
+        bus_write(i * 0x11, WAVE_RAM_ADDR + i);
+    }
+    bus_write(0x80, NR30_ADDR);
+    bus_write(0x20, NR32_ADDR);
+    bus_write(0x00, NR33_ADDR);
+    bus_write(0x85, NR34_ADDR);
+
+    bus_write(0xF0, NR42_ADDR);
+    bus_write(0x34, NR43_ADDR);
+    bus_write(0x80, NR44_ADDR);
+}
+
+static int run(enum scenario scenario, double *elapsed, uint64_t *frames)
+{
+    uint64_t cycles = (uint64_t)BENCH_SECONDS * CPU_FREQ, done = 0, slice;
+    double start;
+    int ret = 0;
+
+    uint8_t writes = scenario == SCENARIO_WRITES || scenario == SCENARIO_WRITES_NO_OUTPUT;
+    enum apu_output output = scenario >= SCENARIO_STEADY_NO_OUTPUT ? APU_OUTPUT_NONE : APU_OUTPUT_SAMPLES;
+
+    bench_load_loop(writes ? write_body : idle_body, writes ? sizeof(write_body) : sizeof(idle_body));
+
+    if (bench_memory_init())
+        return -1;
+    if (cpu_init())
+        goto err_mem;
+    if (scenario != SCENARIO_NO_APU)
+    {
+        if (apu_init(output, SAMPLE_RATE))
+            goto err_cpu;
+        start_channels();
+    }
+
+    *frames = 0;
+    start = host_time();
+    while (done < cycles && ret == 0)
+    {
+        // Drain the output whenever a buffer's worth of audio has been emulated.
+        slice = (uint64_t)FRAMES_PER_READ * CPU_FREQ / SAMPLE_RATE;
+        ret = cpu_run(slice);
+        done += slice;
+        if (scenario != SCENARIO_NO_APU)
+        {
+            *frames += apu_read_samples(samples, FRAMES_PER_READ);
+        }
+    }
+    *elapsed = host_time() - start;
+
+    if (scenario != SCENARIO_NO_APU)
+    {
+        apu_end();
+    }
+    cpu_end();
+    bench_memory_end();
+    return ret;
+
+err_cpu:
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return -1;
+}
+
+int main(int argc, const char *argv[])
+{
+    double elapsed[NUM_SCENARIOS];
+    uint64_t frames;
+    uint8_t scenario;
+
+    for (scenario = 0; scenario < NUM_SCENARIOS; scenario++)
+    {
+        if (run(scenario, &elapsed[scenario], &frames))
+        {
+            fprintf(stderr, "APU benchmark failed\n");
+            return 1;
+        }
+
+        printf("%-18s %d emulated s in %.3f s", scenario_names[scenario], BENCH_SECONDS, elapsed[scenario]);
+        if (scenario != SCENARIO_NO_APU)
+        {
+            printf(", %" PRIu64 " frames, APU cost %.2f ms per emulated second",
+                   frames, (elapsed[scenario] - elapsed[SCENARIO_NO_APU]) * 1e3 / BENCH_SECONDS);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef BENCH__
+#define BENCH__
+
+#include <inttypes.h>
+#include <string.h>
+#include "bus.h"
+#include "hosttime.h"
+
+#define BENCH_ROM_ADDR  0x0000
+#define BENCH_ROM_SIZE  0x8000
+#define BENCH_WRAM_ADDR 0xC000
+#define BENCH_WRAM_SIZE 0x2000
+#define BENCH_HRAM_ADDR 0xFF80
+#define BENCH_HRAM_SIZE 0x7F
+#define BENCH_ENTRY     0x0100
+
+#define JP_OPCODE 0xC3
+
+static uint8_t bench_rom[BENCH_ROM_SIZE];
+static uint8_t bench_wram[BENCH_WRAM_SIZE];
+static uint8_t bench_hram[BENCH_HRAM_SIZE];
+
+// Fill ROM from the entry point with copies of body, followed by a jump back to the entry point.
+static inline void bench_load_loop(const uint8_t *body, uint16_t size)
+{
+    uint16_t addr = BENCH_ENTRY;
+
+    memset(bench_rom, 0, sizeof(bench_rom));
+    while (addr + size <= BENCH_ROM_SIZE - 3)
+    {
+        memcpy(&bench_rom[addr], body, size);
+        addr += size;
+    }
+
+    // Branch handlers leave PC at the target and the CPU loop then adds the instruction size.
+    bench_rom[addr] = JP_OPCODE;
+    bench_rom[addr + 1] = (uint8_t)(BENCH_ENTRY - 3);
+    bench_rom[addr + 2] = (uint8_t)((BENCH_ENTRY - 3) >> 8);
+}
+
+static inline int bench_memory_init()
+{
+    memset(bench_wram, 0, sizeof(bench_wram));
+    memset(bench_hram, 0, sizeof(bench_hram));
+
+    if (add_bus_rom(BENCH_ROM_ADDR, BENCH_ROM_SIZE, bench_rom, NULL))
+    {
+        return -1;
+    }
+    if (add_bus_memory(BENCH_WRAM_ADDR, BENCH_WRAM_SIZE, bench_wram, NULL))
+    {
+        remove_bus_connection(BENCH_ROM_ADDR);
+        return -1;
+    }
+    if (add_bus_memory(BENCH_HRAM_ADDR, BENCH_HRAM_SIZE, bench_hram, NULL))
+    {
+        remove_bus_connection(BENCH_WRAM_ADDR);
+        remove_bus_connection(BENCH_ROM_ADDR);
+        return -1;
+    }
+    return 0;
+}
+
+static inline void bench_memory_end()
+{
+    remove_bus_connection(BENCH_HRAM_ADDR);
+    remove_bus_connection(BENCH_WRAM_ADDR);
+    remove_bus_connection(BENCH_ROM_ADDR);
+}
+
+#endif
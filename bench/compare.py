@@ -0,0 +1,58 @@
+"""
+Compare two cpu_bench results and flag workloads that got slower.
+
+Usage:
+    python3 bench/compare.py [--threshold PERCENT] baseline.json candidate.json
+
+Exits with 1 if any workload of the candidate runs more than PERCENT (default 5) below the
+emulated MHz of the baseline, or is missing from it.
+"""
+import json
+import sys
+from argparse import ArgumentParser, FileType
+
+
+DEFAULT_THRESHOLD = 5.0
+
+
+def load_workloads(file):
+    result = json.load(file)
+    return {workload["name"]: workload for workload in result["workloads"]}
+
+
+def main():
+    parser = ArgumentParser(description="Compare two cpu_bench results.")
+    parser.add_argument("baseline", type=FileType("r"))
+    parser.add_argument("candidate", type=FileType("r"))
+    parser.add_argument("--threshold", type=float, default=DEFAULT_THRESHOLD,
+                        help="slowdown in percent that counts as a regression")
+    args = parser.parse_args()
+
+    baseline = load_workloads(args.baseline)
+    candidate = load_workloads(args.candidate)
+    regressions = 0
+
+    print("{:<12} {:>10} {:>10} {:>8}".format("workload", "base MHz", "new MHz", "change"))
+    for name, base in baseline.items():
+        new = candidate.get(name)
+        if new is None:
+            print("{:<12} {:>10.2f} {:>10} {:>8}  MISSING".format(name, base["emulated_mhz"], "-", "-"))
+            regressions += 1
+            continue
+
+        change = (new["emulated_mhz"] / base["emulated_mhz"] - 1) * 100
+        flag = ""
+        if change < -args.threshold:
+            flag = "REGRESSION"
+            regressions += 1
+        elif new["instructions"] != base["instructions"]:
+            # Same cycles but different work: the builds do not emulate the same way.
+            flag = "instructions {} -> {}".format(base["instructions"], new["instructions"])
+        print("{:<12} {:>10.2f} {:>10.2f} {:>+7.1f}%  {}".format(
+            name, base["emulated_mhz"], new["emulated_mhz"], change, flag).rstrip())
+
+    return 1 if regressions else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
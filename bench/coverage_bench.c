@@ -0,0 +1,66 @@
+#include <stdio.h>
+#include "bench.h"
+#include "coverage.h"
+#include "ppu.h"
+#include "cpu/cpu.h"
+
+#define BENCH_FRAMES 600
+
+// Branch every other instruction, the worst case for edge collection. JR lands right after itself
+// since the offset is 0, which still makes every copy of the body its own edge.
+static const uint8_t loop_body[] = {
+    0x04, // INC B
+    0x18, 0x00 // JR 0
+};
+
+static uint8_t map[COVERAGE_MAP_SIZE];
+
+static int run(int enabled, double *time)
+{
+    int ret = -1;
+
+    if (bench_memory_init())
+        return -1;
+    if (cpu_init())
+        goto err_mem;
+    if (ppu_init(PPU_RENDER_TIMING))
+        goto err_cpu;
+
+    memset(map, 0, sizeof(map));
+    if (enabled && coverage_enable(map, sizeof(map)))
+        goto err_ppu;
+
+    *time = host_time();
+    ret = cpu_run((uint64_t)BENCH_FRAMES * FRAME_CYCLES);
+    *time = host_time() - *time;
+
+    if (enabled)
+        printf("%" PRIu32 " of %d map entries hit\n", coverage_count(), COVERAGE_MAP_SIZE);
+    coverage_disable();
+
+err_ppu:
+    ppu_end();
+err_cpu:
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    double off, on;
+
+    bench_load_loop(loop_body, sizeof(loop_body));
+
+    if (run(0, &off) || run(1, &on))
+    {
+        fprintf(stderr, "Coverage benchmark failed\n");
+        return 1;
+    }
+
+    printf("%d frames, coverage off: %.3f s (%.1f fps)\n", BENCH_FRAMES, off, BENCH_FRAMES / off);
+    printf("%d frames, coverage on:  %.3f s (%.1f fps), %+.1f%%\n", BENCH_FRAMES, on, BENCH_FRAMES / on,
+           (on - off) * 100 / off);
+    return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * CPU throughput on synthetic workloads, reported as JSON on stdout.
+ *
+ * Usage:
+ *     cpu_bench [-c cycles] [-r repeats] [workload...]
+ *
+ * Every workload runs for the same number of cycles (default 20M, almost five emulated seconds),
+ * the best of -r timed runs (default 3) is kept. Instructions are counted in a separate untimed
+ * run, which executes exactly the same. Compare two results with bench/compare.py.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bench.h"
+#include "opstats.h"
+#include "cpu/cpu.h"
+
+#define DEFAULT_CYCLES  20000000ULL
+#define DEFAULT_REPEATS 3
+
+// The loop starts at LOOP_ENTRY and ends with two jumps back to it. Jumps land 3 bytes past their
+// target, and RETI one byte past the interrupted instruction. Should an interrupt return into the
+// operand of the first jump, its bytes (00 04) execute as NOP and INC B on the way to the second.
+#define LOOP_TARGET 0x0400
+#define LOOP_ENTRY  (LOOP_TARGET + 3)
+#define TIMER_VECTOR 0x0050
+#define FUNC_ADDR   0x0200 // Target of the CALL workload, reached through CALL FUNC_ADDR - 3.
+
+#define TAC_ENABLE_16 0x05 // Timer on, TIMA counts every 16 cycles.
+
+#define CALL_OPCODE 0xCD
+#define RET_OPCODE  0xC9
+#define RETI_OPCODE 0xD9
+
+struct workload
+{
+    const char *name;
+    const uint8_t *body;
+    uint16_t size;
+    int8_t tma; // Timer reload value, the timer interrupt stays off for -1.
+};
+
+static const uint8_t alu_body[] = {
+    0x80, // ADD A,B
+    0xA9, // XOR C
+    0x04, // INC B
+    0x93, // SUB E
+    0xB4, // OR H
+    0x0D, // DEC C
+    0x8D, // ADC A,L
+    0xA2 // AND D
+};
+
+// Copies 32 bytes from C000 up to D000 down on every pass.
+static const uint8_t memcpy_body[] = {
+    0x21, 0x00, 0xC0, // LD HL,C000
+    0x11, 0x00, 0xD0, // LD DE,D000
+#define COPY_BYTE 0x2A, 0x12, 0x13 // LD A,(HL+); LD (DE),A; DEC DE
+    COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE,
+    COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE,
+    COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE,
+    COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE, COPY_BYTE
+#undef COPY_BYTE
+};
+
+// RET comes back one byte past the pushed address, hence the padding NOP.
+static const uint8_t call_body[] = {
+    CALL_OPCODE, (uint8_t)(FUNC_ADDR - 3), (uint8_t)((FUNC_ADDR - 3) >> 8), 0x00, // CALL func; NOP
+    0x04 // INC B
+};
+
+static const uint8_t cb_body[] = {
+    0xCB, 0x37, // SWAP A
+    0xCB, 0x11, // RL C
+    0xCB, 0x3F, // SRL A
+    0xCB, 0x27, // SLA A
+    0xCB, 0x30, // SWAP B
+    0xCB, 0x19, // RR C
+    0xCB, 0x00, // RLC B
+    0xCB, 0x1A // RR D
+};
+
+// Sleeps until the timer interrupt, which returns past the NOP to the next HALT.
+static const uint8_t halt_body[] = {
+    0x76, // HALT
+    0x00 // NOP
+};
+
+// Single byte instructions, so returning one byte late from the interrupt is harmless.
+static const uint8_t irq_body[] = {
+    0x04, // INC B
+    0x0C, // INC C
+    0x14, // INC D
+    0x1C // INC E
+};
+
+static const struct workload workloads[] = {
+    {"alu", alu_body, sizeof(alu_body), -1},
+    {"memcpy", memcpy_body, sizeof(memcpy_body), -1},
+    {"call_ret", call_body, sizeof(call_body), -1},
+    {"cb", cb_body, sizeof(cb_body), -1},
+    {"halt_idle", halt_body, sizeof(halt_body), 0x00}, // An interrupt every 4096 cycles.
+    {"timer_irq", irq_body, sizeof(irq_body), (int8_t)0xFE} // An interrupt every 32 cycles.
+};
+
+#define NUM_WORKLOADS (sizeof(workloads) / sizeof(workloads[0]))
+
+static void load_rom(const struct workload *workload)
+{
+    uint16_t addr = LOOP_ENTRY, i;
+
+    memset(bench_rom, 0, sizeof(bench_rom));
+    while (addr + workload->size <= BENCH_ROM_SIZE - 6)
+    {
+        memcpy(&bench_rom[addr], workload->body, workload->size);
+        addr += workload->size;
+    }
+    for (i = 0; i < 2; i++, addr += 3)
+    {
+        bench_rom[addr] = JP_OPCODE;
+        bench_rom[addr + 1] = (uint8_t)LOOP_TARGET;
+        bench_rom[addr + 2] = (uint8_t)(LOOP_TARGET >> 8);
+    }
+
+    bench_rom[FUNC_ADDR] = 0x04; // INC B
+    bench_rom[FUNC_ADDR + 1] = RET_OPCODE;
+    bench_rom[TIMER_VECTOR] = RETI_OPCODE;
+}
+
+// Run one workload from a fresh machine, returning the host time taken.
+static int run(const struct workload *workload, uint64_t cycles, double *elapsed)
+{
+    int ret = -1;
+
+    if (bench_memory_init())
+        return -1;
+    if (cpu_init())
+        goto err_mem;
+
+    cpu.regs.pc = LOOP_ENTRY;
+    cpu.regs.sp = 0xFFFE;
+    if (workload->tma != -1)
+    {
+        cpu.timer_regs.tma = (uint8_t)workload->tma;
+        cpu.timer_regs.tac = TAC_ENABLE_16;
+        cpu.ie_flags.timer_irq = 1;
+        cpu.ime = 1;
+    }
+
+    *elapsed = host_time();
+    ret = cpu_run(cycles);
+    *elapsed = host_time() - *elapsed;
+
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return ret;
+}
+
+static uint64_t count_instructions(const struct workload *workload, uint64_t cycles)
+{
+    uint64_t count = 0;
+    double elapsed;
+    uint32_t i;
+
+    opstats_enable(NULL);
+    if (run(workload, cycles, &elapsed) == 0)
+    {
+        for (i = 0; i < OPSTATS_NUM_OPCODES; i++)
+            count += opstats.executions[i];
+    }
+    opstats_disable();
+    return count;
+}
+
+static int selected(const char *name, int argc, char *argv[])
+{
+    int i;
+
+    if (optind == argc)
+        return 1;
+    for (i = optind; i < argc; i++)
+    {
+        if (strcmp(argv[i], name) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t cycles = DEFAULT_CYCLES, instructions;
+    uint32_t repeats = DEFAULT_REPEATS, i, r;
+    double best, elapsed;
+    const char *sep = "";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            cycles = strtoull(optarg, NULL, 0);
+            break;
+        case 'r':
+            repeats = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            fprintf(stderr, "usage: cpu_bench [-c cycles] [-r repeats] [workload...]\n");
+            return 2;
+        }
+    }
+    if (repeats == 0)
+        repeats = 1;
+
+    printf("{\n  \"benchmark\": \"cpu\",\n  \"cycles\": %" PRIu64 ",\n  \"workloads\": [", cycles);
+    for (i = 0; i < NUM_WORKLOADS; i++)
+    {
+        if (!selected(workloads[i].name, argc, argv))
+            continue;
+
+        load_rom(&workloads[i]);
+        instructions = count_instructions(&workloads[i], cycles);
+
+        best = 0;
+        for (r = 0; r < repeats; r++)
+        {
+            if (run(&workloads[i], cycles, &elapsed))
+            {
+                fprintf(stderr, "Workload %s failed\n", workloads[i].name);
+                return 1;
+            }
+            if (r == 0 || elapsed < best)
+                best = elapsed;
+        }
+
+        fprintf(stderr, "%-10s %8.2f MHz %8.1f ns/instruction\n", workloads[i].name, cycles / best / 1e6,
+                instructions ? best * 1e9 / instructions : 0.0);
+        printf("%s\n    {\"name\": \"%s\", \"instructions\": %" PRIu64 ", \"seconds\": %.6f, "
+               "\"emulated_mhz\": %.3f, \"ns_per_instruction\": %.3f, \"instructions_per_second\": %.0f}",
+               sep, workloads[i].name, instructions, best, cycles / best / 1e6,
+               instructions ? best * 1e9 / instructions : 0.0, instructions / best);
+        sep = ",";
+    }
+    printf("\n  ]\n}\n");
+    return 0;
+}
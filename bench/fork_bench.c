@@ -0,0 +1,135 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "apu.h"
+#include "dma.h"
+#include "fork.h"
+#include "joypad.h"
+#include "movie.h"
+#include "ppu.h"
+#include "savestate.h"
+#include "cpu/cpu.h"
+
+#define NUM_BRANCHES 4000
+#define WARMUP_FRAMES 30
+#define SAMPLE_RATE 48000
+
+// Folds the joypad into WRAM, so every branch ends up with its own state.
+static const uint8_t loop_body[] = {
+    0xF0, 0x00, // LDH A,(P1)
+    0xA8, // XOR B
+    0x47, // LD B,A
+    0xEA, 0x00, 0xC0, // LD (C000),A
+    0xEA, 0x40, 0xD0, // LD (D040),A
+    0xE6, 0x0F, // AND 0F
+    0xE0, 0x00 // LDH (P1),A
+};
+
+static struct fork *branches[NUM_BRANCHES];
+static uint64_t checksums[NUM_BRANCHES];
+
+static int bench()
+{
+    struct fork_stats stats;
+    struct fork *root;
+    uint32_t i, seed = 1;
+    double start, fork_time = 0, switch_time = 0, t;
+    int ret = 0;
+
+    if (fork_init())
+        return -1;
+
+    cpu_run((uint64_t)WARMUP_FRAMES * FRAME_CYCLES);
+    root = fork_create();
+    if (root == NULL)
+    {
+        fork_end();
+        return -1;
+    }
+
+    // Explore one frame of a different input from the root in every branch.
+    start = host_time();
+    for (i = 0; i < NUM_BRANCHES && ret == 0; i++)
+    {
+        t = host_time();
+        fork_switch(root);
+        switch_time += host_time() - t;
+
+        seed = seed * 1103515245 + 12345;
+        joypad_queue(cpu.cycle_count + (seed >> 16) % FRAME_CYCLES, (uint8_t)(seed >> 8));
+        ret = cpu_run(FRAME_CYCLES);
+        joypad_clear_queue();
+        checksums[i] = movie_state_checksum();
+
+        t = host_time();
+        branches[i] = fork_create();
+        fork_time += host_time() - t;
+        if (branches[i] == NULL)
+            ret = -1;
+    }
+    start = host_time() - start;
+
+    fork_get_stats(&stats);
+    printf("%d branches in %.3f s (%.1f us/branch)\n", NUM_BRANCHES, start, start * 1e6 / NUM_BRANCHES);
+    printf("fork: %.2f us, switch: %.2f us, full save state: %" PRIu32 " bytes\n",
+           fork_time * 1e6 / NUM_BRANCHES, switch_time * 1e6 / NUM_BRANCHES, savestate_size());
+    printf("pages: %" PRIu64 " copied, %" PRIu64 " shared, %" PRIu64 " restored, %" PRIu64 " live (%.0f bytes/fork)\n",
+           stats.pages_copied, stats.pages_shared, stats.pages_restored, stats.pages_live,
+           (double)stats.pages_live * sizeof(struct fork_page) / (NUM_BRANCHES + 1));
+
+    // Every branch has to come back exactly as it was left.
+    for (i = 0; i < NUM_BRANCHES && ret == 0; i++)
+    {
+        fork_switch(branches[(i * 7919) % NUM_BRANCHES]);
+        if (movie_state_checksum() != checksums[(i * 7919) % NUM_BRANCHES])
+        {
+            printf("branch %d DIFFERS\n", (i * 7919) % NUM_BRANCHES);
+            ret = -1;
+        }
+    }
+    if (ret == 0)
+        printf("all branches restore exactly\n");
+
+    for (i = 0; i < NUM_BRANCHES; i++)
+        fork_free(branches[i]);
+    fork_free(root);
+    fork_end();
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int ret = 1;
+
+    bench_load_loop(loop_body, sizeof(loop_body));
+
+    if (bench_memory_init())
+        return 1;
+    if (cpu_init())
+        goto err_mem;
+    if (ppu_init(PPU_RENDER_TIMING))
+        goto err_cpu;
+    if (dma_init())
+        goto err_ppu;
+    if (joypad_init())
+        goto err_dma;
+    if (apu_init(APU_OUTPUT_NONE, SAMPLE_RATE))
+        goto err_joypad;
+
+    ret = bench() ? 1 : 0;
+    if (ret)
+        fprintf(stderr, "Fork benchmark failed\n");
+
+    apu_end();
+err_joypad:
+    joypad_end();
+err_dma:
+    dma_end();
+err_ppu:
+    ppu_end();
+err_cpu:
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return ret;
+}
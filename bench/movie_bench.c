@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include "bench.h"
+#include "apu.h"
+#include "joypad.h"
+#include "movie.h"
+#include "ppu.h"
+#include "scheduler.h"
+#include "cpu/cpu.h"
+
+#define BENCH_FRAMES 1200
+#define INPUT_EVERY_FRAMES 7
+#define CHECKSUM_INTERVAL (FRAME_CYCLES * 60)
+#define SAMPLE_RATE 48000
+
+// Cycle at which the corrupted replay flips a byte of WRAM.
+#define CORRUPT_CYCLE ((uint64_t)FRAME_CYCLES * 600 + 1234)
+
+// Fold the joypad into B and WRAM, then select both button halves again.
+static const uint8_t loop_body[] = {
+    0xF0, 0x00, // LDH A,(P1)
+    0xA8, // XOR B
+    0x47, // LD B,A
+    0xEA, 0x00, 0xC0, // LD (C000),A
+    0xE6, 0x0F, // AND 0F
+    0xE0, 0x00 // LDH (P1),A
+};
+
+enum bench_mode
+{
+    BENCH_RECORD,
+    BENCH_REPLAY,
+    BENCH_REPLAY_CORRUPT
+};
+
+// Scripted input, a new button combination every few frames.
+static int queue_script()
+{
+    uint32_t seed = 12345;
+    uint64_t cycle;
+
+    for (cycle = FRAME_CYCLES; cycle < (uint64_t)BENCH_FRAMES * FRAME_CYCLES; cycle += INPUT_EVERY_FRAMES * FRAME_CYCLES)
+    {
+        seed = seed * 1103515245 + 12345;
+        if (joypad_queue(cycle + (seed >> 16) % FRAME_CYCLES, (uint8_t)(seed >> 24)))
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int run(const char *path, enum bench_mode mode, double *elapsed, uint64_t *diverged)
+{
+    uint64_t frames = BENCH_FRAMES;
+    double start;
+    int ret = 0;
+
+    if (bench_memory_init())
+        return -1;
+    if (cpu_init())
+        goto err_mem;
+    if (ppu_init(PPU_RENDER_FULL))
+        goto err_cpu;
+    if (joypad_init())
+        goto err_ppu;
+    if (apu_init(APU_OUTPUT_NONE, SAMPLE_RATE))
+        goto err_joypad;
+
+    if (mode == BENCH_RECORD)
+    {
+        if (movie_record(path, CHECKSUM_INTERVAL) || queue_script())
+            goto err_apu;
+    }
+    else if (movie_replay(path))
+    {
+        goto err_apu;
+    }
+
+    start = host_time();
+    if (mode == BENCH_REPLAY_CORRUPT)
+    {
+        ret = cpu_run(CORRUPT_CYCLE);
+        bench_wram[0x100] ^= 1;
+        frames -= CORRUPT_CYCLE / FRAME_CYCLES;
+    }
+    while (ret == 0 && frames-- && movie.diverged_cycle == SCHED_NEVER)
+    {
+        ret = cpu_run(FRAME_CYCLES);
+    }
+    *elapsed = host_time() - start;
+    *diverged = movie.diverged_cycle;
+
+    if (movie_end())
+        ret = -1;
+    apu_end();
+    joypad_end();
+    ppu_end();
+    cpu_end();
+    bench_memory_end();
+    return ret;
+
+err_apu:
+    apu_end();
+err_joypad:
+    joypad_end();
+err_ppu:
+    ppu_end();
+err_cpu:
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return -1;
+}
+
+int main(int argc, const char *argv[])
+{
+    const char *path = argc > 1 ? argv[1] : "/tmp/movie_bench.gbm";
+    double recording, replay, corrupt;
+    uint64_t diverged, corrupt_diverged;
+    FILE *file;
+    long size;
+
+    bench_load_loop(loop_body, sizeof(loop_body));
+
+    if (run(path, BENCH_RECORD, &recording, &diverged) ||
+        run(path, BENCH_REPLAY, &replay, &diverged) ||
+        run(path, BENCH_REPLAY_CORRUPT, &corrupt, &corrupt_diverged))
+    {
+        fprintf(stderr, "Movie benchmark failed\n");
+        return 1;
+    }
+
+    file = fopen(path, "rb");
+    size = file != NULL && !fseek(file, 0, SEEK_END) ? ftell(file) : -1;
+    if (file != NULL)
+        fclose(file);
+
+    printf("record: %d frames in %.3f s (%.1f us/frame), movie is %ld bytes\n",
+           BENCH_FRAMES, recording, recording * 1e6 / BENCH_FRAMES, size);
+    printf("replay: %d frames in %.3f s (%.1f us/frame), %s\n",
+           BENCH_FRAMES, replay, replay * 1e6 / BENCH_FRAMES, diverged == SCHED_NEVER ? "in sync" : "DIVERGED");
+    if (corrupt_diverged == SCHED_NEVER)
+    {
+        printf("corrupted replay: divergence NOT detected\n");
+        return 1;
+    }
+    printf("corrupted replay: corrupted at cycle %" PRIu64 ", divergence detected at cycle %" PRIu64 " (%.2f frames later)\n",
+           CORRUPT_CYCLE, corrupt_diverged, (double)(corrupt_diverged - CORRUPT_CYCLE) / FRAME_CYCLES);
+    return diverged == SCHED_NEVER ? 0 : 1;
+}
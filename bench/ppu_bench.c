@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include "bench.h"
+#include "bus.h"
+#include "ppu.h"
+#include "cpu/cpu.h"
+
+#define BENCH_FRAMES 600
+
+static const uint8_t loop_body[] = {0x04, 0x0C, 0x14, 0x1C}; // INC B, INC C, INC D, INC E
+
+// Busy background and a full OAM so the renderer does real work on every line.
+static void setup_scene()
+{
+    uint16_t i;
+
+    for (i = 0; i < 0x1800; i++)
+    {
+        bus_write((uint8_t)(i * 37), VRAM_ADDR + i);
+    }
+    for (i = 0; i < 0x800; i++)
+    {
+        bus_write((uint8_t)i, VRAM_ADDR + 0x1800 + i);
+    }
+    for (i = 0; i < OAM_SIZE / 4; i++)
+    {
+        bus_write(16 + (i * 4) % LCD_HEIGHT, OAM_ADDR + i * 4);
+        bus_write(8 + (i * 13) % LCD_WIDTH, OAM_ADDR + i * 4 + 1);
+        bus_write((uint8_t)i, OAM_ADDR + i * 4 + 2);
+        bus_write(i & 1 ? 0x30 : 0x80, OAM_ADDR + i * 4 + 3);
+    }
+    bus_write(0xE4, BGP_ADDR);
+    bus_write(0xD2, OBP0_ADDR);
+    bus_write(0x93, LCDC_ADDR);
+}
+
+static int run(enum ppu_render render, double *elapsed)
+{
+    double start;
+    int ret = 0;
+
+    if (bench_memory_init())
+        return -1;
+    if (cpu_init())
+        goto err_mem;
+    if (ppu_init(render))
+        goto err_cpu;
+
+    setup_scene();
+
+    start = host_time();
+    ret = cpu_run((uint64_t)BENCH_FRAMES * FRAME_CYCLES);
+    *elapsed = host_time() - start;
+
+    if (ppu.frames < BENCH_FRAMES - 1)
+    {
+        fprintf(stderr, "PPU completed only %" PRIu64 " frames\n", ppu.frames);
+        ret = -1;
+    }
+
+    ppu_end();
+    cpu_end();
+    bench_memory_end();
+    return ret;
+
+err_cpu:
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return -1;
+}
+
+int main(int argc, const char *argv[])
+{
+    double full, timing;
+
+    bench_load_loop(loop_body, sizeof(loop_body));
+
+    if (run(PPU_RENDER_FULL, &full) || run(PPU_RENDER_TIMING, &timing))
+    {
+        fprintf(stderr, "PPU benchmark failed\n");
+        return 1;
+    }
+
+    printf("ppu full:   %d frames in %.3f s (%.1f us/frame)\n", BENCH_FRAMES, full, full * 1e6 / BENCH_FRAMES);
+    printf("ppu timing: %d frames in %.3f s (%.1f us/frame)\n", BENCH_FRAMES, timing, timing * 1e6 / BENCH_FRAMES);
+    printf("rendering cost: %.1f us/frame (%.1f%% of full)\n",
+           (full - timing) * 1e6 / BENCH_FRAMES, (full - timing) * 100 / full);
+    return 0;
+}
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include "bench.h"
+#include "apu.h"
+#include "ppu.h"
+#include "recorder.h"
+#include "cpu/cpu.h"
+
+#define BENCH_FRAMES 1200
+#define SAMPLE_RATE 48000
+
+static const uint8_t loop_body[] = {0x04, 0x0C, 0x14, 0x1C}; // INC B, INC C, INC D, INC E
+
+static int run(const char *video_path, const char *audio_path, double *elapsed, struct recorder_stats *stats)
+{
+    uint8_t record = video_path != NULL || audio_path != NULL;
+    double start;
+    int ret = 0;
+
+    if (bench_memory_init())
+        return -1;
+    if (cpu_init())
+        goto err_mem;
+    if (ppu_init(PPU_RENDER_FULL))
+        goto err_cpu;
+    if (apu_init(APU_OUTPUT_SAMPLES, SAMPLE_RATE))
+        goto err_ppu;
+    if (record && recorder_start(video_path, audio_path))
+        goto err_apu;
+
+    bus_write(0x80, NR11_ADDR);
+    bus_write(0xF0, NR12_ADDR);
+    bus_write(0x86, NR14_ADDR);
+
+    start = host_time();
+    ret = cpu_run((uint64_t)BENCH_FRAMES * FRAME_CYCLES);
+    *elapsed = host_time() - start;
+
+    if (record && recorder_stop(stats))
+        ret = -1;
+    apu_end();
+    ppu_end();
+    cpu_end();
+    bench_memory_end();
+    return ret;
+
+err_apu:
+    apu_end();
+err_ppu:
+    ppu_end();
+err_cpu:
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return -1;
+}
+
+int main(int argc, const char *argv[])
+{
+    const char *video_path = argc > 1 ? argv[1] : "/dev/null";
+    const char *audio_path = argc > 2 ? argv[2] : "/dev/null";
+    struct recorder_stats stats;
+    double plain, recording;
+
+    bench_load_loop(loop_body, sizeof(loop_body));
+
+    if (run(NULL, NULL, &plain, NULL) || run(video_path, audio_path, &recording, &stats))
+    {
+        fprintf(stderr, "Recorder benchmark failed\n");
+        return 1;
+    }
+
+    printf("plain:     %d frames in %.3f s (%.1f us/frame)\n", BENCH_FRAMES, plain, plain * 1e6 / BENCH_FRAMES);
+    printf("recording: %d frames in %.3f s (%.1f us/frame)\n", BENCH_FRAMES, recording, recording * 1e6 / BENCH_FRAMES);
+    printf("time spent queueing on the emulation thread: %.1f us/frame\n", stats.queue_ns / 1e3 / BENCH_FRAMES);
+    printf("written %" PRIu64 " frames (%" PRIu64 " dropped), %" PRIu64 " audio frames (%" PRIu64 " dropped)\n",
+           stats.frames, stats.dropped_frames, stats.audio_frames, stats.dropped_audio_frames);
+    return 0;
+}
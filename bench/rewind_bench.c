@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include "bench.h"
+#include "apu.h"
+#include "dma.h"
+#include "joypad.h"
+#include "movie.h"
+#include "ppu.h"
+#include "rewind.h"
+#include "cpu/cpu.h"
+
+#define BENCH_FRAMES 1200
+#define REWIND_BUDGET (4 * 1024 * 1024)
+#define KEYFRAME_INTERVAL 60
+#define STEP_BACK_FRAMES 180
+#define SAMPLE_RATE 48000
+
+// Keeps changing a few bytes of WRAM and VRAM every frame.
+static const uint8_t loop_body[] = {
+    0x04, // INC B
+    0x78, // LD A,B
+    0xEA, 0x00, 0xC0, // LD (C000),A
+    0xEA, 0x00, 0x80, // LD (8000),A
+    0x22 // LD (HL+),A
+};
+
+static uint64_t checksums[BENCH_FRAMES];
+
+static int bench()
+{
+    struct rewind_stats stats;
+    uint32_t frame;
+    double start, elapsed;
+
+    if (rewind_init(REWIND_BUDGET, KEYFRAME_INTERVAL))
+        return -1;
+
+    start = host_time();
+    for (frame = 0; frame < BENCH_FRAMES; frame++)
+    {
+        // HL walks the first part of WRAM again every frame.
+        cpu.regs.hl = BENCH_WRAM_ADDR;
+        if (cpu_run(FRAME_CYCLES) || rewind_push())
+        {
+            rewind_end();
+            return -1;
+        }
+        checksums[frame] = movie_state_checksum();
+    }
+    elapsed = host_time() - start;
+
+    rewind_get_stats(&stats);
+    printf("%" PRIu64 " frames in %.3f s (%.1f us/frame)\n", stats.pushes, elapsed, elapsed * 1e6 / BENCH_FRAMES);
+    printf("snapshot cost: %.2f us/frame\n", stats.push_ns / 1e3 / stats.pushes);
+    printf("bytes per snapshot: %.0f\n", (double)stats.pushed_bytes / stats.pushes);
+    printf("held: %" PRIu32 " snapshots (%" PRIu32 " keyframes, %.1f s) in %" PRIu64 " of %d bytes\n",
+           stats.snapshots, stats.keyframes, stats.snapshots * (double)FRAME_CYCLES / CPU_FREQ, stats.bytes_used, REWIND_BUDGET);
+
+    start = host_time();
+    if (rewind_step_back(STEP_BACK_FRAMES))
+    {
+        rewind_end();
+        return -1;
+    }
+    elapsed = host_time() - start;
+
+    frame = BENCH_FRAMES - 1 - STEP_BACK_FRAMES;
+    printf("stepped back %d frames in %.1f us, state %s\n", STEP_BACK_FRAMES, elapsed * 1e6,
+           movie_state_checksum() == checksums[frame] ? "matches" : "DIFFERS");
+
+    rewind_end();
+    return movie_state_checksum() == checksums[frame] ? 0 : -1;
+}
+
+int main(int argc, const char *argv[])
+{
+    int ret = 1;
+
+    bench_load_loop(loop_body, sizeof(loop_body));
+
+    if (bench_memory_init())
+        return 1;
+    if (cpu_init())
+        goto err_mem;
+    if (ppu_init(PPU_RENDER_FULL))
+        goto err_cpu;
+    if (dma_init())
+        goto err_ppu;
+    if (joypad_init())
+        goto err_dma;
+    if (apu_init(APU_OUTPUT_NONE, SAMPLE_RATE))
+        goto err_joypad;
+
+    ret = bench() ? 1 : 0;
+    if (ret)
+        fprintf(stderr, "Rewind benchmark failed\n");
+
+    apu_end();
+err_joypad:
+    joypad_end();
+err_dma:
+    dma_end();
+err_ppu:
+    ppu_end();
+err_cpu:
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return ret;
+}
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "bench.h"
+#include "apu.h"
+#include "dma.h"
+#include "hash.h"
+#include "joypad.h"
+#include "movie.h"
+#include "ppu.h"
+#include "savestate.h"
+#include "cpu/cpu.h"
+
+#define ITERATIONS 100000
+#define WARMUP_FRAMES 30
+#define CHECK_FRAMES 10
+#define SAMPLE_RATE 48000
+
+static const uint8_t loop_body[] = {
+    0x04, // INC B
+    0x78, // LD A,B
+    0xEA, 0x00, 0xC0, // LD (C000),A
+    0xEA, 0x00, 0x80 // LD (8000),A
+};
+
+static uint64_t run_and_hash()
+{
+    uint64_t hash;
+
+    cpu_run((uint64_t)CHECK_FRAMES * FRAME_CYCLES);
+    hash = movie_state_checksum();
+    return hash_bytes(hash, ppu.framebuffer, sizeof(ppu.framebuffer));
+}
+
+static int bench()
+{
+    uint32_t size = savestate_size();
+    uint8_t *state = (uint8_t*)malloc(size);
+    uint64_t first, second;
+    double start, save_time, load_time;
+    uint32_t i;
+    int ret = -1;
+
+    if (state == NULL)
+        return -1;
+
+    cpu_run((uint64_t)WARMUP_FRAMES * FRAME_CYCLES + 1234);
+    if (savestate_save(state, size))
+        goto out;
+
+    start = host_time();
+    for (i = 0; i < ITERATIONS; i++)
+    {
+        savestate_save(state, size);
+    }
+    save_time = host_time() - start;
+
+    start = host_time();
+    for (i = 0; i < ITERATIONS; i++)
+    {
+        savestate_load(state, size);
+    }
+    load_time = host_time() - start;
+
+    // Running on from a loaded state has to end up exactly where running on from the save did.
+    first = run_and_hash();
+    if (savestate_load(state, size))
+        goto out;
+    second = run_and_hash();
+
+    printf("state size: %" PRIu32 " bytes\n", size);
+    printf("save: %.2f us\n", save_time * 1e6 / ITERATIONS);
+    printf("load: %.2f us\n", load_time * 1e6 / ITERATIONS);
+    printf("resumed run %s\n", first == second ? "matches" : "DIFFERS");
+    ret = first == second ? 0 : -1;
+
+out:
+    free(state);
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    int ret = 1;
+
+    bench_load_loop(loop_body, sizeof(loop_body));
+
+    if (bench_memory_init())
+        return 1;
+    if (cpu_init())
+        goto err_mem;
+    if (ppu_init(PPU_RENDER_FULL))
+        goto err_cpu;
+    if (dma_init())
+        goto err_ppu;
+    if (joypad_init())
+        goto err_dma;
+    if (apu_init(APU_OUTPUT_SAMPLES, SAMPLE_RATE))
+        goto err_joypad;
+
+    bus_write(0x80, NR11_ADDR);
+    bus_write(0xF0, NR12_ADDR);
+    bus_write(0x86, NR14_ADDR);
+
+    ret = bench() ? 1 : 0;
+    if (ret)
+        fprintf(stderr, "Save state benchmark failed\n");
+
+    apu_end();
+err_joypad:
+    joypad_end();
+err_dma:
+    dma_end();
+err_ppu:
+    ppu_end();
+err_cpu:
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return ret;
+}
@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include "bench.h"
+#include "bus.h"
+#include "ppu.h"
+#include "cpu/cpu.h"
+
+#define SEARCH_ITERATIONS 20000
+#define BENCH_FRAMES 600
+
+static const uint8_t loop_body[] = {0x04, 0x0C, 0x14, 0x1C}; // INC B, INC C, INC D, INC E
+
+enum scene
+{
+    SCENE_SPREAD, // Sprites spread over the whole screen.
+    SCENE_STACKED, // All 40 sprites on the same 16 lines.
+    SCENE_TALL, // 8x16 sprites in 4 rows of 10.
+    NUM_SCENES
+};
+
+static const char *scene_names[NUM_SCENES] = {"spread", "stacked", "tall"};
+
+// Straightforward per-entry OAM scan, the reference ppu_find_sprites is checked against.
+static uint8_t find_sprites_scalar(uint8_t ly, uint8_t *sprites)
+{
+    uint8_t i, j, count = 0, height = LCDC_OBJ_SIZE(ppu.regs.lcdc) ? 16 : 8;
+    int16_t top;
+
+    for (i = 0; i < NUM_SPRITES && count < MAX_SPRITES_PER_LINE; i++)
+    {
+        top = (int16_t)ppu.oam[i * 4] - 16;
+        if (ly >= top && ly < top + height)
+        {
+            for (j = count; j > 0 && ppu.oam[sprites[j - 1] * 4 + 1] > ppu.oam[i * 4 + 1]; j--)
+            {
+                sprites[j] = sprites[j - 1];
+            }
+            sprites[j] = i;
+            count++;
+        }
+    }
+    return count;
+}
+
+static void setup_scene(enum scene scene)
+{
+    uint16_t i;
+    uint8_t y, x;
+
+    for (i = 0; i < 0x1800; i++)
+    {
+        bus_write((uint8_t)(i * 37), VRAM_ADDR + i);
+    }
+    for (i = 0; i < NUM_SPRITES; i++)
+    {
+        switch (scene)
+        {
+        case SCENE_SPREAD:
+            y = 16 + (i * 4) % LCD_HEIGHT;
+            x = 8 + (i * 13) % LCD_WIDTH;
+            break;
+        case SCENE_STACKED:
+            y = 60 + (i & 7);
+            x = 8 + (i * 29) % LCD_WIDTH;
+            break;
+        default:
+            y = 16 + (i / 10) * 36;
+            x = 8 + (i % 10) * 15;
+            break;
+        }
+        bus_write(y, OAM_ADDR + i * 4);
+        bus_write(x, OAM_ADDR + i * 4 + 1);
+        bus_write((uint8_t)i, OAM_ADDR + i * 4 + 2);
+        bus_write(i & 1 ? 0x20 : 0x00, OAM_ADDR + i * 4 + 3);
+    }
+    bus_write(scene == SCENE_TALL ? 0x97 : 0x93, LCDC_ADDR);
+}
+
+static int check_search()
+{
+    uint8_t expected[MAX_SPRITES_PER_LINE], actual[MAX_SPRITES_PER_LINE];
+    uint8_t count, ly;
+
+    for (ly = 0; ly < LCD_HEIGHT; ly++)
+    {
+        count = find_sprites_scalar(ly, expected);
+        if (ppu_find_sprites(ly, actual) != count || memcmp(expected, actual, count))
+        {
+            fprintf(stderr, "Sprite search mismatch on line %d\n", ly);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static double time_search(uint8_t (*search)(uint8_t, uint8_t*))
+{
+    uint8_t sprites[MAX_SPRITES_PER_LINE];
+    volatile uint8_t sink = 0;
+    uint32_t i;
+    uint8_t ly;
+    double start = host_time();
+
+    for (i = 0; i < SEARCH_ITERATIONS; i++)
+    {
+        for (ly = 0; ly < LCD_HEIGHT; ly++)
+        {
+            sink += search(ly, sprites);
+        }
+    }
+    return (host_time() - start) * 1e9 / ((double)SEARCH_ITERATIONS * LCD_HEIGHT);
+}
+
+static int run(enum scene scene)
+{
+    double scalar, vector, start, frame;
+    int ret = -1;
+
+    if (bench_memory_init())
+        return -1;
+    if (cpu_init())
+        goto err_mem;
+    if (ppu_init(PPU_RENDER_FULL))
+        goto err_cpu;
+
+    setup_scene(scene);
+    if (check_search())
+        goto end;
+
+    scalar = time_search(find_sprites_scalar);
+    vector = time_search(ppu_find_sprites);
+
+    start = host_time();
+    ret = cpu_run((uint64_t)BENCH_FRAMES * FRAME_CYCLES);
+    frame = (host_time() - start) * 1e6 / BENCH_FRAMES;
+
+    printf("%-8s search: scalar %6.1f ns/line, vector %6.1f ns/line (%.2fx); full render %.1f us/frame\n",
+           scene_names[scene], scalar, vector, scalar / vector, frame);
+
+end:
+    ppu_end();
+err_cpu:
+    cpu_end();
+err_mem:
+    bench_memory_end();
+    return ret;
+}
+
+int main(int argc, const char *argv[])
+{
+    uint8_t scene;
+
+    bench_load_loop(loop_body, sizeof(loop_body));
+
+    for (scene = 0; scene < NUM_SCENES; scene++)
+    {
+        if (run(scene))
+        {
+            fprintf(stderr, "Sprite benchmark failed\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,114 @@
+#ifndef APU__
+#define APU__
+
+#include <inttypes.h>
+#include "blip.h"
+
+#define NR10_ADDR 0xFF10 // Channel 1 sweep
+#define NR11_ADDR 0xFF11 // Channel 1 duty/length
+#define NR12_ADDR 0xFF12 // Channel 1 envelope
+#define NR13_ADDR 0xFF13 // Channel 1 frequency low
+#define NR14_ADDR 0xFF14 // Channel 1 trigger/length enable/frequency high
+#define NR21_ADDR 0xFF16
+#define NR22_ADDR 0xFF17
+#define NR23_ADDR 0xFF18
+#define NR24_ADDR 0xFF19
+#define NR30_ADDR 0xFF1A // Channel 3 DAC enable
+#define NR31_ADDR 0xFF1B
+#define NR32_ADDR 0xFF1C // Channel 3 output level
+#define NR33_ADDR 0xFF1D
+#define NR34_ADDR 0xFF1E
+#define NR41_ADDR 0xFF20
+#define NR42_ADDR 0xFF21
+#define NR43_ADDR 0xFF22 // Channel 4 clock shift/width/divisor
+#define NR44_ADDR 0xFF23
+#define NR50_ADDR 0xFF24 // Master volume
+#define NR51_ADDR 0xFF25 // Panning
+#define NR52_ADDR 0xFF26 // Power and channel status
+#define APU_REGS_SIZE (NR52_ADDR - NR10_ADDR + 1)
+
+#define WAVE_RAM_ADDR 0xFF30
+#define WAVE_RAM_SIZE 0x10
+
+#define NR52_POWER(nr52) (nr52 & 0x80)
+
+#define NUM_APU_CHANNELS 4
+
+// The frame sequencer clocks length counters, sweep and envelopes at 512Hz.
+#define FRAME_SEQ_CYCLES 8192
+
+// Capacity of the internal sample buffer, samples not read in time are dropped.
+#define APU_BUFFER_FRAMES 8192
+
+enum apu_output
+{
+    APU_OUTPUT_SAMPLES, // Full synthesis into the sample buffer.
+    APU_OUTPUT_NONE // Only the state the CPU can observe (NR52, length, sweep, envelope) is kept.
+};
+
+struct apu_envelope
+{
+    uint8_t volume;
+    uint8_t increase;
+    uint8_t period;
+    uint8_t timer;
+};
+
+struct apu_channel
+{
+    uint8_t enabled;
+    uint8_t dac; // The DAC is on, a disabled channel with DAC on outputs silence.
+    uint8_t length_enable;
+    uint16_t length; // Steps left until the length counter disables the channel.
+    uint16_t freq; // 11-bit frequency of pulse and wave channels.
+    uint8_t pos; // Duty step or wave sample.
+    uint32_t period; // Clock cycles per waveform step.
+    uint64_t next_step; // Cycle of the next waveform step.
+    struct apu_envelope envelope;
+    float left; // Level last sent to the left mixer output.
+    float right; // Level last sent to the right mixer output.
+};
+
+struct apu_sweep
+{
+    uint8_t enabled;
+    uint8_t period;
+    uint8_t timer;
+    uint16_t shadow;
+};
+
+struct apu_struct
+{
+    uint8_t regs[APU_REGS_SIZE]; // Last written register values.
+    uint8_t wave_ram[WAVE_RAM_SIZE];
+    struct apu_channel channels[NUM_APU_CHANNELS];
+    struct apu_sweep sweep;
+    uint16_t lfsr; // Noise shift register.
+    uint8_t frame_seq_step;
+    uint64_t frame_seq_cycle; // Cycle of the next frame sequencer step.
+    uint64_t sync_cycle; // Cycle the APU has been synthesized up to.
+    enum apu_output output;
+    uint32_t sample_rate;
+    struct blip_buffer blip_left;
+    struct blip_buffer blip_right;
+};
+
+// Global APU.
+extern struct apu_struct apu;
+
+// Bus handlers, wave RAM reads are served by the bus from apu.wave_ram.
+int apu_reg_read(uint8_t *result, uint16_t addr);
+int apu_reg_write(uint8_t val, uint16_t addr);
+int apu_wave_write(uint8_t val, uint16_t addr);
+
+int apu_init(enum apu_output output, uint32_t sample_rate);
+int apu_end();
+
+// Synthesize up to the current cycle.
+void apu_sync();
+
+// Synthesize up to the current cycle and move up to max_frames interleaved stereo frames to out.
+// out may be NULL to discard them. Always 0 with APU_OUTPUT_NONE.
+uint32_t apu_read_samples(int16_t *out, uint32_t max_frames);
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef BLIP__
+#define BLIP__
+
+#include <inttypes.h>
+
+// Band-limited step synthesis: a signal is described by the clock times and sizes of its
+// amplitude changes, each of which is drawn into the sample buffer as a band-limited step.
+// Clock times are relative to the end of the last frame.
+
+#define BLIP_PHASES 32 // Sub-sample resolution of step positions.
+#define BLIP_TAPS   16 // Length of a single step, in samples.
+
+struct blip_buffer
+{
+    uint64_t factor; // Samples per clock, 32.32 fixed point.
+    uint64_t offset; // Position of the current frame start in samples, 32.32 fixed point.
+    uint32_t size; // Capacity in samples.
+    float integrator; // Running sum of the step deltas, the current amplitude.
+    float dc; // DC level removed from the output.
+    float *deltas; // size + BLIP_TAPS entries.
+};
+
+int blip_init(struct blip_buffer *blip, uint32_t size, uint32_t clock_rate, uint32_t sample_rate);
+void blip_free(struct blip_buffer *blip);
+void blip_clear(struct blip_buffer *blip);
+
+// Number of clocks that can still be added before the buffer is full.
+uint32_t blip_clocks_left(struct blip_buffer *blip);
+
+void blip_add_delta(struct blip_buffer *blip, uint32_t clock_time, float delta);
+void blip_end_frame(struct blip_buffer *blip, uint32_t clock_duration);
+
+uint32_t blip_samples_avail(struct blip_buffer *blip);
+
+// Move up to count finished samples to out, writing one every stride entries.
+uint32_t blip_read_samples(struct blip_buffer *blip, int16_t *out, uint32_t count, uint8_t stride);
+
+#endif
@@ -3,8 +3,14 @@
 
 #include <inttypes.h>
 
+// Writes are tracked per page of the address space.
+#define BUS_PAGE_SHIFT 8
+#define BUS_PAGE_SIZE  (1 << BUS_PAGE_SHIFT)
+#define BUS_NUM_PAGES  (0x10000 >> BUS_PAGE_SHIFT)
+
 typedef int(*bus_read_t)(uint8_t*,uint16_t);
 typedef int(*bus_write_t)(uint8_t,uint16_t);
+typedef void(*bus_memory_func_t)(uint16_t start_address, uint16_t size, uint8_t *mem, uint8_t read_only, void *arg);
 
 struct bus_connection {
 	struct bus_connection *next;
@@ -12,11 +18,34 @@ struct bus_connection {
 	uint16_t size;
 	bus_read_t read_func;
 	bus_write_t write_func;
+	uint8_t *mem; // Host buffer backing the region, reads are served from it directly.
+	uint8_t read_only; // Writes never reach mem, only write_func if there is one.
 };
 
 int add_bus_connection(uint16_t start_address, uint16_t size, bus_read_t read_func, bus_write_t write_func);
+int add_bus_memory(uint16_t start_address, uint16_t size, uint8_t *mem, bus_write_t write_func);
+int add_bus_rom(uint16_t start_address, uint16_t size, uint8_t *mem, bus_write_t write_func);
 int remove_bus_connection(uint16_t start_address);
 
+// Host buffer holding [address, address + size), or NULL if no single buffer backs that range.
+uint8_t *bus_get_memory(uint16_t address, uint16_t size);
+
+// Call func for every region backed by a host buffer, in address order.
+void bus_for_each_memory(bus_memory_func_t func, void *arg);
+
+// Pages written since the last bus_clear_dirty, for copy-on-write snapshots. Owners that change
+// their memory without going through the bus have to mark it themselves.
+void bus_mark_dirty(uint16_t address, uint32_t size);
+void bus_clear_dirty();
+int bus_is_dirty(uint8_t page);
+
+// With open set, reads from unmapped addresses return 0xFF and writes to them are dropped, as on
+// hardware. Otherwise both fail, which catches programs that stray off the mapped devices.
+void bus_set_open(uint8_t open);
+
+// While limit is non zero, reads below it return 0xFF and writes below it are ignored.
+void bus_lock(uint16_t limit);
+
 int bus_read(uint8_t *result, uint16_t src);
 int bus_write(uint8_t src, uint16_t dst);
 
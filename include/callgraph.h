@@ -0,0 +1,56 @@
+#ifndef CALLGRAPH__
+#define CALLGRAPH__
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#define CALLGRAPH_MAX_DEPTH 256
+
+// Call graph profiler of the guest. A shadow call stack follows CALL, RST and interrupt dispatch
+// and their returns, and cycles are accumulated per calling context (the chain of callees from
+// the root). A return pops the frame whose return address it consumes, along with any deeper
+// frames that were left through stack tricks. Returns that match no frame, like a pushed address
+// used as a jump, leave the stack alone.
+struct callgraph_stats
+{
+    uint64_t calls;
+    uint64_t unwound; // Frames dropped without their own return.
+    uint64_t dropped; // Calls not tracked because the stack or the context table was full.
+    uint32_t contexts;
+};
+
+// Tracked calls are skipped while this is 0.
+extern uint8_t callgraph_enabled;
+
+void callgraph_enter(uint16_t target, uint16_t sp);
+void callgraph_leave(uint16_t sp);
+
+// Called by the call handlers and interrupt dispatch with SP pointing at the pushed return address.
+static inline void callgraph_call(uint16_t target, uint16_t sp)
+{
+    if (callgraph_enabled)
+        callgraph_enter(target, sp);
+}
+
+// Called by the return handlers with SP pointing at the return address about to be popped.
+static inline void callgraph_ret(uint16_t sp)
+{
+    if (callgraph_enabled)
+        callgraph_leave(sp);
+}
+
+// Start tracking calls from an empty stack, dropping earlier results.
+int callgraph_start();
+void callgraph_stop();
+void callgraph_end();
+
+// Print the num functions with the most inclusive cycles, along with their exclusive cycles and
+// calls. Callees are named through the profiler symbols.
+int callgraph_report(FILE *file, uint32_t num);
+
+// Write the exclusive cycles of every calling context as folded stacks, for flame graph tools.
+int callgraph_write_folded(FILE *file);
+
+void callgraph_get_stats(struct callgraph_stats *stats);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef CART__
+#define CART__
+
+#include <inttypes.h>
+
+#define CART_ROM_ADDR       0x0000
+#define CART_ROM_BANK_ADDR  0x4000
+#define CART_ROM_BANK_SIZE  0x4000
+#define CART_RAM_ADDR       0xA000
+#define CART_RAM_SIZE       0x2000
+
+// Cartridge header fields.
+#define CART_TYPE_ADDR     0x0147
+#define CART_ROM_SIZE_ADDR 0x0148
+#define CART_RAM_SIZE_ADDR 0x0149
+
+#define CART_MAX_ROM_SIZE (2 * 1024 * 1024)
+
+enum cart_mbc
+{
+    CART_MBC_NONE,
+    CART_MBC1
+};
+
+// MBC registers, the only cartridge state a program can change besides RAM.
+struct cart_regs
+{
+    uint8_t rom_bank; // Lower 5 bits of the ROM bank.
+    uint8_t bank_high; // Upper 2 bits of the ROM bank.
+};
+
+struct cart_struct
+{
+    struct cart_regs regs;
+    enum cart_mbc mbc;
+    uint8_t *rom;
+    uint32_t rom_size;
+    uint8_t has_ram;
+    uint8_t ram[CART_RAM_SIZE];
+};
+
+// Global cartridge.
+extern struct cart_struct cart;
+
+// Bus handlers
+int cart_rom_bank_read(uint8_t *result, uint16_t addr);
+int cart_mbc_write(uint8_t val, uint16_t addr); // 0x0000-0x3FFF
+int cart_mbc_write_high(uint8_t val, uint16_t addr); // 0x4000-0x7FFF
+
+// ROM bank mapped at 0x4000, 1 without a cartridge.
+uint32_t cart_rom_bank();
+
+// Map the ROM in path and its RAM, if it has any. Supports plain 32 KiB ROMs and MBC1 with up to
+// 2 MiB of ROM and a single RAM bank, which is always enabled.
+int cart_load(const char *path);
+int cart_end();
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef COVERAGE__
+#define COVERAGE__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define COVERAGE_MAP_SIZE 0x10000 // Default map size, the same as AFL++ uses.
+
+// Edge coverage of guest code. Every taken jump, call, return and interrupt hits one counter of
+// the map, picked by hashing the PC it leaves from and the PC it goes to. Counters wrap around
+// like AFL++ expects. Collection is off until a map is attached, which leaves a single check of
+// the map pointer per taken branch.
+struct coverage_struct
+{
+    uint8_t *map; // NULL while disabled.
+    uint32_t mask; // Map size - 1.
+    int shm_id; // Attached System V shared memory, -1 for a caller provided map.
+};
+
+// Global coverage state.
+extern struct coverage_struct coverage;
+
+// Record the edge from -> to. Called by the branch handlers and interrupt dispatch.
+static inline void coverage_edge(uint16_t from, uint16_t to)
+{
+    uint32_t edge;
+
+    if (coverage.map == NULL)
+    {
+        return;
+    }
+
+    // Scramble both ends so nearby edges spread over the map, and shift the source so A -> B and
+    // B -> A are different edges.
+    edge = ((uint32_t)from * 0x9E3779B1u) >> 16;
+    edge = edge >> 1 ^ (((uint32_t)to * 0x85EBCA77u) >> 16);
+    coverage.map[edge & coverage.mask]++;
+}
+
+// Collect into map, which has to be a power of two in size. It is not cleared.
+int coverage_enable(uint8_t *map, uint32_t size);
+
+// Collect into the shared memory segment shm_id, as created with shmget by another process.
+int coverage_attach(int shm_id, uint32_t size);
+
+// Attach to the map of afl-fuzz if run by it, from __AFL_SHM_ID and AFL_MAP_SIZE. Returns -1
+// when not run by afl-fuzz.
+int coverage_attach_afl();
+
+// Stop collecting and detach from shared memory.
+void coverage_disable();
+
+void coverage_clear();
+
+// Number of map entries hit at least once, for completeness reports.
+uint32_t coverage_count();
+
+#endif
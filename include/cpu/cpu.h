@@ -4,6 +4,8 @@
 #include "cpu/interrupts.h"
 #include "cpu/timer.h"
 
+#define CPU_FREQ 4194304 // Clock cycles per second.
+
 enum cpu_state
 {
     STATE_NORMAL,
@@ -17,6 +19,10 @@ struct cpu_struct
     struct registers regs;
     enum cpu_state state;
     uint8_t ime; // Interrupt Master Enable flag
+    uint8_t enable_irq; // Pending EI, applied after the following instruction
+    uint8_t disable_irq; // Pending DI, applied after the following instruction
+    uint8_t cycles; // Cycles left until the current instruction is done
+    uint64_t cycle_count; // Clock cycles elapsed since cpu_init
     struct irq_register if_flags; // Interrupt Flags
     struct irq_register ie_flags; // Interrupt Enable
     struct timer_regs timer_regs;
@@ -25,6 +31,10 @@ struct cpu_struct
 // Global CPU.
 extern struct cpu_struct cpu;
 
+int cpu_init();
+int cpu_end();
+
+int cpu_run(uint64_t num_cycles);
 void cpu_loop();
 
 #endif
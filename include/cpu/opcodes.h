@@ -24,6 +24,9 @@ OPCODE(INVAL);
 
 extern struct opcode opcodes[NUM_OPCODES];
 
+// Sub-opcode of the last CB prefixed instruction executed, so it is not fetched twice.
+extern uint8_t cb_opcode;
+
 void register_opcodes();
 
 #endif
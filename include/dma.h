@@ -0,0 +1,28 @@
+#ifndef DMA__
+#define DMA__
+
+#include <inttypes.h>
+
+#define DMA_ADDR 0xFF46
+
+// OAM DMA keeps the CPU off the bus (everything below the I/O registers) for 160 machine cycles.
+#define DMA_CYCLES     640
+#define DMA_LOCK_LIMIT 0xFF00
+
+struct dma_struct
+{
+    uint8_t source; // Last value written to DMA, the high byte of the source address.
+    uint8_t active; // Set while the transfer window is open.
+};
+
+// Global OAM DMA engine.
+extern struct dma_struct dma;
+
+// Bus handlers
+int dma_read(uint8_t *result, uint16_t addr);
+int dma_write(uint8_t val, uint16_t addr);
+
+int dma_init();
+int dma_end();
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef FORK__
+#define FORK__
+
+#include <inttypes.h>
+#include "bus.h"
+
+// A copy of one bus page of emulated memory, shared by every fork in which it is unchanged.
+struct fork_page
+{
+    uint32_t refs;
+    uint8_t data[BUS_PAGE_SIZE];
+};
+
+// Complete machine state at the time it was forked. Pages of memory that were not written since
+// the fork that was current back then are shared with it instead of copied.
+struct fork
+{
+    uint8_t *devices;
+    struct fork_page **pages;
+};
+
+struct fork_stats
+{
+    uint64_t forks; // Forks taken.
+    uint64_t pages_copied; // Pages copied by forks, the rest were shared.
+    uint64_t pages_shared;
+    uint64_t pages_restored; // Pages copied back by fork_switch.
+    uint64_t pages_live; // Pages currently allocated.
+};
+
+// Split the writable bus memory into pages. Has to be called after every device is set up, and
+// again if the bus layout changes.
+int fork_init();
+void fork_end();
+
+// Fork the machine as it is now. The new fork becomes the current one.
+struct fork *fork_create();
+
+// Make the machine the state of fork. Only pages that differ from the live memory are copied.
+void fork_switch(struct fork *fork);
+
+void fork_free(struct fork *fork);
+
+// Compare the machine states held by two forks. Returns 0 if they are the same. Otherwise returns 1
+// and sets address to the first byte of memory that differs, or to -1 if only devices differ.
+int fork_compare(const struct fork *a, const struct fork *b, int32_t *address);
+
+void fork_get_stats(struct fork_stats *stats);
+
+#endif
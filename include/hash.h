@@ -0,0 +1,44 @@
+#ifndef HASH__
+#define HASH__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+#define HASH_SEED 0xCBF29CE484222325ULL // FNV-1a 64 bit offset basis
+#define HASH_PRIME 0x100000001B3ULL
+
+// 64 bit FNV-1a, chained by passing the previous result as the seed.
+static inline uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t*)data;
+    size_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        hash = (hash ^ bytes[i]) * HASH_PRIME;
+    }
+    return hash;
+}
+
+static inline uint64_t hash_u8(uint64_t hash, uint8_t val)
+{
+    return (hash ^ val) * HASH_PRIME;
+}
+
+static inline uint64_t hash_u16(uint64_t hash, uint16_t val)
+{
+    return hash_u8(hash_u8(hash, (uint8_t)val), (uint8_t)(val >> 8));
+}
+
+static inline uint64_t hash_u64(uint64_t hash, uint64_t val)
+{
+    uint8_t i;
+
+    for (i = 0; i < 8; i++)
+    {
+        hash = hash_u8(hash, (uint8_t)(val >> (i * 8)));
+    }
+    return hash;
+}
+
+#endif
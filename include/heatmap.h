@@ -0,0 +1,44 @@
+#ifndef HEATMAP__
+#define HEATMAP__
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#define HEATMAP_ADDRESSES 0x10000
+#define HEATMAP_PAGE_SHIFT 8
+#define HEATMAP_IO_ADDR 0xFF00 // Accesses from here on are also reported per register.
+
+// Bus reads and writes per address, counted by bus_read and bus_write while enabled. Reports
+// sum them per 256 byte page, and list 0xFF00-0xFFFF per register.
+struct heatmap_struct
+{
+    uint64_t reads[HEATMAP_ADDRESSES];
+    uint64_t writes[HEATMAP_ADDRESSES];
+};
+
+// Counters being collected, NULL while disabled.
+extern struct heatmap_struct *heatmap;
+
+static inline void heatmap_read(uint16_t addr)
+{
+    if (heatmap != NULL)
+        heatmap->reads[addr]++;
+}
+
+static inline void heatmap_write(uint16_t addr)
+{
+    if (heatmap != NULL)
+        heatmap->writes[addr]++;
+}
+
+// Start counting from zero.
+int heatmap_enable();
+void heatmap_disable();
+void heatmap_clear();
+
+// Write the pages and I/O registers accessed at least once as CSV lines of
+// "label,kind,address,reads,writes", kind being page or io. With a header the column names come
+// first. The label tells apart dumps written to the same file, like a frame number.
+int heatmap_write_csv(FILE *file, uint64_t label, int header);
+
+#endif
@@ -0,0 +1,129 @@
+#ifndef HOSTPROF__
+#define HOSTPROF__
+
+#include <inttypes.h>
+#include "scheduler.h"
+#if defined(HOSTPROF) && (defined(__x86_64__) || defined(__i386__))
+#include <x86intrin.h>
+#elif defined(HOSTPROF)
+#include "hosttime.h"
+#endif
+
+// Host time accounting per emulator subsystem. Only built with -DHOSTPROF, otherwise the probes
+// compile to nothing. Time is charged exclusively: a bus callback made by an opcode counts for its
+// bus region and not for the opcode. The probes themselves take some time, which goes to whatever
+// encloses them.
+enum hostprof_region
+{
+    HOSTPROF_REGION_ROM,
+    HOSTPROF_REGION_VRAM,
+    HOSTPROF_REGION_CART_RAM,
+    HOSTPROF_REGION_WRAM,
+    HOSTPROF_REGION_OAM,
+    HOSTPROF_REGION_IO,
+    HOSTPROF_REGION_HRAM,
+    HOSTPROF_NUM_REGIONS
+};
+
+enum hostprof_slot
+{
+    HOSTPROF_HOST, // Outside of cpu_run.
+    HOSTPROF_DISPATCH, // The CPU loop: fetch, decode, cycle and scheduler bookkeeping.
+    HOSTPROF_OPCODE,
+    HOSTPROF_TIMER,
+    HOSTPROF_IRQ,
+    HOSTPROF_SCHED, // One slot per scheduler event.
+    HOSTPROF_BUS = HOSTPROF_SCHED + NUM_SCHED_EVENTS, // Bus callbacks, one slot per region.
+    NUM_HOSTPROF_SLOTS = HOSTPROF_BUS + HOSTPROF_NUM_REGIONS
+};
+
+#define HOSTPROF_MAX_DEPTH 16
+
+struct hostprof_struct
+{
+    uint8_t enabled;
+    uint32_t depth;
+    uint8_t stack[HOSTPROF_MAX_DEPTH];
+    uint64_t last; // Ticks when the top of the stack was last charged.
+    uint64_t ticks[NUM_HOSTPROF_SLOTS];
+    uint64_t calls[NUM_HOSTPROF_SLOTS];
+};
+
+#ifdef HOSTPROF
+
+extern struct hostprof_struct hostprof;
+
+static inline uint64_t hostprof_ticks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return host_ns();
+#endif
+}
+
+static inline void hostprof_charge()
+{
+    uint64_t now = hostprof_ticks();
+    uint32_t top = hostprof.depth < HOSTPROF_MAX_DEPTH ? hostprof.depth : HOSTPROF_MAX_DEPTH;
+
+    hostprof.ticks[hostprof.stack[top - 1]] += now - hostprof.last;
+    hostprof.last = now;
+}
+
+static inline void hostprof_enter(uint32_t slot)
+{
+    if (!hostprof.enabled)
+        return;
+
+    hostprof_charge();
+    if (hostprof.depth < HOSTPROF_MAX_DEPTH)
+        hostprof.stack[hostprof.depth] = (uint8_t)slot;
+    hostprof.depth++;
+    hostprof.calls[slot]++;
+}
+
+static inline void hostprof_leave()
+{
+    if (!hostprof.enabled || hostprof.depth <= 1)
+        return;
+
+    hostprof_charge();
+    hostprof.depth--;
+}
+
+static inline uint32_t hostprof_region(uint16_t addr)
+{
+    if (addr < 0x8000)
+        return HOSTPROF_REGION_ROM;
+    if (addr < 0xA000)
+        return HOSTPROF_REGION_VRAM;
+    if (addr < 0xC000)
+        return HOSTPROF_REGION_CART_RAM;
+    if (addr < 0xFE00)
+        return HOSTPROF_REGION_WRAM;
+    if (addr < 0xFF00)
+        return HOSTPROF_REGION_OAM;
+    if (addr < 0xFF80 || addr == 0xFFFF)
+        return HOSTPROF_REGION_IO;
+    return HOSTPROF_REGION_HRAM;
+}
+
+#define HOSTPROF_ENTER(slot) hostprof_enter(slot)
+#define HOSTPROF_LEAVE() hostprof_leave()
+
+#else
+
+#define HOSTPROF_ENTER(slot)
+#define HOSTPROF_LEAVE()
+
+#endif
+
+// Start charging host time, from zero, and print the summary to stderr when the process exits.
+// Fails when built without HOSTPROF.
+int hostprof_start();
+
+// Print the time per slot, with the share of the total and the average per call.
+void hostprof_report();
+
+#endif
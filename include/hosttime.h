@@ -0,0 +1,25 @@
+#ifndef HOSTTIME__
+#define HOSTTIME__
+
+#include <inttypes.h>
+#include <time.h>
+
+// Monotonic host time in nanoseconds.
+static inline uint64_t host_ns()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Monotonic host time in seconds.
+static inline double host_time()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#endif
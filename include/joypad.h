@@ -0,0 +1,65 @@
+#ifndef JOYPAD__
+#define JOYPAD__
+
+#include <inttypes.h>
+
+#define JOYPAD_ADDR 0xFF00
+
+// P1 bits selecting which half of the buttons is read, active low.
+#define JOYPAD_SELECT_DPAD    0x10
+#define JOYPAD_SELECT_BUTTONS 0x20
+#define JOYPAD_SELECT_MASK    (JOYPAD_SELECT_DPAD | JOYPAD_SELECT_BUTTONS)
+
+// Capacity of the input queue, joypad_queue fails once it is full.
+#define JOYPAD_QUEUE_SIZE 256
+
+// Button bits, a set bit means the button is held. The low nibble is the d-pad, the high nibble
+// the buttons, both in the order the P1 register reports them.
+#define JOYPAD_RIGHT  0x01
+#define JOYPAD_LEFT   0x02
+#define JOYPAD_UP     0x04
+#define JOYPAD_DOWN   0x08
+#define JOYPAD_A      0x10
+#define JOYPAD_B      0x20
+#define JOYPAD_SELECT 0x40
+#define JOYPAD_START  0x80
+
+// From cycle on, exactly the buttons in the mask are held.
+struct joypad_event
+{
+    uint64_t cycle;
+    uint8_t buttons;
+};
+
+struct joypad_struct
+{
+    uint8_t select; // P1 bits 4-5 as last written.
+    uint8_t buttons; // Buttons held right now.
+    struct joypad_event queue[JOYPAD_QUEUE_SIZE];
+    uint16_t queue_head;
+    uint16_t queue_count;
+};
+
+// Called whenever queued input takes effect, with the cycle it took effect at.
+typedef void(*joypad_input_callback_t)(uint64_t cycle, uint8_t buttons);
+
+// Global joypad.
+extern struct joypad_struct joypad;
+
+// Bus handlers
+int joypad_read(uint8_t *result, uint16_t addr);
+int joypad_write(uint8_t val, uint16_t addr);
+
+int joypad_init();
+int joypad_end();
+
+// Hold buttons from cycle on. Events must be queued in cycle order, one due in the past is applied
+// on the next clock cycle. Returns -1 if the queue is full or the event is out of order.
+int joypad_queue(uint64_t cycle, uint8_t buttons);
+
+void joypad_set_input_callback(joypad_input_callback_t callback);
+
+// Drop every event that was not applied yet.
+void joypad_clear_queue();
+
+#endif
@@ -0,0 +1,16 @@
+#ifndef MACHINE__
+#define MACHINE__
+
+#include <inttypes.h>
+
+// Sample rate the APU is set up with, it only matters to the length of the frame sequencer steps.
+#define MACHINE_SAMPLE_RATE 48000
+
+// Set up every device of a headless machine with open bus, for the tools that run ROMs without
+// a window. The ROM at rom_path becomes the cartridge.
+int machine_init(const char *rom_path);
+// Same, with size bytes of program mapped flat from address 0 instead of a cartridge.
+int machine_init_program(uint8_t *program, uint16_t size);
+void machine_end();
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef MARKERS__
+#define MARKERS__
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#define MARKERS_MAX 65536
+#define MARKER_MAX_MESSAGE 64
+
+// Source level markers of the guest, the convention of other emulators: LD B,B is a breakpoint
+// and LD D,D a message, written as
+//     ld d, d
+//     jr .end
+//     dw $6464, $0000
+//     db "message"
+// .end
+// While enabled, both record the cycle they execute at, so guest code can time itself exactly.
+enum marker_kind
+{
+    MARKER_BREAK,
+    MARKER_MESSAGE
+};
+
+struct marker
+{
+    uint64_t cycle; // When the marker instruction started.
+    uint16_t pc;
+    uint8_t kind;
+    char message[MARKER_MAX_MESSAGE]; // Empty without one.
+};
+
+// Markers are plain loads while this is 0.
+extern uint8_t markers_enabled;
+
+void markers_hit(enum marker_kind kind, uint16_t pc);
+
+// Called by the LD B,B and LD D,D handlers.
+static inline void marker(enum marker_kind kind, uint16_t pc)
+{
+    if (markers_enabled)
+        markers_hit(kind, pc);
+}
+
+// Start recording into an empty table. Markers past MARKERS_MAX are counted but not kept.
+int markers_start();
+void markers_stop();
+void markers_end();
+
+uint32_t markers_count();
+const struct marker *markers_get(uint32_t index);
+
+// Print every marker with the cycles since the previous one, then the cycles between every pair
+// of consecutive marker addresses: count, minimum, average and maximum.
+int markers_report(FILE *file);
+
+#endif
@@ -0,0 +1,89 @@
+#ifndef MOVIE__
+#define MOVIE__
+
+#include <inttypes.h>
+#include <stdio.h>
+
+// Movie file layout, all values little endian:
+//   header: "GBMV", version (u16), reserved (u16), ROM hash (u64), start cycle (u64),
+//           start state checksum (u64), checksum interval in cycles (u32), start state size (u32)
+//   start state: save state of the machine the recording started from
+//   records: type (u8), cycles since the previous record (LEB128), payload
+#define MOVIE_MAGIC "GBMV"
+#define MOVIE_VERSION 2
+#define MOVIE_HEADER_SIZE 40
+
+// Default distance between embedded state checksums, one second of emulated time.
+#define MOVIE_CHECKSUM_INTERVAL 4194304
+
+// ROM area hashed to match a movie with the game it was recorded on.
+#define MOVIE_ROM_ADDR 0x0000
+#define MOVIE_ROM_SIZE 0x8000
+
+enum movie_record
+{
+    MOVIE_RECORD_INPUT, // Payload: held buttons (u8).
+    MOVIE_RECORD_CHECKSUM, // Payload: state checksum (u64).
+    MOVIE_RECORD_END // No payload.
+};
+
+enum movie_mode
+{
+    MOVIE_OFF,
+    MOVIE_RECORDING,
+    MOVIE_REPLAYING
+};
+
+struct movie_input
+{
+    uint64_t cycle;
+    uint8_t buttons;
+};
+
+struct movie_checksum
+{
+    uint64_t cycle;
+    uint64_t checksum;
+};
+
+struct movie_struct
+{
+    enum movie_mode mode;
+    FILE *file; // Recording only.
+    uint64_t rom_hash;
+    uint64_t start_cycle;
+    uint64_t end_cycle; // Replay only, cycle the recording was stopped at.
+    uint32_t interval;
+    uint64_t last_cycle; // Cycle of the last record written.
+    uint64_t diverged_cycle; // First cycle the replay no longer matched, SCHED_NEVER while it does.
+
+    // Replay only, the whole movie is loaded up front.
+    struct movie_input *inputs;
+    uint32_t num_inputs;
+    uint32_t next_input; // Next input to be applied.
+    uint32_t queued_inputs; // Inputs handed to the joypad so far.
+    struct movie_checksum *checksums;
+    uint32_t num_checksums;
+    uint32_t next_checksum;
+};
+
+// Global movie.
+extern struct movie_struct movie;
+
+// Hash of every piece of emulated state that decides what happens next. Syncs the PPU and APU
+// first, both have to be initialized.
+uint64_t movie_state_checksum();
+uint64_t movie_rom_hash();
+
+// Start recording joypad input from the current state, embedding a checksum every interval
+// cycles. The joypad must already be initialized.
+int movie_record(const char *path, uint32_t interval);
+
+// Restore the state the movie was recorded from and replay it. The machine has to be set up with
+// the same devices and memory regions as when recording.
+int movie_replay(const char *path);
+
+// Stop recording or replaying. Returns -1 if the movie could not be written.
+int movie_end();
+
+#endif
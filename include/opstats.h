@@ -0,0 +1,38 @@
+#ifndef OPSTATS__
+#define OPSTATS__
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#define OPSTATS_NUM_OPCODES 0x100
+
+// Executions and cycles per opcode, counted by cpu_run while enabled. CB prefixed instructions
+// are counted both under 0xCB and per sub-opcode.
+struct opstats_struct
+{
+    uint8_t enabled;
+    uint64_t executions[OPSTATS_NUM_OPCODES];
+    uint64_t cycles[OPSTATS_NUM_OPCODES];
+    uint64_t cb_executions[OPSTATS_NUM_OPCODES];
+    uint64_t cb_cycles[OPSTATS_NUM_OPCODES];
+};
+
+// Global opcode counters.
+extern struct opstats_struct opstats;
+
+// Count an executed opcode. cb_opcode is the sub-opcode the CB handler fetched, only used when
+// opcode is 0xCB.
+void opstats_count(uint8_t opcode, uint8_t cb_opcode, uint8_t cycles);
+
+// Start counting from zero. With a path, the counters are also dumped there when the process
+// exits, as JSON if the path ends in .json and CSV otherwise.
+int opstats_enable(const char *exit_path);
+void opstats_disable();
+void opstats_clear();
+
+// Dump the opcodes executed at least once.
+int opstats_write_csv(FILE *file);
+int opstats_write_json(FILE *file);
+int opstats_dump(const char *path);
+
+#endif
@@ -0,0 +1,133 @@
+#ifndef PPU__
+#define PPU__
+
+#include <inttypes.h>
+
+#define LCD_WIDTH  160
+#define LCD_HEIGHT 144
+
+#define VRAM_ADDR 0x8000
+#define VRAM_SIZE 0x2000
+#define OAM_ADDR  0xFE00
+#define OAM_SIZE  0xA0
+
+#define NUM_SPRITES          (OAM_SIZE / 4)
+#define MAX_SPRITES_PER_LINE 10
+#define OAM_SOA_SIZE         48 // NUM_SPRITES rounded up to whole 16 byte vectors.
+
+#define LCDC_ADDR 0xFF40
+#define STAT_ADDR 0xFF41
+#define SCY_ADDR  0xFF42
+#define SCX_ADDR  0xFF43
+#define LY_ADDR   0xFF44
+#define LYC_ADDR  0xFF45
+#define BGP_ADDR  0xFF47
+#define OBP0_ADDR 0xFF48
+#define OBP1_ADDR 0xFF49
+#define WY_ADDR   0xFF4A
+#define WX_ADDR   0xFF4B
+
+#define LCDC_ENABLE(lcdc)     (lcdc & 0x80)
+#define LCDC_WIN_MAP(lcdc)    (lcdc & 0x40)
+#define LCDC_WIN_ENABLE(lcdc) (lcdc & 0x20)
+#define LCDC_TILE_DATA(lcdc)  (lcdc & 0x10)
+#define LCDC_BG_MAP(lcdc)     (lcdc & 0x08)
+#define LCDC_OBJ_SIZE(lcdc)   (lcdc & 0x04)
+#define LCDC_OBJ_ENABLE(lcdc) (lcdc & 0x02)
+#define LCDC_BG_ENABLE(lcdc)  (lcdc & 0x01)
+
+#define STAT_LYC_IRQ    0x40
+#define STAT_OAM_IRQ    0x20
+#define STAT_VBLANK_IRQ 0x10
+#define STAT_HBLANK_IRQ 0x08
+#define STAT_LYC_EQUAL  0x04
+#define STAT_MODE(stat) (stat & 3)
+
+// Clock cycles of each PPU mode, one dot per clock cycle.
+#define OAM_SCAN_CYCLES 80
+#define TRANSFER_CYCLES 172
+#define HBLANK_CYCLES   204
+#define LINE_CYCLES     456
+#define VBLANK_LINE     144
+#define NUM_LINES       154
+#define FRAME_CYCLES    (LINE_CYCLES * NUM_LINES)
+
+enum ppu_mode
+{
+    PPU_MODE_HBLANK,
+    PPU_MODE_VBLANK,
+    PPU_MODE_OAM,
+    PPU_MODE_TRANSFER
+};
+
+enum ppu_render
+{
+    PPU_RENDER_FULL, // Mode timing, interrupts and pixels.
+    PPU_RENDER_TIMING // Mode timing and interrupts only, the framebuffer is never drawn.
+};
+
+struct ppu_regs
+{
+    uint8_t lcdc; // LCD Control
+    uint8_t stat; // LCD Status
+    uint8_t scy; // Background scroll Y
+    uint8_t scx; // Background scroll X
+    uint8_t ly; // Current scanline
+    uint8_t lyc; // Scanline compare
+    uint8_t bgp; // Background palette
+    uint8_t obp0; // Object palette 0
+    uint8_t obp1; // Object palette 1
+    uint8_t wy; // Window Y
+    uint8_t wx; // Window X + 7
+};
+
+struct ppu_struct
+{
+    struct ppu_regs regs;
+    enum ppu_render render;
+    uint8_t stat_line; // STAT interrupt line, the interrupt is requested on its rising edge.
+    uint8_t window_line; // Internal window line counter.
+    uint64_t frame_start; // Cycle at which line 0 of the current frame started.
+    uint64_t render_cycle; // Cycle at which the next scanline to be rendered entered transfer mode.
+    uint64_t frames; // Number of frames completed.
+    uint8_t vram[VRAM_SIZE];
+    uint8_t oam[OAM_SIZE];
+    // Y and X of every sprite, kept in sync with OAM writes so the per-line sprite search can
+    // compare all of them at once. Padding entries have Y 0, which is never visible.
+    uint8_t oam_y[OAM_SOA_SIZE] __attribute__((aligned(16)));
+    uint8_t oam_x[OAM_SOA_SIZE] __attribute__((aligned(16)));
+    uint8_t framebuffer[LCD_HEIGHT][LCD_WIDTH]; // Shades 0 (white) to 3 (black).
+};
+
+// Called once all lines of a frame have been drawn, at the start of VBlank.
+typedef void(*ppu_frame_callback_t)(const uint8_t *framebuffer);
+
+// Global PPU.
+extern struct ppu_struct ppu;
+
+// Bus handlers, VRAM and OAM reads are served by the bus from the buffers below.
+int ppu_vram_write(uint8_t val, uint16_t addr);
+int ppu_oam_write(uint8_t val, uint16_t addr);
+int ppu_lcd_read(uint8_t *result, uint16_t addr);
+int ppu_lcd_write(uint8_t val, uint16_t addr);
+int ppu_pal_read(uint8_t *result, uint16_t addr);
+int ppu_pal_write(uint8_t val, uint16_t addr);
+
+// Replace the whole OAM, used by OAM DMA.
+void ppu_oam_dma(const uint8_t *src);
+
+// Rebuild the per-sprite copies of OAM after it was replaced without going through the bus.
+void ppu_reload_oam();
+
+// Collect the sprites visible on line ly, ordered from highest to lowest priority.
+uint8_t ppu_find_sprites(uint8_t ly, uint8_t *sprites);
+
+void ppu_set_frame_callback(ppu_frame_callback_t callback);
+
+// Catch up with the CPU, for users that access PPU state without going through the bus.
+void ppu_sync();
+
+int ppu_init(enum ppu_render render);
+int ppu_end();
+
+#endif
@@ -0,0 +1,43 @@
+#ifndef PROFILER__
+#define PROFILER__
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#define PROFILER_MAX_NAME 128
+
+// Sampling profiler of the guest. Every interval cycles the scheduler records the PC and, in the
+// switchable ROM area, the mapped bank. PC is sampled as the CPU loop left it, which is the
+// instruction after the one executing, close enough to attribute time to functions.
+struct profiler_stats
+{
+    uint64_t samples;
+    uint32_t addresses; // Distinct bank:address pairs sampled.
+    uint32_t symbols; // Symbols loaded.
+};
+
+// Start sampling every interval cycles, dropping earlier samples. Reports stay available after
+// profiler_stop.
+int profiler_start(uint32_t interval);
+void profiler_stop();
+
+// Stop and free the samples and symbols.
+void profiler_end();
+
+// Load an RGBDS .sym file, lines of "bank:address name". Samples are attributed to the closest
+// symbol at or before them in the same bank and memory area, and local labels (Func.loop) to
+// their function.
+int profiler_load_symbols(const char *path);
+
+// Name of bank:addr as "Symbol" or "Symbol+offset", or "bank:addr" in hex without a symbol.
+void profiler_symbol_name(uint16_t bank, uint16_t addr, char *name, uint32_t size);
+
+// Print the num hottest functions, or addresses without symbols.
+int profiler_report(FILE *file, uint32_t num);
+
+// Write the samples as folded stacks ("Func;Func.loop count" lines) for flame graph tools.
+int profiler_write_folded(FILE *file);
+
+void profiler_get_stats(struct profiler_stats *stats);
+
+#endif
@@ -0,0 +1,29 @@
+#ifndef RAM__
+#define RAM__
+
+#include <inttypes.h>
+
+#define WRAM_ADDR 0xC000
+#define WRAM_SIZE 0x2000
+#define ECHO_ADDR 0xE000 // Mirror of the first 0x1E00 bytes of WRAM.
+#define ECHO_SIZE 0x1E00
+#define HRAM_ADDR 0xFF80
+#define HRAM_SIZE 0x7F
+
+struct ram_struct
+{
+    uint8_t wram[WRAM_SIZE];
+    uint8_t hram[HRAM_SIZE];
+};
+
+// Global work and high RAM.
+extern struct ram_struct ram;
+
+// Bus handlers
+int ram_echo_read(uint8_t *result, uint16_t addr);
+int ram_echo_write(uint8_t val, uint16_t addr);
+
+int ram_init();
+int ram_end();
+
+#endif
@@ -0,0 +1,27 @@
+#ifndef RECORDER__
+#define RECORDER__
+
+#include <inttypes.h>
+
+#define RECORDER_VIDEO_SLOTS  64
+#define RECORDER_AUDIO_SLOTS  64
+#define RECORDER_AUDIO_FRAMES 2048 // Stereo frames per audio block, more than one video frame's worth.
+
+struct recorder_stats
+{
+    uint64_t frames; // Video frames written.
+    uint64_t dropped_frames; // Video frames lost because the writer fell behind.
+    uint64_t audio_frames; // Stereo audio frames written.
+    uint64_t dropped_audio_frames; // Audio frames lost because the writer fell behind.
+    uint64_t queue_ns; // Host time the emulation thread spent queueing frames and audio.
+};
+
+// Record every completed frame as raw Y4M video and the APU output as 16-bit stereo WAV. Either
+// path may be NULL. Files are written by a separate thread, the emulation thread only copies
+// into lock-free queues and never waits on it. Audio is pulled from the APU on a cycle schedule,
+// so it keeps flowing while the LCD is off. recorder_stop returns -1 if any write failed, or if
+// the recording was never started.
+int recorder_start(const char *video_path, const char *audio_path);
+int recorder_stop(struct recorder_stats *stats);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef REWIND__
+#define REWIND__
+
+#include <inttypes.h>
+
+// Snapshots are compared and stored in blocks of this many bytes.
+#define REWIND_BLOCK_SIZE 16
+
+// Upper bound on the number of snapshots held, whatever the memory budget.
+#define REWIND_MAX_SNAPSHOTS 36000
+
+// Every snapshot is stored as the XOR against the last keyframe, with runs of unchanged blocks
+// collapsed. Keyframes themselves are stored against all zeroes.
+//   token (u16): bit 15 set for n literal blocks that follow, clear for n unchanged blocks
+struct rewind_stats
+{
+    uint32_t snapshots; // Snapshots held right now.
+    uint32_t keyframes; // Keyframes among them.
+    uint64_t bytes_used; // Bytes taken by the held snapshots.
+    uint64_t pushes; // Snapshots taken since rewind_init.
+    uint64_t pushed_bytes; // Compressed bytes of all of them.
+    uint64_t push_ns; // Host time spent taking them.
+};
+
+// Keep snapshots within budget bytes, starting a new keyframe every keyframe_interval snapshots.
+// The oldest snapshots are dropped to make room.
+int rewind_init(uint32_t budget, uint32_t keyframe_interval);
+void rewind_end();
+
+// Snapshot the machine, meant to be called between frames.
+int rewind_push();
+
+// Go back to the snapshot steps before the latest one (0 is the latest) and drop the newer ones.
+// Returns -1 if not that many snapshots are held.
+int rewind_step_back(uint32_t steps);
+
+void rewind_get_stats(struct rewind_stats *stats);
+
+#endif
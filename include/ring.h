@@ -0,0 +1,87 @@
+#ifndef RING__
+#define RING__
+
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdlib.h>
+
+#define RING_CACHE_LINE 64
+
+// Single producer, single consumer ring of fixed size slots. The producer only writes head and
+// the consumer only writes tail, so neither side ever waits for the other.
+struct ring
+{
+    _Alignas(RING_CACHE_LINE) _Atomic uint32_t head; // Next slot to be produced.
+    _Alignas(RING_CACHE_LINE) _Atomic uint32_t tail; // Next slot to be consumed.
+    _Alignas(RING_CACHE_LINE) uint32_t num_slots; // Power of two.
+    uint32_t slot_size;
+    uint8_t *slots;
+};
+
+static inline int ring_init(struct ring *ring, uint32_t num_slots, uint32_t slot_size)
+{
+    if (num_slots == 0 || (num_slots & (num_slots - 1)))
+    {
+        return -1;
+    }
+
+    ring->slots = (uint8_t*)malloc((size_t)num_slots * slot_size);
+    if (ring->slots == NULL)
+    {
+        return -1;
+    }
+    ring->num_slots = num_slots;
+    ring->slot_size = slot_size;
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+    return 0;
+}
+
+static inline void ring_free(struct ring *ring)
+{
+    free(ring->slots);
+    ring->slots = NULL;
+}
+
+// Producer: slot to fill next, or NULL if the ring is full.
+static inline void *ring_produce(struct ring *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head - atomic_load_explicit(&ring->tail, memory_order_acquire) == ring->num_slots)
+    {
+        return NULL;
+    }
+    return ring->slots + (size_t)(head & (ring->num_slots - 1)) * ring->slot_size;
+}
+
+// Producer: publish the slot returned by ring_produce.
+static inline void ring_commit(struct ring *ring)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+// Consumer: oldest published slot, or NULL if the ring is empty.
+static inline void *ring_consume(struct ring *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail == atomic_load_explicit(&ring->head, memory_order_acquire))
+    {
+        return NULL;
+    }
+    return ring->slots + (size_t)(tail & (ring->num_slots - 1)) * ring->slot_size;
+}
+
+// Consumer: hand the slot returned by ring_consume back to the producer.
+static inline void ring_release(struct ring *ring)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+}
+
+#endif
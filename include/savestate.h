@@ -0,0 +1,35 @@
+#ifndef SAVESTATE__
+#define SAVESTATE__
+
+#include <inttypes.h>
+
+// Save state layout, header fields little endian:
+//   header: "GBSS", version (u16), reserved (u16), total size (u32)
+//   sections: tag (4 chars), payload size (u32), payload
+// Device sections hold the device structs as they are laid out in memory, so a state only loads
+// into the build that saved it. Any change to those structs has to bump the version.
+#define SAVESTATE_MAGIC "GBSS"
+#define SAVESTATE_VERSION 4
+#define SAVESTATE_HEADER_SIZE 12
+#define SAVESTATE_SECTION_HEADER_SIZE 8
+
+// Bytes needed to save the machine as it is currently set up.
+uint32_t savestate_size();
+
+// Save into buffer, which must hold at least savestate_size() bytes.
+int savestate_save(uint8_t *buffer, uint32_t size);
+
+// Restore a state saved with the same set of devices and memory regions. The buffer is checked
+// completely before anything is restored, so a failed load leaves the machine untouched.
+int savestate_load(const uint8_t *buffer, uint32_t size);
+
+// Device state alone, without headers or memory, for callers that keep the bus memory themselves.
+// Loading it does not mark anything dirty on the bus.
+uint32_t savestate_devices_size();
+void savestate_save_devices(uint8_t *buffer);
+void savestate_load_devices(const uint8_t *buffer);
+
+int savestate_save_file(const char *path);
+int savestate_load_file(const char *path);
+
+#endif
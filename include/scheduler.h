@@ -0,0 +1,36 @@
+#ifndef SCHEDULER__
+#define SCHEDULER__
+
+#include <inttypes.h>
+
+#define SCHED_NEVER UINT64_MAX
+
+// Every device that needs to act at a given clock cycle owns exactly one event slot.
+enum sched_event
+{
+    SCHED_PPU,
+    SCHED_DMA,
+    SCHED_SERIAL,
+    SCHED_JOYPAD,
+    SCHED_MOVIE,
+    SCHED_PROFILER,
+    SCHED_RECORDER,
+    NUM_SCHED_EVENTS
+};
+
+typedef void(*sched_callback_t)(uint64_t cycle);
+
+// Cycle of the earliest pending event, checked by the CPU loop after every clock cycle.
+extern uint64_t sched_next_cycle;
+
+void sched_init();
+
+int sched_register(enum sched_event event, sched_callback_t callback);
+
+void sched_set(enum sched_event event, uint64_t cycle);
+void sched_cancel(enum sched_event event);
+uint64_t sched_get(enum sched_event event);
+
+void sched_run(uint64_t cycle);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef SERIAL__
+#define SERIAL__
+
+#include <inttypes.h>
+
+#define SERIAL_SB_ADDR 0xFF01
+#define SERIAL_SC_ADDR 0xFF02
+
+// SC bits.
+#define SERIAL_SC_START    0x80 // Set to start a transfer, cleared by the hardware when it is done.
+#define SERIAL_SC_INTERNAL 0x01 // Shift with the internal 8192 Hz clock.
+
+// Eight bits at 8192 Hz.
+#define SERIAL_BYTE_CYCLES 4096
+
+// Bytes kept of the output, later ones are dropped until serial_clear_output.
+#define SERIAL_OUTPUT_SIZE 0x4000
+
+struct serial_struct
+{
+    uint8_t sb; // Serial transfer data
+    uint8_t sc; // Serial transfer control
+    uint8_t output[SERIAL_OUTPUT_SIZE]; // Every byte sent, oldest first.
+    uint32_t output_size;
+};
+
+// Called with every byte sent.
+typedef void(*serial_output_callback_t)(uint8_t byte);
+// Called at the end of every transfer for the byte received in exchange.
+typedef uint8_t(*serial_input_callback_t)();
+
+// Global serial port.
+extern struct serial_struct serial;
+
+// Bus handlers
+int serial_read(uint8_t *result, uint16_t addr);
+int serial_write(uint8_t val, uint16_t addr);
+
+// Nothing is connected to the port: bytes sent are captured, and 0xFF is received in exchange
+// unless an input callback supplies the other end. Transfers with the external clock never
+// finish, as there is no clock on the other end.
+int serial_init();
+int serial_end();
+
+void serial_set_output_callback(serial_output_callback_t callback);
+void serial_set_input_callback(serial_input_callback_t callback);
+void serial_clear_output();
+
+#endif
@@ -0,0 +1,133 @@
+/*
+ * bus_read, bus_write and the connection lookup behind them with 2 to 30 regions mapped, plus
+ * read_word and write_word. Each region is mapped either as plain memory or through handlers.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "bus.h"
+#include "mem_utils.h"
+#include "micro.h"
+
+#define SPACE_SIZE 0xFF00 // Regions are spread over everything below the I/O registers.
+#define NUM_ADDRESSES 4096
+
+static const uint32_t region_counts[] = {2, 4, 8, 16, 30};
+
+static uint8_t space[SPACE_SIZE];
+static uint16_t region_starts[32];
+static uint16_t addresses[NUM_ADDRESSES];
+
+static int handler_read(uint8_t *result, uint16_t addr)
+{
+    *result = space[addr];
+    return 0;
+}
+
+static int handler_write(uint8_t val, uint16_t addr)
+{
+    space[addr] = val;
+    return 0;
+}
+
+// Map num regions of equal size, which the handlers treat as starting at 0.
+static int map_regions(uint32_t num, int handlers)
+{
+    uint16_t size = SPACE_SIZE / num;
+    uint32_t i;
+    int ret = 0;
+
+    for (i = 0; i < num && ret == 0; i++)
+    {
+        region_starts[i] = (uint16_t)(i * size);
+        if (handlers)
+            ret = add_bus_connection(region_starts[i], size, handler_read, handler_write);
+        else
+            ret = add_bus_memory(region_starts[i], size, &space[region_starts[i]], NULL);
+    }
+    return ret;
+}
+
+static void unmap_regions(uint32_t num)
+{
+    uint32_t i;
+
+    for (i = 0; i < num; i++)
+    {
+        remove_bus_connection(region_starts[i]);
+    }
+}
+
+static void measure(uint32_t num, int handlers)
+{
+    char name[64];
+    uint32_t i, sum = 0;
+    uint16_t word;
+    double start;
+
+    if (map_regions(num, handlers))
+    {
+        fprintf(stderr, "Failed to map %u regions\n", num);
+        exit(1);
+    }
+
+    start = host_time();
+    for (i = 0; i < MICRO_OPS; i++)
+    {
+        uint8_t val;
+
+        bus_read(&val, addresses[i % NUM_ADDRESSES]);
+        sum += val;
+    }
+    snprintf(name, sizeof(name), "bus_read %2u %s", num, handlers ? "handlers" : "memory");
+    micro_report(name, host_time() - start, MICRO_OPS);
+
+    start = host_time();
+    for (i = 0; i < MICRO_OPS; i++)
+    {
+        bus_write((uint8_t)i, addresses[i % NUM_ADDRESSES]);
+    }
+    snprintf(name, sizeof(name), "bus_write %2u %s", num, handlers ? "handlers" : "memory");
+    micro_report(name, host_time() - start, MICRO_OPS);
+
+    // Words never straddle two regions, so both halves take the same path.
+    start = host_time();
+    for (i = 0; i < MICRO_OPS; i++)
+    {
+        read_word(&word, addresses[i % NUM_ADDRESSES] & ~1);
+        sum += word;
+    }
+    snprintf(name, sizeof(name), "read_word %2u %s", num, handlers ? "handlers" : "memory");
+    micro_report(name, host_time() - start, MICRO_OPS);
+
+    start = host_time();
+    for (i = 0; i < MICRO_OPS; i++)
+    {
+        write_word((uint16_t)i, addresses[i % NUM_ADDRESSES] & ~1);
+    }
+    snprintf(name, sizeof(name), "write_word %2u %s", num, handlers ? "handlers" : "memory");
+    micro_report(name, host_time() - start, MICRO_OPS);
+
+    micro_sink += sum;
+    unmap_regions(num);
+}
+
+int main(int argc, const char *argv[])
+{
+    uint32_t i, state = 2463534242u;
+    int handlers;
+
+    // Uniform over the mapped space, so every region is looked up as often.
+    for (i = 0; i < NUM_ADDRESSES; i++)
+    {
+        addresses[i] = (uint16_t)(micro_random(&state) % (SPACE_SIZE - 0x200));
+    }
+
+    for (handlers = 0; handlers < 2; handlers++)
+    {
+        for (i = 0; i < sizeof(region_counts) / sizeof(region_counts[0]); i++)
+        {
+            measure(region_counts[i], handlers);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,63 @@
+/*
+ * Per cycle and per instruction primitives of the CPU loop: timer_update with the timer off and
+ * counting, and handle_interrups when nothing is pending, with IME off and on.
+ */
+#include "micro.h"
+#include "cpu/cpu.h"
+
+#define TAC_ENABLE_16 0x05 // Timer on, TIMA counts every 16 cycles.
+
+static void measure_timer(const char *name, uint8_t tac)
+{
+    double start;
+    uint32_t i;
+
+    cpu.timer_regs.tac = tac;
+    cpu.timer_regs.tma = 0;
+
+    start = host_time();
+    for (i = 0; i < MICRO_OPS; i++)
+    {
+        timer_update();
+    }
+    micro_report(name, host_time() - start, MICRO_OPS);
+
+    micro_sink += cpu.timer_regs.tima;
+    cpu.timer_regs.tac = 0;
+    *(uint8_t*)&cpu.if_flags = 0xE0;
+}
+
+static void measure_irq(const char *name, uint8_t ime)
+{
+    uint8_t cycles = 0, enable_irq = 0, disable_irq = 0;
+    double start;
+    uint32_t i;
+
+    cpu.ime = ime;
+    *(uint8_t*)&cpu.ie_flags = 0x1F;
+    *(uint8_t*)&cpu.if_flags = 0xE0;
+
+    start = host_time();
+    for (i = 0; i < MICRO_OPS; i++)
+    {
+        handle_interrups(&cycles, &enable_irq, &disable_irq);
+    }
+    micro_report(name, host_time() - start, MICRO_OPS);
+
+    micro_sink += cycles;
+    cpu.ime = 0;
+}
+
+int main(int argc, const char *argv[])
+{
+    if (cpu_init())
+        return 1;
+
+    measure_timer("timer_update off", 0);
+    measure_timer("timer_update counting", TAC_ENABLE_16);
+    measure_irq("handle_interrups none pending, IME 0", 0);
+    measure_irq("handle_interrups none pending, IME 1", 1);
+
+    cpu_end();
+    return 0;
+}
@@ -0,0 +1,28 @@
+#ifndef MICRO__
+#define MICRO__
+
+#include <inttypes.h>
+#include <stdio.h>
+#include "hosttime.h"
+
+// Operations timed per measurement.
+#define MICRO_OPS 20000000
+
+// Results are folded into this so the compiler keeps the work.
+static volatile uint32_t micro_sink;
+
+static inline void micro_report(const char *name, double seconds, uint64_t ops)
+{
+    printf("%-36s %8.2f ns/op\n", name, seconds * 1e9 / ops);
+}
+
+// Addresses drawn from a fixed xorshift sequence, the same for every run.
+static inline uint32_t micro_random(uint32_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 17;
+    *state ^= *state << 5;
+    return *state;
+}
+
+#endif
@@ -0,0 +1,599 @@
+#include "apu.h"
+#include <string.h>
+#include "bus.h"
+#include "log.h"
+#include "cpu/cpu.h"
+
+#define PULSE1 0
+#define PULSE2 1
+#define WAVE   2
+#define NOISE  3
+
+// Registers of a channel are 5 apart, starting at NR10.
+#define REG(addr) apu.regs[(addr) - NR10_ADDR]
+#define CH_REG(idx, n) apu.regs[(idx) * 5 + (n)]
+
+struct apu_struct apu;
+
+// Bits that always read back as 1.
+static const uint8_t read_masks[APU_REGS_SIZE] = {
+    0x80, 0x3F, 0x00, 0xFF, 0xBF, // NR10-NR14
+    0xFF, 0x3F, 0x00, 0xFF, 0xBF, // NR20-NR24
+    0x7F, 0xFF, 0x9F, 0xFF, 0xBF, // NR30-NR34
+    0xFF, 0xFF, 0x00, 0x00, 0xBF, // NR40-NR44
+    0x00, 0x00, 0x70              // NR50-NR52
+};
+
+// Pulse output for each of the 8 duty steps, first step in the top bit.
+static const uint8_t duty_waveforms[4] = {0x01, 0x81, 0x87, 0x7E};
+
+static const uint8_t noise_divisors[8] = {8, 16, 32, 48, 64, 80, 96, 112};
+
+/* ----------- Channels ----------- */
+
+static uint32_t channel_period(uint8_t idx)
+{
+    uint8_t nr43;
+
+    switch (idx)
+    {
+    case PULSE1:
+    case PULSE2:
+        return (2048 - apu.channels[idx].freq) * 4;
+    case WAVE:
+        return (2048 - apu.channels[idx].freq) * 2;
+    default:
+        nr43 = REG(NR43_ADDR);
+        if ((nr43 >> 4) >= 14)
+        {
+            return 0; // The LFSR is never clocked.
+        }
+        return (uint32_t)noise_divisors[nr43 & 7] << (nr43 >> 4);
+    }
+}
+
+// Digital output of a channel, 0-15.
+static uint8_t channel_output(uint8_t idx)
+{
+    struct apu_channel *ch = &apu.channels[idx];
+    uint8_t sample, shift;
+
+    if (!ch->enabled)
+    {
+        return 0;
+    }
+
+    switch (idx)
+    {
+    case PULSE1:
+    case PULSE2:
+        return (duty_waveforms[CH_REG(idx, 1) >> 6] >> (7 - ch->pos)) & 1 ? ch->envelope.volume : 0;
+    case WAVE:
+        shift = (REG(NR32_ADDR) >> 5) & 3;
+        if (shift == 0)
+        {
+            return 0;
+        }
+        sample = apu.wave_ram[ch->pos / 2];
+        sample = ch->pos & 1 ? sample & 0xF : sample >> 4;
+        return sample >> (shift - 1);
+    default:
+        return apu.lfsr & 1 ? 0 : ch->envelope.volume;
+    }
+}
+
+// Whether stepping the waveform can change what the mixer outputs.
+static inline uint8_t channel_audible(uint8_t idx)
+{
+    struct apu_channel *ch = &apu.channels[idx];
+
+    if (!ch->enabled || !ch->dac || !(REG(NR51_ADDR) & (0x11 << idx)))
+    {
+        return 0;
+    }
+    if (idx == WAVE)
+    {
+        return REG(NR32_ADDR) & 0x60;
+    }
+    return ch->envelope.volume;
+}
+
+// Send the channel's current level to the mixer outputs, as a step at the given cycle.
+static void update_output(uint8_t idx, uint64_t cycle)
+{
+    struct apu_channel *ch = &apu.channels[idx];
+    uint8_t nr50 = REG(NR50_ADDR), nr51 = REG(NR51_ADDR);
+    float level = 0, left = 0, right = 0;
+    uint32_t time = cycle - apu.sync_cycle;
+
+    if (apu.output == APU_OUTPUT_NONE)
+    {
+        return;
+    }
+
+    if (ch->dac)
+    {
+        level = channel_output(idx) / (15.0f * 8 * NUM_APU_CHANNELS);
+    }
+    if (nr51 & (0x10 << idx))
+    {
+        left = level * (((nr50 >> 4) & 7) + 1);
+    }
+    if (nr51 & (1 << idx))
+    {
+        right = level * ((nr50 & 7) + 1);
+    }
+
+    if (left != ch->left)
+    {
+        blip_add_delta(&apu.blip_left, time, left - ch->left);
+        ch->left = left;
+    }
+    if (right != ch->right)
+    {
+        blip_add_delta(&apu.blip_right, time, right - ch->right);
+        ch->right = right;
+    }
+}
+
+static inline void update_outputs(uint64_t cycle)
+{
+    uint8_t idx;
+
+    for (idx = 0; idx < NUM_APU_CHANNELS; idx++)
+    {
+        update_output(idx, cycle);
+    }
+}
+
+static inline void step_waveform(uint8_t idx)
+{
+    struct apu_channel *ch = &apu.channels[idx];
+    uint16_t bit;
+
+    switch (idx)
+    {
+    case PULSE1:
+    case PULSE2:
+        ch->pos = (ch->pos + 1) & 7;
+        break;
+    case WAVE:
+        ch->pos = (ch->pos + 1) & 31;
+        break;
+    default:
+        bit = (apu.lfsr ^ (apu.lfsr >> 1)) & 1;
+        apu.lfsr = (apu.lfsr >> 1) | (bit << 14);
+        if (REG(NR43_ADDR) & 8)
+        {
+            apu.lfsr = (apu.lfsr & ~0x40) | (bit << 6);
+        }
+        break;
+    }
+}
+
+// Step a channel's waveform up to (not including) the end cycle, emitting every level change.
+static void run_channel(uint8_t idx, uint64_t end)
+{
+    struct apu_channel *ch = &apu.channels[idx];
+    uint64_t steps;
+
+    if (!ch->enabled || ch->period == 0 || ch->next_step >= end)
+    {
+        return;
+    }
+
+    if (!channel_audible(idx))
+    {
+        // Nothing can be heard, skip to the end keeping the waveform position in phase.
+        steps = (end - ch->next_step + ch->period - 1) / ch->period;
+        if (idx != NOISE)
+        {
+            ch->pos = (ch->pos + steps) & (idx == WAVE ? 31 : 7);
+        }
+        ch->next_step += steps * ch->period;
+        return;
+    }
+
+    while (ch->next_step < end)
+    {
+        step_waveform(idx);
+        update_output(idx, ch->next_step);
+        ch->next_step += ch->period;
+    }
+}
+
+/* ----------- Frame sequencer ----------- */
+
+static uint16_t sweep_calc()
+{
+    uint16_t delta = apu.sweep.shadow >> (REG(NR10_ADDR) & 7);
+    uint16_t freq = REG(NR10_ADDR) & 8 ? apu.sweep.shadow - delta : apu.sweep.shadow + delta;
+
+    if (freq > 2047)
+    {
+        apu.channels[PULSE1].enabled = 0;
+    }
+    return freq;
+}
+
+static void clock_sweep()
+{
+    uint16_t freq;
+
+    if (apu.sweep.timer > 0 && --apu.sweep.timer == 0)
+    {
+        apu.sweep.timer = apu.sweep.period ? apu.sweep.period : 8;
+        if (apu.sweep.enabled && apu.sweep.period)
+        {
+            freq = sweep_calc();
+            if (freq <= 2047 && (REG(NR10_ADDR) & 7))
+            {
+                apu.sweep.shadow = freq;
+                apu.channels[PULSE1].freq = freq;
+                apu.channels[PULSE1].period = channel_period(PULSE1);
+                sweep_calc();
+            }
+        }
+    }
+}
+
+static void clock_length(struct apu_channel *ch)
+{
+    if (ch->length_enable && ch->length > 0 && --ch->length == 0)
+    {
+        ch->enabled = 0;
+    }
+}
+
+static void clock_envelope(struct apu_envelope *envelope)
+{
+    if (envelope->period && --envelope->timer == 0)
+    {
+        envelope->timer = envelope->period;
+        if (envelope->increase && envelope->volume < 15)
+        {
+            envelope->volume++;
+        }
+        else if (!envelope->increase && envelope->volume > 0)
+        {
+            envelope->volume--;
+        }
+    }
+}
+
+static void clock_frame_sequencer(uint64_t cycle)
+{
+    uint8_t idx;
+
+    if (!(apu.frame_seq_step & 1))
+    {
+        for (idx = 0; idx < NUM_APU_CHANNELS; idx++)
+        {
+            clock_length(&apu.channels[idx]);
+        }
+    }
+    if (apu.frame_seq_step == 2 || apu.frame_seq_step == 6)
+    {
+        clock_sweep();
+    }
+    if (apu.frame_seq_step == 7)
+    {
+        clock_envelope(&apu.channels[PULSE1].envelope);
+        clock_envelope(&apu.channels[PULSE2].envelope);
+        clock_envelope(&apu.channels[NOISE].envelope);
+    }
+    apu.frame_seq_step = (apu.frame_seq_step + 1) & 7;
+
+    update_outputs(cycle);
+}
+
+/* ----------- Synthesis ----------- */
+
+// Without output only the frame sequencer has to be caught up, waveforms are never generated.
+static void sync_state(uint64_t cycle)
+{
+    while (apu.frame_seq_cycle <= cycle)
+    {
+        if (NR52_POWER(REG(NR52_ADDR)))
+        {
+            clock_frame_sequencer(apu.frame_seq_cycle);
+        }
+        apu.frame_seq_cycle += FRAME_SEQ_CYCLES;
+    }
+    apu.sync_cycle = cycle;
+}
+
+// Synthesize everything between the last sync and the given cycle. Work is split at frame
+// sequencer steps, nothing at all is done per clock cycle.
+static void sync(uint64_t cycle)
+{
+    uint64_t end;
+    uint8_t idx;
+
+    if (apu.output == APU_OUTPUT_NONE)
+    {
+        sync_state(cycle);
+        return;
+    }
+
+    while (apu.sync_cycle < cycle)
+    {
+        end = cycle < apu.frame_seq_cycle ? cycle : apu.frame_seq_cycle;
+
+        // Nobody is reading the samples, drop the oldest ones.
+        if (blip_clocks_left(&apu.blip_left) <= end - apu.sync_cycle)
+        {
+            blip_read_samples(&apu.blip_left, NULL, APU_BUFFER_FRAMES, 1);
+            blip_read_samples(&apu.blip_right, NULL, APU_BUFFER_FRAMES, 1);
+        }
+
+        if (NR52_POWER(REG(NR52_ADDR)))
+        {
+            for (idx = 0; idx < NUM_APU_CHANNELS; idx++)
+            {
+                run_channel(idx, end);
+            }
+        }
+
+        blip_end_frame(&apu.blip_left, end - apu.sync_cycle);
+        blip_end_frame(&apu.blip_right, end - apu.sync_cycle);
+        apu.sync_cycle = end;
+
+        if (end == apu.frame_seq_cycle)
+        {
+            if (NR52_POWER(REG(NR52_ADDR)))
+            {
+                clock_frame_sequencer(end);
+            }
+            apu.frame_seq_cycle += FRAME_SEQ_CYCLES;
+        }
+    }
+}
+
+void apu_sync()
+{
+    sync(cpu.cycle_count);
+}
+
+uint32_t apu_read_samples(int16_t *out, uint32_t max_frames)
+{
+    uint32_t count;
+
+    sync(cpu.cycle_count);
+    if (apu.output == APU_OUTPUT_NONE)
+    {
+        return 0;
+    }
+    count = blip_read_samples(&apu.blip_left, out, max_frames, 2);
+    blip_read_samples(&apu.blip_right, out != NULL ? out + 1 : NULL, count, 2);
+    return count;
+}
+
+/* ----------- Bus handlers ----------- */
+
+static void trigger(uint8_t idx, uint64_t cycle)
+{
+    struct apu_channel *ch = &apu.channels[idx];
+    uint8_t nrx2 = CH_REG(idx, 2);
+
+    ch->enabled = ch->dac;
+    if (ch->length == 0)
+    {
+        ch->length = idx == WAVE ? 256 : 64;
+    }
+    ch->period = channel_period(idx);
+    ch->next_step = cycle + ch->period;
+
+    ch->envelope.volume = nrx2 >> 4;
+    ch->envelope.increase = nrx2 & 8;
+    ch->envelope.period = nrx2 & 7;
+    ch->envelope.timer = ch->envelope.period;
+
+    switch (idx)
+    {
+    case PULSE1:
+        apu.sweep.shadow = ch->freq;
+        apu.sweep.period = (REG(NR10_ADDR) >> 4) & 7;
+        apu.sweep.timer = apu.sweep.period ? apu.sweep.period : 8;
+        apu.sweep.enabled = apu.sweep.period || (REG(NR10_ADDR) & 7);
+        if (REG(NR10_ADDR) & 7)
+        {
+            sweep_calc();
+        }
+        break;
+    case WAVE:
+        ch->pos = 0;
+        break;
+    case NOISE:
+        apu.lfsr = 0x7FFF;
+        break;
+    }
+}
+
+static void power_off()
+{
+    uint8_t idx;
+
+    memset(apu.regs, 0, NR52_ADDR - NR10_ADDR);
+    for (idx = 0; idx < NUM_APU_CHANNELS; idx++)
+    {
+        apu.channels[idx].enabled = 0;
+        apu.channels[idx].dac = 0;
+        apu.channels[idx].length_enable = 0;
+        apu.channels[idx].freq = 0;
+    }
+    apu.sweep.enabled = 0;
+}
+
+int apu_reg_read(uint8_t *result, uint16_t addr)
+{
+    uint8_t idx;
+
+    if (addr >= APU_REGS_SIZE)
+    {
+        return -1;
+    }
+
+    if (addr == NR52_ADDR - NR10_ADDR)
+    {
+        sync(cpu.cycle_count);
+        *result = (REG(NR52_ADDR) & 0x80) | read_masks[addr];
+        for (idx = 0; idx < NUM_APU_CHANNELS; idx++)
+        {
+            *result |= apu.channels[idx].enabled << idx;
+        }
+        return 0;
+    }
+
+    *result = apu.regs[addr] | read_masks[addr];
+    return 0;
+}
+
+int apu_reg_write(uint8_t val, uint16_t addr)
+{
+    uint16_t abs_addr = NR10_ADDR + addr;
+    uint8_t idx = addr / 5;
+    struct apu_channel *ch = &apu.channels[idx < NUM_APU_CHANNELS ? idx : 0];
+
+    if (addr >= APU_REGS_SIZE)
+    {
+        return -1;
+    }
+
+    sync(cpu.cycle_count);
+
+    if (!NR52_POWER(REG(NR52_ADDR)) && abs_addr != NR52_ADDR)
+    {
+        return 0; // Registers are read only while powered off.
+    }
+
+    apu.regs[addr] = val;
+
+    switch (abs_addr)
+    {
+    case NR11_ADDR:
+    case NR21_ADDR:
+    case NR41_ADDR:
+        ch->length = 64 - (val & 0x3F);
+        break;
+    case NR31_ADDR:
+        ch->length = 256 - val;
+        break;
+    case NR12_ADDR:
+    case NR22_ADDR:
+    case NR42_ADDR:
+        ch->dac = (val & 0xF8) != 0;
+        ch->enabled &= ch->dac;
+        break;
+    case NR30_ADDR:
+        ch->dac = (val & 0x80) != 0;
+        ch->enabled &= ch->dac;
+        break;
+    case NR13_ADDR:
+    case NR23_ADDR:
+    case NR33_ADDR:
+        ch->freq = (ch->freq & 0x700) | val;
+        ch->period = channel_period(idx);
+        break;
+    case NR43_ADDR:
+        ch->period = channel_period(idx);
+        break;
+    case NR14_ADDR:
+    case NR24_ADDR:
+    case NR34_ADDR:
+    case NR44_ADDR:
+        if (abs_addr != NR44_ADDR)
+        {
+            ch->freq = (ch->freq & 0xFF) | ((val & 7) << 8);
+            ch->period = channel_period(idx);
+        }
+        ch->length_enable = (val & 0x40) != 0;
+        if (val & 0x80)
+        {
+            trigger(idx, cpu.cycle_count);
+        }
+        break;
+    case NR52_ADDR:
+        apu.regs[addr] = val & 0x80;
+        if (!NR52_POWER(val))
+        {
+            power_off();
+        }
+        else
+        {
+            apu.frame_seq_step = 0;
+        }
+        break;
+    }
+
+    update_outputs(cpu.cycle_count);
+    return 0;
+}
+
+int apu_wave_write(uint8_t val, uint16_t addr)
+{
+    sync(cpu.cycle_count);
+    apu.wave_ram[addr] = val;
+    return 0;
+}
+
+/* ----------- Init ----------- */
+
+int apu_init(enum apu_output output, uint32_t sample_rate)
+{
+    memset(&apu, 0, sizeof(apu));
+    apu.output = output;
+    apu.sample_rate = sample_rate;
+    apu.sync_cycle = cpu.cycle_count;
+    apu.frame_seq_cycle = cpu.cycle_count + FRAME_SEQ_CYCLES;
+    apu.lfsr = 0x7FFF;
+
+    // Power on with the mixer routing every channel to both outputs at full volume.
+    REG(NR50_ADDR) = 0x77;
+    REG(NR51_ADDR) = 0xFF;
+    REG(NR52_ADDR) = 0x80;
+
+    if (output == APU_OUTPUT_SAMPLES)
+    {
+        if (blip_init(&apu.blip_left, APU_BUFFER_FRAMES, CPU_FREQ, sample_rate))
+        {
+            goto error;
+        }
+        if (blip_init(&apu.blip_right, APU_BUFFER_FRAMES, CPU_FREQ, sample_rate))
+        {
+            goto error_left;
+        }
+    }
+    if (add_bus_connection(NR10_ADDR, APU_REGS_SIZE, apu_reg_read, apu_reg_write))
+    {
+        goto error_right;
+    }
+    if (add_bus_memory(WAVE_RAM_ADDR, WAVE_RAM_SIZE, apu.wave_ram, apu_wave_write))
+    {
+        goto error_regs;
+    }
+    return 0;
+
+error_regs:
+    remove_bus_connection(NR10_ADDR);
+error_right:
+    blip_free(&apu.blip_right);
+error_left:
+    blip_free(&apu.blip_left);
+error:
+    log(LERR "Failed to initialize APU.");
+    return -1;
+}
+
+int apu_end()
+{
+    int ret = 0;
+
+    if (remove_bus_connection(NR10_ADDR) || remove_bus_connection(WAVE_RAM_ADDR))
+    {
+        ret = -1;
+    }
+    blip_free(&apu.blip_left);
+    blip_free(&apu.blip_right);
+    return ret;
+}
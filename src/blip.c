@@ -0,0 +1,129 @@
+#include "blip.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLIP_FRAC_BITS 32
+#define BLIP_PHASE_SHIFT (BLIP_FRAC_BITS - 5) // log2(BLIP_PHASES)
+#define BLIP_CUTOFF 0.9 // Fraction of the Nyquist frequency kept.
+#define BLIP_DC_RATE (1.0f / 1024) // Speed of the output high-pass filter.
+
+// Band-limited impulse for every sub-sample phase, each normalized to a total of 1.
+static float blip_kernel[BLIP_PHASES][BLIP_TAPS];
+static uint8_t blip_kernel_ready = 0;
+
+static void make_kernel()
+{
+    uint8_t phase, tap;
+    double t, sum, window, sinc, kernel[BLIP_TAPS];
+
+    for (phase = 0; phase < BLIP_PHASES; phase++)
+    {
+        sum = 0;
+        for (tap = 0; tap < BLIP_TAPS; tap++)
+        {
+            // Taps are centered around the step, sample tap sits at t samples from it.
+            t = tap - (BLIP_TAPS / 2 - 1) - (double)phase / BLIP_PHASES;
+            window = 0.42 + 0.5 * cos(M_PI * t / (BLIP_TAPS / 2)) + 0.08 * cos(2 * M_PI * t / (BLIP_TAPS / 2));
+            sinc = t == 0 ? 1 : sin(M_PI * BLIP_CUTOFF * t) / (M_PI * BLIP_CUTOFF * t);
+            kernel[tap] = sinc * window;
+            sum += kernel[tap];
+        }
+        for (tap = 0; tap < BLIP_TAPS; tap++)
+        {
+            blip_kernel[phase][tap] = kernel[tap] / sum;
+        }
+    }
+    blip_kernel_ready = 1;
+}
+
+int blip_init(struct blip_buffer *blip, uint32_t size, uint32_t clock_rate, uint32_t sample_rate)
+{
+    if (!blip_kernel_ready)
+    {
+        make_kernel();
+    }
+
+    blip->deltas = (float*)malloc((size + BLIP_TAPS) * sizeof(float));
+    if (blip->deltas == NULL)
+    {
+        return -1;
+    }
+    blip->size = size;
+    blip->factor = ((uint64_t)sample_rate << BLIP_FRAC_BITS) / clock_rate;
+    blip_clear(blip);
+    return 0;
+}
+
+void blip_free(struct blip_buffer *blip)
+{
+    free(blip->deltas);
+    blip->deltas = NULL;
+}
+
+void blip_clear(struct blip_buffer *blip)
+{
+    blip->offset = 0;
+    blip->integrator = 0;
+    blip->dc = 0;
+    memset(blip->deltas, 0, (blip->size + BLIP_TAPS) * sizeof(float));
+}
+
+uint32_t blip_clocks_left(struct blip_buffer *blip)
+{
+    uint64_t left = ((uint64_t)blip->size << BLIP_FRAC_BITS) - blip->offset;
+
+    return left / blip->factor;
+}
+
+void blip_add_delta(struct blip_buffer *blip, uint32_t clock_time, float delta)
+{
+    uint64_t pos = blip->offset + clock_time * blip->factor;
+    const float *kernel = blip_kernel[(pos >> BLIP_PHASE_SHIFT) & (BLIP_PHASES - 1)];
+    float *out = &blip->deltas[pos >> BLIP_FRAC_BITS];
+    uint8_t tap;
+
+    // The kernel is drawn starting at the step's sample, delaying the output by half a kernel
+    // so that no step ever reaches back into samples already made available.
+    for (tap = 0; tap < BLIP_TAPS; tap++)
+    {
+        out[tap] += kernel[tap] * delta;
+    }
+}
+
+void blip_end_frame(struct blip_buffer *blip, uint32_t clock_duration)
+{
+    blip->offset += clock_duration * blip->factor;
+}
+
+uint32_t blip_samples_avail(struct blip_buffer *blip)
+{
+    return blip->offset >> BLIP_FRAC_BITS;
+}
+
+uint32_t blip_read_samples(struct blip_buffer *blip, int16_t *out, uint32_t count, uint8_t stride)
+{
+    uint32_t avail = blip_samples_avail(blip), i;
+    float sample;
+
+    if (count > avail)
+    {
+        count = avail;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        blip->integrator += blip->deltas[i];
+        blip->dc += (blip->integrator - blip->dc) * BLIP_DC_RATE;
+        sample = (blip->integrator - blip->dc) * 32767;
+        if (out != NULL)
+        {
+            out[i * stride] = sample > 32767 ? 32767 : sample < -32768 ? -32768 : (int16_t)sample;
+        }
+    }
+
+    memmove(blip->deltas, &blip->deltas[count], (avail - count + BLIP_TAPS) * sizeof(float));
+    memset(&blip->deltas[avail + BLIP_TAPS - count], 0, count * sizeof(float));
+    blip->offset -= (uint64_t)count << BLIP_FRAC_BITS;
+    return count;
+}
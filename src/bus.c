@@ -1,8 +1,14 @@
 #include "bus.h"
 #include <stdlib.h>
+#include <string.h>
+#include "heatmap.h"
+#include "hostprof.h"
 #include "log.h"
 
 static struct bus_connection *bus_list = NULL;
+static uint16_t bus_lock_limit = 0;
+static uint8_t bus_dirty[BUS_NUM_PAGES];
+static uint8_t bus_open = 0;
 
 static inline int does_overlap(struct bus_connection *first, struct bus_connection *second)
 {
@@ -28,7 +34,7 @@ static struct bus_connection * find_connection(uint16_t address)
 }
 
 
-int add_bus_connection(uint16_t start_address, uint16_t size, bus_read_t read_func, bus_write_t write_func)
+static int insert_connection(uint16_t start_address, uint16_t size, bus_read_t read_func, bus_write_t write_func, uint8_t *mem, uint8_t read_only)
 {
 	struct bus_connection *new_connection;
 	struct bus_connection *current = bus_list;
@@ -43,6 +49,8 @@ int add_bus_connection(uint16_t start_address, uint16_t size, bus_read_t read_fu
 	new_connection->size = size;
 	new_connection->read_func = read_func;
 	new_connection->write_func = write_func;
+	new_connection->mem = mem;
+	new_connection->read_only = read_only;
 	new_connection->next = NULL;
 
 	if (current == NULL)
@@ -77,7 +85,7 @@ int add_bus_connection(uint16_t start_address, uint16_t size, bus_read_t read_fu
 		}
 	}
 
-	if (new_connection->start_address > current->start_address + current->size)
+	if (new_connection->start_address >= current->start_address + current->size)
 	{
 		current->next = new_connection;
 		return 0;
@@ -89,6 +97,25 @@ error:
 	return -1;	
 }
 
+int add_bus_connection(uint16_t start_address, uint16_t size, bus_read_t read_func, bus_write_t write_func)
+{
+	return insert_connection(start_address, size, read_func, write_func, NULL, 0);
+}
+
+// Add a region backed by a host buffer. Reads never leave the bus, writes go through write_func
+// if the owner needs to observe them and straight into the buffer otherwise.
+int add_bus_memory(uint16_t start_address, uint16_t size, uint8_t *mem, bus_write_t write_func)
+{
+	return insert_connection(start_address, size, NULL, write_func, mem, 0);
+}
+
+// Add a region backed by a host buffer that the CPU can not change. Writes only reach write_func,
+// which may remap the region (bank switching), and are dropped without one.
+int add_bus_rom(uint16_t start_address, uint16_t size, uint8_t *mem, bus_write_t write_func)
+{
+	return insert_connection(start_address, size, NULL, write_func, mem, 1);
+}
+
 int remove_bus_connection(uint16_t start_address)
 {
 	struct bus_connection *to_free = NULL;
@@ -115,10 +142,110 @@ int remove_bus_connection(uint16_t start_address)
 	return -1;
 }
 
+uint8_t *bus_get_memory(uint16_t address, uint16_t size)
+{
+	struct bus_connection *connection = find_connection(address);
+
+	if (connection == NULL || connection->mem == NULL ||
+	    address + size > connection->start_address + connection->size)
+	{
+		return NULL;
+	}
+	return connection->mem + (address - connection->start_address);
+}
+
+void bus_for_each_memory(bus_memory_func_t func, void *arg)
+{
+	struct bus_connection *current;
+
+	for (current = bus_list; current != NULL; current = current->next)
+	{
+		if (current->mem != NULL)
+		{
+			func(current->start_address, current->size, current->mem, current->read_only, arg);
+		}
+	}
+}
+
+void bus_mark_dirty(uint16_t address, uint32_t size)
+{
+	uint32_t page;
+
+	if (size == 0)
+	{
+		return;
+	}
+	for (page = address >> BUS_PAGE_SHIFT; page <= (address + size - 1) >> BUS_PAGE_SHIFT && page < BUS_NUM_PAGES; page++)
+	{
+		bus_dirty[page] = 1;
+	}
+}
+
+void bus_clear_dirty()
+{
+	memset(bus_dirty, 0, sizeof(bus_dirty));
+}
+
+int bus_is_dirty(uint8_t page)
+{
+	return bus_dirty[page];
+}
+
+void bus_set_open(uint8_t open)
+{
+	bus_open = open;
+}
+
+void bus_lock(uint16_t limit)
+{
+	bus_lock_limit = limit;
+}
+
+static inline int read_callback(struct bus_connection *connection, uint8_t *result, uint16_t src)
+{
+	int ret;
+
+	HOSTPROF_ENTER(HOSTPROF_BUS + hostprof_region(src));
+	ret = connection->read_func(result, src - connection->start_address);
+	HOSTPROF_LEAVE();
+	return ret;
+}
+
+static inline int write_callback(struct bus_connection *connection, uint8_t src, uint16_t dst)
+{
+	int ret;
+
+	HOSTPROF_ENTER(HOSTPROF_BUS + hostprof_region(dst));
+	ret = connection->write_func(src, dst - connection->start_address);
+	HOSTPROF_LEAVE();
+	return ret;
+}
+
 int bus_read(uint8_t *result, uint16_t src)
 {
-	struct bus_connection *connection = find_connection(src);
-	if (connection == NULL || connection->read_func(result, src - connection->start_address))
+	struct bus_connection *connection;
+
+	heatmap_read(src);
+	if (src < bus_lock_limit)
+	{
+		*result = 0xFF;
+		return 0;
+	}
+
+	connection = find_connection(src);
+	if (connection != NULL && connection->mem != NULL)
+	{
+		*result = connection->mem[src - connection->start_address];
+		return 0;
+	}
+
+	if (connection == NULL && bus_open)
+	{
+		*result = 0xFF;
+		return 0;
+	}
+
+	if (connection == NULL || read_callback(connection, result, src))
 	{
 		log("ERROR: Could not read from bus address %04x", src);
         return -1;
@@ -128,8 +255,31 @@ int bus_read(uint8_t *result, uint16_t src)
 
 int bus_write(uint8_t src, uint16_t dst)
 {
-	struct bus_connection *connection = find_connection(dst);
-	if (connection == NULL || connection->write_func(src, dst - connection->start_address))
+	struct bus_connection *connection;
+
+	heatmap_write(dst);
+	if (dst < bus_lock_limit)
+	{
+		return 0;
+	}
+	bus_dirty[dst >> BUS_PAGE_SHIFT] = 1;
+
+	connection = find_connection(dst);
+	if (connection != NULL && connection->write_func == NULL && connection->mem != NULL)
+	{
+		if (!connection->read_only)
+		{
+			connection->mem[dst - connection->start_address] = src;
+		}
+		return 0;
+	}
+
+	if (connection == NULL && bus_open)
+	{
+		return 0;
+	}
+
+	if (connection == NULL || write_callback(connection, src, dst))
 	{
         log("ERROR: Could not write to bus address %04x", dst);
 		return -1;
@@ -0,0 +1,321 @@
+#include "callgraph.h"
+#include <stdlib.h>
+#include <string.h>
+#include "cart.h"
+#include "log.h"
+#include "profiler.h"
+#include "cpu/cpu.h"
+
+#define MAX_CONTEXTS  (1 << 20)
+#define TABLE_SIZE    (2 * MAX_CONTEXTS) // Open addressing, at most half full.
+#define TABLE_EMPTY   UINT32_MAX
+#define ROOT_SP       0x10000 // Above any SP, so the root frame is never popped.
+#define ROOT_KEY      UINT32_MAX
+#define MAX_NAME      128
+
+// One calling context: a callee reached through the chain of its parents.
+struct context
+{
+    uint32_t parent;
+    uint32_t key; // Bank << 16 | address of the callee.
+    uint64_t calls;
+    uint64_t cycles; // Exclusive cycles.
+};
+
+struct frame
+{
+    uint32_t context;
+    uint32_t sp;
+};
+
+struct callgraph_struct
+{
+    struct frame stack[CALLGRAPH_MAX_DEPTH];
+    uint32_t depth;
+    uint64_t last_cycle; // When the top frame was last charged.
+    struct context *contexts;
+    uint32_t num_contexts;
+    uint32_t *table; // Context indices by parent and key.
+    struct callgraph_stats stats;
+};
+
+uint8_t callgraph_enabled = 0;
+
+static struct callgraph_struct callgraph;
+
+static inline uint32_t callee_key(uint16_t addr)
+{
+    uint32_t bank = addr >= CART_ROM_BANK_ADDR && addr < CART_ROM_BANK_ADDR + CART_ROM_BANK_SIZE ? cart_rom_bank() : 0;
+
+    return bank << 16 | addr;
+}
+
+static inline uint32_t slot(uint32_t parent, uint32_t key)
+{
+    return (uint32_t)(((uint64_t)parent << 32 | key) * 0x9E3779B97F4A7C15ULL >> 43) & (TABLE_SIZE - 1);
+}
+
+// Context of key called from parent, created on first use. TABLE_EMPTY once the table is full.
+static uint32_t find_context(uint32_t parent, uint32_t key)
+{
+    uint32_t i = slot(parent, key), index;
+    struct context *ctx;
+
+    while ((index = callgraph.table[i]) != TABLE_EMPTY)
+    {
+        ctx = &callgraph.contexts[index];
+        if (ctx->parent == parent && ctx->key == key)
+            return index;
+        i = (i + 1) & (TABLE_SIZE - 1);
+    }
+
+    if (callgraph.num_contexts == MAX_CONTEXTS)
+        return TABLE_EMPTY;
+
+    index = callgraph.num_contexts++;
+    callgraph.contexts[index] = (struct context){parent, key, 0, 0};
+    callgraph.table[i] = index;
+    return index;
+}
+
+// Charge the cycles since the last change of the stack to its top.
+static inline void charge()
+{
+    callgraph.contexts[callgraph.stack[callgraph.depth - 1].context].cycles += cpu.cycle_count - callgraph.last_cycle;
+    callgraph.last_cycle = cpu.cycle_count;
+}
+
+void callgraph_enter(uint16_t target, uint16_t sp)
+{
+    uint32_t context;
+
+    if (callgraph.depth == CALLGRAPH_MAX_DEPTH)
+    {
+        callgraph.stats.dropped++;
+        return;
+    }
+
+    context = find_context(callgraph.stack[callgraph.depth - 1].context, callee_key(target));
+    if (context == TABLE_EMPTY)
+    {
+        callgraph.stats.dropped++;
+        return;
+    }
+
+    charge();
+    callgraph.contexts[context].calls++;
+    callgraph.stack[callgraph.depth++] = (struct frame){context, sp};
+    callgraph.stats.calls++;
+}
+
+void callgraph_leave(uint16_t sp)
+{
+    // Deeper than the top frame: not a return from a tracked call.
+    if (callgraph.stack[callgraph.depth - 1].sp > sp)
+    {
+        return;
+    }
+
+    charge();
+    callgraph.depth--;
+    while (callgraph.stack[callgraph.depth - 1].sp <= sp)
+    {
+        callgraph.depth--;
+        callgraph.stats.unwound++;
+    }
+}
+
+int callgraph_start()
+{
+    uint32_t i;
+
+    callgraph_end();
+    callgraph.contexts = (struct context*)malloc(MAX_CONTEXTS * sizeof(struct context));
+    callgraph.table = (uint32_t*)malloc(TABLE_SIZE * sizeof(uint32_t));
+    if (callgraph.contexts == NULL || callgraph.table == NULL)
+    {
+        callgraph_end();
+        log(LERR "Failed to start the call graph profiler.");
+        return -1;
+    }
+    for (i = 0; i < TABLE_SIZE; i++)
+    {
+        callgraph.table[i] = TABLE_EMPTY;
+    }
+
+    memset(&callgraph.stats, 0, sizeof(callgraph.stats));
+    callgraph.contexts[0] = (struct context){0, ROOT_KEY, 1, 0};
+    callgraph.num_contexts = 1;
+    callgraph.stack[0] = (struct frame){0, ROOT_SP};
+    callgraph.depth = 1;
+    callgraph.last_cycle = cpu.cycle_count;
+    callgraph_enabled = 1;
+    return 0;
+}
+
+void callgraph_stop()
+{
+    if (callgraph_enabled)
+    {
+        charge();
+        callgraph_enabled = 0;
+    }
+}
+
+void callgraph_end()
+{
+    callgraph_enabled = 0;
+    free(callgraph.contexts);
+    free(callgraph.table);
+    callgraph.contexts = NULL;
+    callgraph.table = NULL;
+    callgraph.num_contexts = 0;
+}
+
+/* ----------- Reports ----------- */
+
+static void context_name(uint32_t index, char *name, uint32_t size)
+{
+    uint32_t key = callgraph.contexts[index].key;
+
+    if (key == ROOT_KEY)
+        snprintf(name, size, "(root)");
+    else
+        profiler_symbol_name((uint16_t)(key >> 16), (uint16_t)key, name, size);
+}
+
+struct function
+{
+    uint32_t key;
+    uint32_t context; // Any context of the function, for its name.
+    uint64_t inclusive;
+    uint64_t exclusive;
+    uint64_t calls;
+};
+
+static int compare_keys(const void *a, const void *b)
+{
+    const struct function *fa = (const struct function*)a, *fb = (const struct function*)b;
+
+    return fa->key < fb->key ? -1 : fa->key > fb->key;
+}
+
+static int compare_inclusive(const void *a, const void *b)
+{
+    const struct function *fa = (const struct function*)a, *fb = (const struct function*)b;
+
+    if (fa->inclusive != fb->inclusive)
+        return fa->inclusive > fb->inclusive ? -1 : 1;
+    return compare_keys(a, b);
+}
+
+// Whether a parent of context calls the same function, so its cycles are already included there.
+static int recursive(uint32_t index)
+{
+    uint32_t key = callgraph.contexts[index].key;
+
+    while (index != 0)
+    {
+        index = callgraph.contexts[index].parent;
+        if (callgraph.contexts[index].key == key)
+            return 1;
+    }
+    return 0;
+}
+
+int callgraph_report(FILE *file, uint32_t num)
+{
+    struct function *functions;
+    uint64_t *totals, total;
+    uint32_t i, num_functions = 0;
+    char name[MAX_NAME];
+
+    functions = (struct function*)malloc(callgraph.num_contexts * sizeof(struct function));
+    totals = (uint64_t*)calloc(callgraph.num_contexts, sizeof(uint64_t));
+    if (functions == NULL || totals == NULL)
+    {
+        free(functions);
+        free(totals);
+        return -1;
+    }
+
+    // Contexts are created after their parents, so totals can be summed bottom up in one pass.
+    for (i = callgraph.num_contexts; i-- > 0;)
+    {
+        totals[i] += callgraph.contexts[i].cycles;
+        if (i != 0)
+            totals[callgraph.contexts[i].parent] += totals[i];
+    }
+    total = totals[0];
+
+    for (i = 0; i < callgraph.num_contexts; i++)
+    {
+        functions[i] = (struct function){callgraph.contexts[i].key, i, recursive(i) ? 0 : totals[i],
+                                         callgraph.contexts[i].cycles, callgraph.contexts[i].calls};
+    }
+
+    // Merge the contexts of every function.
+    qsort(functions, callgraph.num_contexts, sizeof(struct function), compare_keys);
+    for (i = 0; i < callgraph.num_contexts; i++)
+    {
+        if (num_functions > 0 && functions[num_functions - 1].key == functions[i].key)
+        {
+            functions[num_functions - 1].inclusive += functions[i].inclusive;
+            functions[num_functions - 1].exclusive += functions[i].exclusive;
+            functions[num_functions - 1].calls += functions[i].calls;
+        }
+        else
+        {
+            functions[num_functions++] = functions[i];
+        }
+    }
+    qsort(functions, num_functions, sizeof(struct function), compare_inclusive);
+
+    fprintf(file, "%" PRIu64 " cycles, %" PRIu64 " calls, %" PRIu64 " frames unwound, %" PRIu64 " calls dropped\n",
+            total, callgraph.stats.calls, callgraph.stats.unwound, callgraph.stats.dropped);
+    fprintf(file, " incl%%  inclusive  exclusive      calls  function\n");
+    for (i = 0; i < num_functions && i < num; i++)
+    {
+        context_name(functions[i].context, name, sizeof(name));
+        fprintf(file, "%6.2f %10" PRIu64 " %10" PRIu64 " %10" PRIu64 "  %s\n",
+                total ? functions[i].inclusive * 100.0 / total : 0.0, functions[i].inclusive,
+                functions[i].exclusive, functions[i].calls, name);
+    }
+
+    free(functions);
+    free(totals);
+    return ferror(file) ? -1 : 0;
+}
+
+static void write_stack(FILE *file, uint32_t index)
+{
+    char name[MAX_NAME];
+
+    if (index != 0)
+    {
+        write_stack(file, callgraph.contexts[index].parent);
+        fputc(';', file);
+    }
+    context_name(index, name, sizeof(name));
+    fputs(name, file);
+}
+
+int callgraph_write_folded(FILE *file)
+{
+    uint32_t i;
+
+    for (i = 0; i < callgraph.num_contexts; i++)
+    {
+        if (callgraph.contexts[i].cycles == 0)
+            continue;
+        write_stack(file, i);
+        fprintf(file, " %" PRIu64 "\n", callgraph.contexts[i].cycles);
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+void callgraph_get_stats(struct callgraph_stats *stats)
+{
+    *stats = callgraph.stats;
+    stats->contexts = callgraph.num_contexts;
+}
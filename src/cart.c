@@ -0,0 +1,169 @@
+#include "cart.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bus.h"
+#include "log.h"
+
+struct cart_struct cart;
+
+static inline uint32_t rom_bank()
+{
+    uint32_t bank = cart.regs.rom_bank | cart.regs.bank_high << 5;
+
+    return (bank * CART_ROM_BANK_SIZE) % cart.rom_size;
+}
+
+uint32_t cart_rom_bank()
+{
+    if (cart.rom == NULL)
+    {
+        return 1;
+    }
+    return rom_bank() / CART_ROM_BANK_SIZE;
+}
+
+int cart_rom_bank_read(uint8_t *result, uint16_t addr)
+{
+    *result = cart.rom[rom_bank() + addr];
+    return 0;
+}
+
+// Writes to ROM select the bank, addr is absolute. RAM enable (0x0000-0x1FFF) and the banking
+// mode (0x6000-0x7FFF) are accepted and ignored.
+static int mbc_write(uint8_t val, uint16_t addr)
+{
+    if (cart.mbc != CART_MBC1)
+    {
+        return 0;
+    }
+
+    switch (addr >> 13)
+    {
+    case 1:
+        cart.regs.rom_bank = val & 0x1F ? val & 0x1F : 1;
+        break;
+    case 2:
+        cart.regs.bank_high = val & 3;
+        break;
+    default:
+        break;
+    }
+    return 0;
+}
+
+// The bus passes addresses relative to the start of each region.
+int cart_mbc_write(uint8_t val, uint16_t addr)
+{
+    return mbc_write(val, addr);
+}
+
+int cart_mbc_write_high(uint8_t val, uint16_t addr)
+{
+    return mbc_write(val, addr + CART_ROM_BANK_ADDR);
+}
+
+static int read_rom(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    long size;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) || (size = ftell(file)) < 2 * CART_ROM_BANK_SIZE ||
+        size > CART_MAX_ROM_SIZE || size % CART_ROM_BANK_SIZE || fseek(file, 0, SEEK_SET))
+    {
+        goto error;
+    }
+
+    cart.rom = (uint8_t*)malloc(size);
+    if (cart.rom == NULL || fread(cart.rom, 1, size, file) != (size_t)size)
+    {
+        goto error;
+    }
+    cart.rom_size = (uint32_t)size;
+    fclose(file);
+    return 0;
+
+error:
+    if (file != NULL)
+        fclose(file);
+    free(cart.rom);
+    cart.rom = NULL;
+    log(LERR "Failed to read ROM %s", path);
+    return -1;
+}
+
+int cart_load(const char *path)
+{
+    memset(&cart, 0, sizeof(cart));
+    cart.regs.rom_bank = 1;
+
+    if (read_rom(path))
+    {
+        return -1;
+    }
+
+    switch (cart.rom[CART_TYPE_ADDR])
+    {
+    case 0x00:
+    case 0x08:
+    case 0x09:
+        cart.mbc = CART_MBC_NONE;
+        break;
+    case 0x01:
+    case 0x02:
+    case 0x03:
+        cart.mbc = CART_MBC1;
+        break;
+    default:
+        log(LERR "Unsupported cartridge type %02x", cart.rom[CART_TYPE_ADDR]);
+        goto error;
+    }
+    cart.has_ram = cart.rom[CART_RAM_SIZE_ADDR] != 0;
+
+    if (cart.mbc == CART_MBC_NONE)
+    {
+        // Without an MBC the whole ROM is served straight from the buffer.
+        if (add_bus_rom(CART_ROM_ADDR, 2 * CART_ROM_BANK_SIZE, cart.rom, NULL))
+            goto error;
+    }
+    else
+    {
+        if (add_bus_rom(CART_ROM_ADDR, CART_ROM_BANK_SIZE, cart.rom, cart_mbc_write))
+            goto error;
+        if (add_bus_connection(CART_ROM_BANK_ADDR, CART_ROM_BANK_SIZE, cart_rom_bank_read, cart_mbc_write_high))
+            goto error_rom;
+    }
+
+    if (cart.has_ram && add_bus_memory(CART_RAM_ADDR, CART_RAM_SIZE, cart.ram, NULL))
+    {
+        goto error_bank;
+    }
+    return 0;
+
+error_bank:
+    if (cart.mbc != CART_MBC_NONE)
+        remove_bus_connection(CART_ROM_BANK_ADDR);
+error_rom:
+    remove_bus_connection(CART_ROM_ADDR);
+error:
+    free(cart.rom);
+    cart.rom = NULL;
+    log(LERR "Failed to load cartridge %s", path);
+    return -1;
+}
+
+int cart_end()
+{
+    int ret = 0;
+
+    if (cart.has_ram && remove_bus_connection(CART_RAM_ADDR))
+        ret = -1;
+    if (cart.mbc != CART_MBC_NONE && remove_bus_connection(CART_ROM_BANK_ADDR))
+        ret = -1;
+    if (remove_bus_connection(CART_ROM_ADDR))
+        ret = -1;
+
+    free(cart.rom);
+    cart.rom = NULL;
+    return ret;
+}
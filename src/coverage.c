@@ -0,0 +1,101 @@
+#include "coverage.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/shm.h>
+#include "log.h"
+
+struct coverage_struct coverage = {NULL, 0, -1};
+
+int coverage_enable(uint8_t *map, uint32_t size)
+{
+    if (map == NULL || size == 0 || size & (size - 1))
+    {
+        log(LERR "Coverage map size %" PRIu32 " is not a power of two.", size);
+        return -1;
+    }
+
+    coverage_disable();
+    coverage.map = map;
+    coverage.mask = size - 1;
+    return 0;
+}
+
+int coverage_attach(int shm_id, uint32_t size)
+{
+    void *map;
+
+    if (size == 0 || size & (size - 1))
+    {
+        log(LERR "Coverage map size %" PRIu32 " is not a power of two.", size);
+        return -1;
+    }
+
+    map = shmat(shm_id, NULL, 0);
+    if (map == (void*)-1)
+    {
+        log(LERR "Failed to attach coverage map %d.", shm_id);
+        return -1;
+    }
+
+    coverage_disable();
+    coverage.map = (uint8_t*)map;
+    coverage.mask = size - 1;
+    coverage.shm_id = shm_id;
+    return 0;
+}
+
+int coverage_attach_afl()
+{
+    const char *id = getenv("__AFL_SHM_ID");
+    const char *map_size = getenv("AFL_MAP_SIZE");
+    uint32_t size = COVERAGE_MAP_SIZE;
+
+    if (id == NULL)
+    {
+        return -1;
+    }
+
+    // Only use as much of a larger map as rounds down to a power of two.
+    if (map_size != NULL && strtoul(map_size, NULL, 0) > 0)
+    {
+        size = (uint32_t)strtoul(map_size, NULL, 0);
+        while (size & (size - 1))
+            size &= size - 1;
+    }
+    return coverage_attach(atoi(id), size);
+}
+
+void coverage_disable()
+{
+    if (coverage.shm_id >= 0)
+    {
+        shmdt(coverage.map);
+    }
+    coverage.map = NULL;
+    coverage.mask = 0;
+    coverage.shm_id = -1;
+}
+
+void coverage_clear()
+{
+    if (coverage.map != NULL)
+    {
+        memset(coverage.map, 0, coverage.mask + 1);
+    }
+}
+
+uint32_t coverage_count()
+{
+    uint32_t i, count = 0;
+
+    if (coverage.map == NULL)
+    {
+        return 0;
+    }
+
+    for (i = 0; i <= coverage.mask; i++)
+    {
+        count += coverage.map[i] != 0;
+    }
+    return count;
+}
@@ -2,10 +2,15 @@
 #include "cpu/registers.h"
 #include "cpu/opcodes.h"
 #include "bus.h"
+#include "hostprof.h"
 #include "log.h"
+#include "opstats.h"
+#include "scheduler.h"
 #include "cpu/interrupts.h"
 #include "cpu/timer.h"
 
+// Number of cycles cpu_loop runs between checks for errors.
+#define CPU_LOOP_SLICE 70224
 
 struct cpu_struct cpu;
 
@@ -15,9 +20,15 @@ static inline void log_registers(struct registers *regs)
         regs->af, regs->bc, regs->de, regs->hl, regs->sp, regs->pc);
 }
 
-static inline int cpu_init()
+int cpu_init()
 {
     init_registers(&cpu.regs);
+    cpu.state = STATE_NORMAL;
+    cpu.enable_irq = 0;
+    cpu.disable_irq = 0;
+    cpu.cycles = 0;
+    cpu.cycle_count = 0;
+    sched_init();
     if (irq_init())
         return -1;
     if (timer_init(&cpu.timer_regs))
@@ -29,20 +40,34 @@ static inline int cpu_init()
     return 0;
 }
 
-void cpu_loop()
+int cpu_end()
+{
+    int ret = 0;
+
+    if (irq_end())
+        ret = -1;
+    if (timer_end())
+        ret = -1;
+    return ret;
+}
+
+static inline int run(uint64_t num_cycles)
 {
     struct opcode *opcode;
-    uint8_t current_opcode, cycles = 0, disable_irq = 0, enable_irq = 0;
-    
-    if (cpu_init()) return;
+    uint8_t current_opcode;
+    uint64_t end_cycle = cpu.cycle_count + num_cycles;
+    int ret;
 
-    while(1)
+    while (cpu.cycle_count < end_cycle)
     {
-        if (cycles == 0)
+        if (cpu.cycles == 0)
         {
-            if (handle_interrups(&cycles, &enable_irq, &disable_irq))
+            HOSTPROF_ENTER(HOSTPROF_IRQ);
+            ret = handle_interrups(&cpu.cycles, &cpu.enable_irq, &cpu.disable_irq);
+            HOSTPROF_LEAVE();
+            if (ret)
             {
-                goto end;
+                return -1;
             }
 
             if (cpu.state == STATE_NORMAL)
@@ -51,7 +76,7 @@ void cpu_loop()
                 if (bus_read(&current_opcode, cpu.regs.pc))
                 {
                     log("ERROR: Failed to read opcode!");
-                    goto end;
+                    return -1;
                 }
 
                 // Extract from opcode table (decode)
@@ -59,23 +84,51 @@ void cpu_loop()
 
                 // Call opcode handler (execute)
                 log_registers(&cpu.regs);
-                if (opcode->func(&cpu.regs, &cpu.state, &enable_irq, &disable_irq))
+                HOSTPROF_ENTER(HOSTPROF_OPCODE);
+                ret = opcode->func(&cpu.regs, &cpu.state, &cpu.enable_irq, &cpu.disable_irq);
+                HOSTPROF_LEAVE();
+                if (ret)
                 {
                     log("ERROR: Opcode handler failed!");
-                    goto end;
+                    return -1;
                 }
 
-                cycles = opcode->cycles;
+                cpu.cycles = opcode->cycles;
+                if (opstats.enabled)
+                {
+                    opstats_count(current_opcode, cb_opcode, cpu.cycles);
+                }
                 cpu.regs.pc += opcode->size;
             }
         }
 
+        HOSTPROF_ENTER(HOSTPROF_TIMER);
         timer_update();
-        cycles--;
+        HOSTPROF_LEAVE();
+        cpu.cycles--;
+        cpu.cycle_count++;
+
+        if (cpu.cycle_count >= sched_next_cycle)
+        {
+            sched_run(cpu.cycle_count);
+        }
     }
 
-end:
-    irq_end();
-    timer_end();
+    return 0;
 }
 
+// Run the CPU for num_cycles clock cycles. Returns 0 once they elapsed, -1 on error.
+int cpu_run(uint64_t num_cycles)
+{
+    int ret;
+
+    HOSTPROF_ENTER(HOSTPROF_DISPATCH);
+    ret = run(num_cycles);
+    HOSTPROF_LEAVE();
+    return ret;
+}
+
+void cpu_loop()
+{
+    while (cpu_run(CPU_LOOP_SLICE) == 0);
+}
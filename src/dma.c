@@ -0,0 +1,78 @@
+#include "dma.h"
+#include "bus.h"
+#include "log.h"
+#include "ppu.h"
+#include "scheduler.h"
+#include "cpu/cpu.h"
+
+struct dma_struct dma;
+
+// End of the transfer window.
+static void dma_event(uint64_t cycle)
+{
+    dma.active = 0;
+    bus_lock(0);
+}
+
+int dma_read(uint8_t *result, uint16_t addr)
+{
+    *result = dma.source;
+    return 0;
+}
+
+// The transfer is done as a single block copy when it is written, the scheduler then only has to
+// keep the bus locked for as long as the hardware would need to copy it byte by byte.
+int dma_write(uint8_t val, uint16_t addr)
+{
+    uint8_t buffer[OAM_SIZE];
+    uint8_t *src;
+    uint16_t src_addr;
+    uint8_t i;
+
+    dma.source = val;
+
+    // Sources above WRAM read its echo.
+    src_addr = (val >= 0xE0 ? val - 0x20 : val) << 8;
+
+    // Lift a running transfer's lock so the source can be read.
+    bus_lock(0);
+
+    src = bus_get_memory(src_addr, OAM_SIZE);
+    if (src == NULL)
+    {
+        for (i = 0; i < OAM_SIZE; i++)
+        {
+            if (bus_read(&buffer[i], src_addr + i))
+            {
+                buffer[i] = 0xFF;
+            }
+        }
+        src = buffer;
+    }
+    ppu_oam_dma(src);
+
+    dma.active = 1;
+    bus_lock(DMA_LOCK_LIMIT);
+    sched_set(SCHED_DMA, cpu.cycle_count + DMA_CYCLES);
+    return 0;
+}
+
+int dma_init()
+{
+    dma.source = 0xFF;
+    dma.active = 0;
+
+    if (sched_register(SCHED_DMA, dma_event) || add_bus_connection(DMA_ADDR, 1, dma_read, dma_write))
+    {
+        log(LERR "Failed to initialize OAM DMA.");
+        return -1;
+    }
+    return 0;
+}
+
+int dma_end()
+{
+    sched_cancel(SCHED_DMA);
+    bus_lock(0);
+    return remove_bus_connection(DMA_ADDR);
+}
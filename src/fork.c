@@ -0,0 +1,202 @@
+#include "fork.h"
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+#include "savestate.h"
+
+// Part of a writable memory region that falls into one bus page.
+struct fork_slice
+{
+    uint8_t *mem;
+    uint16_t address;
+    uint16_t size;
+};
+
+struct fork_struct
+{
+    struct fork_slice *slices;
+    uint32_t num_slices;
+    uint32_t devices_size;
+    struct fork *current; // Fork the live memory matches, apart from the dirty pages.
+    struct fork_stats stats;
+};
+
+static struct fork_struct forks;
+
+static void add_slices(uint16_t start_address, uint16_t size, uint8_t *mem, uint8_t read_only, void *arg)
+{
+    uint32_t address = start_address, end = (uint32_t)start_address + size, slice_end;
+
+    if (read_only)
+    {
+        return;
+    }
+
+    while (address < end)
+    {
+        slice_end = ((address >> BUS_PAGE_SHIFT) + 1) << BUS_PAGE_SHIFT;
+        if (slice_end > end)
+        {
+            slice_end = end;
+        }
+
+        // The first pass only counts.
+        if (forks.slices != NULL)
+        {
+            forks.slices[forks.num_slices] = (struct fork_slice){mem + (address - start_address), (uint16_t)address, (uint16_t)(slice_end - address)};
+        }
+        forks.num_slices++;
+        address = slice_end;
+    }
+}
+
+int fork_init()
+{
+    memset(&forks, 0, sizeof(forks));
+    forks.devices_size = savestate_devices_size();
+
+    bus_for_each_memory(add_slices, NULL);
+    forks.slices = (struct fork_slice*)malloc(forks.num_slices * sizeof(struct fork_slice) + 1);
+    if (forks.slices == NULL)
+    {
+        log(LERR "Failed to initialize forking.");
+        return -1;
+    }
+    forks.num_slices = 0;
+    bus_for_each_memory(add_slices, NULL);
+    return 0;
+}
+
+void fork_end()
+{
+    free(forks.slices);
+    memset(&forks, 0, sizeof(forks));
+}
+
+void fork_free(struct fork *fork)
+{
+    uint32_t i;
+
+    if (fork == NULL)
+    {
+        return;
+    }
+
+    for (i = 0; i < forks.num_slices && fork->pages != NULL; i++)
+    {
+        if (fork->pages[i] != NULL && --fork->pages[i]->refs == 0)
+        {
+            free(fork->pages[i]);
+            forks.stats.pages_live--;
+        }
+    }
+    if (forks.current == fork)
+    {
+        forks.current = NULL;
+    }
+    free(fork->pages);
+    free(fork->devices);
+    free(fork);
+}
+
+struct fork *fork_create()
+{
+    struct fork *fork = (struct fork*)calloc(1, sizeof(struct fork));
+    struct fork_slice *slice;
+    struct fork_page *page;
+    uint32_t i;
+
+    if (fork == NULL)
+    {
+        goto error;
+    }
+    fork->devices = (uint8_t*)malloc(forks.devices_size);
+    fork->pages = (struct fork_page**)calloc(forks.num_slices + 1, sizeof(struct fork_page*));
+    if (fork->devices == NULL || fork->pages == NULL)
+    {
+        goto error;
+    }
+
+    savestate_save_devices(fork->devices);
+
+    for (i = 0; i < forks.num_slices; i++)
+    {
+        slice = &forks.slices[i];
+        if (forks.current != NULL && !bus_is_dirty(slice->address >> BUS_PAGE_SHIFT))
+        {
+            page = forks.current->pages[i];
+            page->refs++;
+            forks.stats.pages_shared++;
+        }
+        else
+        {
+            page = (struct fork_page*)malloc(sizeof(struct fork_page));
+            if (page == NULL)
+            {
+                goto error;
+            }
+            page->refs = 1;
+            memcpy(page->data, slice->mem, slice->size);
+            forks.stats.pages_copied++;
+            forks.stats.pages_live++;
+        }
+        fork->pages[i] = page;
+    }
+
+    forks.current = fork;
+    forks.stats.forks++;
+    bus_clear_dirty();
+    return fork;
+
+error:
+    log(LERR "Failed to fork.");
+    fork_free(fork);
+    return NULL;
+}
+
+void fork_switch(struct fork *fork)
+{
+    struct fork_slice *slice;
+    uint32_t i;
+
+    for (i = 0; i < forks.num_slices; i++)
+    {
+        slice = &forks.slices[i];
+        if (forks.current == NULL || forks.current->pages[i] != fork->pages[i] ||
+            bus_is_dirty(slice->address >> BUS_PAGE_SHIFT))
+        {
+            memcpy(slice->mem, fork->pages[i]->data, slice->size);
+            forks.stats.pages_restored++;
+        }
+    }
+    savestate_load_devices(fork->devices);
+
+    forks.current = fork;
+    bus_clear_dirty();
+}
+
+int fork_compare(const struct fork *a, const struct fork *b, int32_t *address)
+{
+    struct fork_slice *slice;
+    uint32_t i, j;
+
+    for (i = 0; i < forks.num_slices; i++)
+    {
+        slice = &forks.slices[i];
+        if (a->pages[i] == b->pages[i] || !memcmp(a->pages[i]->data, b->pages[i]->data, slice->size))
+        {
+            continue;
+        }
+        for (j = 0; a->pages[i]->data[j] == b->pages[i]->data[j]; j++);
+        *address = slice->address + j;
+        return 1;
+    }
+
+    *address = -1;
+    return memcmp(a->devices, b->devices, forks.devices_size) != 0;
+}
+
+void fork_get_stats(struct fork_stats *stats)
+{
+    *stats = forks.stats;
+}
@@ -0,0 +1,67 @@
+#include "heatmap.h"
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+
+#define PAGE_SIZE (1 << HEATMAP_PAGE_SHIFT)
+
+struct heatmap_struct *heatmap = NULL;
+
+int heatmap_enable()
+{
+    if (heatmap == NULL)
+    {
+        heatmap = (struct heatmap_struct*)malloc(sizeof(struct heatmap_struct));
+        if (heatmap == NULL)
+        {
+            log(LERR "Failed to allocate the heatmap.");
+            return -1;
+        }
+    }
+    heatmap_clear();
+    return 0;
+}
+
+void heatmap_disable()
+{
+    free(heatmap);
+    heatmap = NULL;
+}
+
+void heatmap_clear()
+{
+    if (heatmap != NULL)
+        memset(heatmap, 0, sizeof(struct heatmap_struct));
+}
+
+int heatmap_write_csv(FILE *file, uint64_t label, int header)
+{
+    uint64_t reads, writes;
+    uint32_t page, addr;
+
+    if (heatmap == NULL)
+        return -1;
+
+    if (header)
+        fprintf(file, "label,kind,address,reads,writes\n");
+
+    for (page = 0; page < HEATMAP_ADDRESSES / PAGE_SIZE; page++)
+    {
+        reads = writes = 0;
+        for (addr = page * PAGE_SIZE; addr < (page + 1) * PAGE_SIZE; addr++)
+        {
+            reads += heatmap->reads[addr];
+            writes += heatmap->writes[addr];
+        }
+        if (reads || writes)
+            fprintf(file, "%" PRIu64 ",page,0x%04X,%" PRIu64 ",%" PRIu64 "\n", label, page * PAGE_SIZE, reads, writes);
+    }
+
+    for (addr = HEATMAP_IO_ADDR; addr < HEATMAP_ADDRESSES; addr++)
+    {
+        if (heatmap->reads[addr] || heatmap->writes[addr])
+            fprintf(file, "%" PRIu64 ",io,0x%04X,%" PRIu64 ",%" PRIu64 "\n", label, addr, heatmap->reads[addr],
+                    heatmap->writes[addr]);
+    }
+    return ferror(file) ? -1 : 0;
+}
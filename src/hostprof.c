@@ -0,0 +1,137 @@
+#include "hostprof.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hosttime.h"
+#include "log.h"
+
+#ifdef HOSTPROF
+
+#define CALIBRATION_PROBES 100000
+
+struct hostprof_struct hostprof;
+
+static const char *region_names[HOSTPROF_NUM_REGIONS] = {
+    "bus rom", "bus vram", "bus cart ram", "bus wram", "bus oam", "bus io", "bus hram"
+};
+
+static const char *sched_names[NUM_SCHED_EVENTS] = {
+    [SCHED_PPU] = "sched ppu",
+    [SCHED_DMA] = "sched dma",
+    [SCHED_SERIAL] = "sched serial",
+    [SCHED_JOYPAD] = "sched joypad",
+    [SCHED_MOVIE] = "sched movie",
+    [SCHED_PROFILER] = "sched profiler",
+    [SCHED_RECORDER] = "sched recorder"
+};
+
+static double start_time;
+static uint64_t start_ticks;
+static double probe_ticks; // Host ticks taken by one enter and leave pair.
+static uint8_t exit_registered = 0;
+
+static const char *slot_name(uint32_t slot)
+{
+    switch (slot)
+    {
+    case HOSTPROF_HOST:
+        return "host";
+    case HOSTPROF_DISPATCH:
+        return "dispatch";
+    case HOSTPROF_OPCODE:
+        return "opcodes";
+    case HOSTPROF_TIMER:
+        return "timer_update";
+    case HOSTPROF_IRQ:
+        return "interrupts";
+    default:
+        break;
+    }
+    if (slot < HOSTPROF_BUS)
+        return sched_names[slot - HOSTPROF_SCHED];
+    return region_names[slot - HOSTPROF_BUS];
+}
+
+// Time empty probes, to tell how much of the accounted time they take themselves.
+static void calibrate()
+{
+    uint64_t start;
+    uint32_t i;
+
+    start = hostprof_ticks();
+    for (i = 0; i < CALIBRATION_PROBES; i++)
+    {
+        hostprof_enter(HOSTPROF_HOST);
+        hostprof_leave();
+    }
+    probe_ticks = (double)(hostprof_ticks() - start) / CALIBRATION_PROBES;
+}
+
+int hostprof_start()
+{
+    if (!exit_registered)
+    {
+        if (atexit(hostprof_report))
+        {
+            log(LERR "Failed to register the host time summary.");
+            return -1;
+        }
+        exit_registered = 1;
+    }
+
+    memset(&hostprof, 0, sizeof(hostprof));
+    hostprof.stack[0] = HOSTPROF_HOST;
+    hostprof.depth = 1;
+    hostprof.enabled = 1;
+    hostprof.last = hostprof_ticks();
+    calibrate();
+
+    memset(hostprof.ticks, 0, sizeof(hostprof.ticks));
+    memset(hostprof.calls, 0, sizeof(hostprof.calls));
+    start_time = host_time();
+    start_ticks = hostprof.last = hostprof_ticks();
+    return 0;
+}
+
+void hostprof_report()
+{
+    uint64_t total = 0;
+    double ns_per_tick;
+    uint32_t slot;
+
+    if (!hostprof.enabled)
+        return;
+
+    hostprof_charge();
+    ns_per_tick = (host_time() - start_time) * 1e9 / (double)(hostprof_ticks() - start_ticks);
+    for (slot = 0; slot < NUM_HOSTPROF_SLOTS; slot++)
+    {
+        total += hostprof.ticks[slot];
+    }
+
+    fprintf(stderr, "%-16s %14s %8s %12s %10s\n", "slot", "calls", "share", "ms", "ns/call");
+    for (slot = 0; slot < NUM_HOSTPROF_SLOTS; slot++)
+    {
+        if (hostprof.ticks[slot] == 0)
+            continue;
+        fprintf(stderr, "%-16s %14" PRIu64 " %7.2f%% %12.3f %10.1f\n", slot_name(slot), hostprof.calls[slot],
+                total ? hostprof.ticks[slot] * 100.0 / total : 0.0, hostprof.ticks[slot] * ns_per_tick / 1e6,
+                hostprof.calls[slot] ? hostprof.ticks[slot] * ns_per_tick / hostprof.calls[slot] : 0.0);
+    }
+    fprintf(stderr, "total %.3f ms, each probe takes about %.1f ns and is charged to its caller\n",
+            total * ns_per_tick / 1e6, probe_ticks * ns_per_tick);
+}
+
+#else
+
+int hostprof_start()
+{
+    log(LERR "Host time accounting needs a build with -DHOSTPROF.");
+    return -1;
+}
+
+void hostprof_report()
+{
+}
+
+#endif
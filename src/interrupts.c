@@ -1,5 +1,7 @@
 #include "cpu/interrupts.h"
 #include "bus.h"
+#include "callgraph.h"
+#include "coverage.h"
 #include "log.h"
 #include "cpu/opcodes.h"
 #include "cpu/cpu.h"
@@ -132,6 +134,8 @@ int handle_interrups(uint8_t *cycles, uint8_t *enable_irq, uint8_t *disable_irq)
                 return -1;
 
             // Set PC to irq address.
+            coverage_edge(cpu.regs.pc, irq_addresses[irq_no]);
+            callgraph_call(irq_addresses[irq_no], cpu.regs.sp);
             cpu.regs.pc = irq_addresses[irq_no];
 
             // Clear irq.
@@ -0,0 +1,147 @@
+#include "joypad.h"
+#include "bus.h"
+#include "log.h"
+#include "scheduler.h"
+#include "cpu/cpu.h"
+
+struct joypad_struct joypad;
+
+static joypad_input_callback_t input_callback = NULL;
+
+// Input lines P10-P13 as the CPU sees them, a pressed button in a selected half pulls its line low.
+static uint8_t joypad_lines()
+{
+    uint8_t pressed = 0;
+
+    if (!(joypad.select & JOYPAD_SELECT_DPAD))
+    {
+        pressed |= joypad.buttons & 0x0F;
+    }
+    if (!(joypad.select & JOYPAD_SELECT_BUTTONS))
+    {
+        pressed |= joypad.buttons >> 4;
+    }
+    return ~pressed & 0x0F;
+}
+
+// The joypad interrupt is requested whenever one of the input lines goes from high to low.
+static void update(uint8_t select, uint8_t buttons)
+{
+    uint8_t old_lines = joypad_lines();
+
+    joypad.select = select;
+    joypad.buttons = buttons;
+
+    if (old_lines & ~joypad_lines())
+    {
+        cpu.if_flags.joypad_irq = 1;
+    }
+}
+
+static void schedule_next()
+{
+    if (joypad.queue_count)
+    {
+        sched_set(SCHED_JOYPAD, joypad.queue[joypad.queue_head].cycle);
+    }
+}
+
+// Apply every queued event that is due, nothing runs between events.
+static void joypad_event(uint64_t cycle)
+{
+    struct joypad_event *event;
+
+    while (joypad.queue_count)
+    {
+        event = &joypad.queue[joypad.queue_head];
+        if (event->cycle > cycle)
+        {
+            break;
+        }
+        update(joypad.select, event->buttons);
+        joypad.queue_head = (joypad.queue_head + 1) % JOYPAD_QUEUE_SIZE;
+        joypad.queue_count--;
+
+        // Events queued late take effect now rather than at their own cycle.
+        if (input_callback != NULL)
+        {
+            input_callback(cpu.cycle_count, joypad.buttons);
+        }
+    }
+    schedule_next();
+}
+
+int joypad_read(uint8_t *result, uint16_t addr)
+{
+    *result = 0xC0 | joypad.select | joypad_lines();
+    return 0;
+}
+
+int joypad_write(uint8_t val, uint16_t addr)
+{
+    update(val & JOYPAD_SELECT_MASK, joypad.buttons);
+    return 0;
+}
+
+int joypad_queue(uint64_t cycle, uint8_t buttons)
+{
+    struct joypad_event *last;
+
+    if (joypad.queue_count == JOYPAD_QUEUE_SIZE)
+    {
+        log(LERR "Joypad input queue is full.");
+        return -1;
+    }
+
+    if (joypad.queue_count)
+    {
+        last = &joypad.queue[(joypad.queue_head + joypad.queue_count - 1) % JOYPAD_QUEUE_SIZE];
+        if (cycle < last->cycle)
+        {
+            log(LERR "Joypad input at cycle %" PRIu64 " queued after cycle %" PRIu64, cycle, last->cycle);
+            return -1;
+        }
+    }
+
+    joypad.queue[(joypad.queue_head + joypad.queue_count) % JOYPAD_QUEUE_SIZE] = (struct joypad_event){cycle, buttons};
+    joypad.queue_count++;
+    if (joypad.queue_count == 1)
+    {
+        schedule_next();
+    }
+    return 0;
+}
+
+void joypad_set_input_callback(joypad_input_callback_t callback)
+{
+    input_callback = callback;
+}
+
+void joypad_clear_queue()
+{
+    joypad.queue_head = 0;
+    joypad.queue_count = 0;
+    sched_cancel(SCHED_JOYPAD);
+}
+
+int joypad_init()
+{
+    joypad.select = JOYPAD_SELECT_MASK;
+    joypad.buttons = 0;
+    joypad.queue_head = 0;
+    joypad.queue_count = 0;
+
+    if (sched_register(SCHED_JOYPAD, joypad_event) || add_bus_connection(JOYPAD_ADDR, 1, joypad_read, joypad_write))
+    {
+        log(LERR "Failed to initialize joypad.");
+        return -1;
+    }
+    return 0;
+}
+
+int joypad_end()
+{
+    input_callback = NULL;
+    joypad_clear_queue();
+    return remove_bus_connection(JOYPAD_ADDR);
+}
@@ -0,0 +1,95 @@
+#include "machine.h"
+#include <stddef.h>
+#include "apu.h"
+#include "bus.h"
+#include "cart.h"
+#include "dma.h"
+#include "joypad.h"
+#include "ppu.h"
+#include "ram.h"
+#include "serial.h"
+#include "cpu/cpu.h"
+
+static uint8_t has_cart;
+
+// Everything but what is mapped at address 0.
+static int devices_init()
+{
+    if (ram_init())
+        return -1;
+    if (cpu_init())
+        goto err_ram;
+    if (ppu_init(PPU_RENDER_TIMING))
+        goto err_cpu;
+    if (dma_init())
+        goto err_ppu;
+    if (joypad_init())
+        goto err_dma;
+    if (serial_init())
+        goto err_joypad;
+    if (apu_init(APU_OUTPUT_NONE, MACHINE_SAMPLE_RATE))
+        goto err_serial;
+    return 0;
+
+err_serial:
+    serial_end();
+err_joypad:
+    joypad_end();
+err_dma:
+    dma_end();
+err_ppu:
+    ppu_end();
+err_cpu:
+    cpu_end();
+err_ram:
+    ram_end();
+    return -1;
+}
+
+static void devices_end()
+{
+    apu_end();
+    serial_end();
+    joypad_end();
+    dma_end();
+    ppu_end();
+    cpu_end();
+    ram_end();
+}
+
+int machine_init(const char *rom_path)
+{
+    bus_set_open(1);
+    if (cart_load(rom_path))
+        return -1;
+    if (devices_init())
+    {
+        cart_end();
+        return -1;
+    }
+    has_cart = 1;
+    return 0;
+}
+
+int machine_init_program(uint8_t *program, uint16_t size)
+{
+    bus_set_open(1);
+    if (add_bus_memory(0, size, program, NULL))
+        return -1;
+    if (devices_init())
+    {
+        remove_bus_connection(0);
+        return -1;
+    }
+    has_cart = 0;
+    return 0;
+}
+
+void machine_end()
+{
+    devices_end();
+    if (has_cart)
+        cart_end();
+    else
+        remove_bus_connection(0);
+}
@@ -3,8 +3,15 @@
 #include "bus.h"
 #include "cpu/cpu.h"
 #include "cpu/registers.h"
+#include "ppu.h"
+#include "dma.h"
+#include "apu.h"
+#include "joypad.h"
+#include "serial.h"
 #include "log.h"
 
+#define APU_SAMPLE_RATE 48000
+
 char mem[256];
 
 
@@ -34,7 +41,64 @@ int main(int argc, const char *argv[])
         return -1;
     }
 	
+    if (cpu_init())
+    {
+        remove_bus_connection(0x0100);
+        return -1;
+    }
+
+    if (ppu_init(PPU_RENDER_FULL))
+    {
+        cpu_end();
+        remove_bus_connection(0x0100);
+        return -1;
+    }
+
+    if (dma_init())
+    {
+        ppu_end();
+        cpu_end();
+        remove_bus_connection(0x0100);
+        return -1;
+    }
+
+    if (joypad_init())
+    {
+        dma_end();
+        ppu_end();
+        cpu_end();
+        remove_bus_connection(0x0100);
+        return -1;
+    }
+
+    if (serial_init())
+    {
+        joypad_end();
+        dma_end();
+        ppu_end();
+        cpu_end();
+        remove_bus_connection(0x0100);
+        return -1;
+    }
+
+    if (apu_init(APU_OUTPUT_NONE, APU_SAMPLE_RATE))
+    {
+        serial_end();
+        joypad_end();
+        dma_end();
+        ppu_end();
+        cpu_end();
+        remove_bus_connection(0x0100);
+        return -1;
+    }
+
     cpu_loop();
 
+    apu_end();
+    serial_end();
+    joypad_end();
+    dma_end();
+    ppu_end();
+    cpu_end();
     remove_bus_connection(0x0100);
 }
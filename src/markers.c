@@ -0,0 +1,197 @@
+#include "markers.h"
+#include <stdlib.h>
+#include <string.h>
+#include "bus.h"
+#include "log.h"
+#include "cpu/cpu.h"
+
+#define JR_OPCODE 0x18
+#define MESSAGE_MAGIC 0x6464
+#define MESSAGE_HEADER 6 // JR, its offset and the two magic words.
+
+struct markers_struct
+{
+    struct marker *table;
+    uint32_t count;
+    uint64_t dropped;
+};
+
+// Cycles between two marker addresses.
+struct span
+{
+    uint16_t from;
+    uint16_t to;
+    uint64_t count;
+    uint64_t min;
+    uint64_t max;
+    uint64_t total;
+};
+
+uint8_t markers_enabled = 0;
+
+static struct markers_struct markers;
+
+static void read_message(struct marker *entry)
+{
+    uint8_t header[MESSAGE_HEADER], len, i;
+
+    entry->message[0] = '\0';
+    for (i = 0; i < MESSAGE_HEADER; i++)
+    {
+        if (bus_read(&header[i], entry->pc + 1 + i))
+            return;
+    }
+
+    // The JR skips the magic words and the text.
+    if (header[0] != JR_OPCODE || header[1] < 4 || (header[2] | header[3] << 8) != MESSAGE_MAGIC ||
+        header[4] != 0 || header[5] != 0)
+    {
+        return;
+    }
+
+    len = header[1] - 4;
+    if (len >= MARKER_MAX_MESSAGE)
+        len = MARKER_MAX_MESSAGE - 1;
+    for (i = 0; i < len; i++)
+    {
+        if (bus_read((uint8_t*)&entry->message[i], entry->pc + 1 + MESSAGE_HEADER + i))
+            break;
+    }
+    entry->message[i] = '\0';
+}
+
+void markers_hit(enum marker_kind kind, uint16_t pc)
+{
+    struct marker *entry;
+
+    if (markers.count == MARKERS_MAX)
+    {
+        markers.dropped++;
+        return;
+    }
+
+    entry = &markers.table[markers.count++];
+    entry->cycle = cpu.cycle_count;
+    entry->pc = pc;
+    entry->kind = (uint8_t)kind;
+    if (kind == MARKER_MESSAGE)
+        read_message(entry);
+    else
+        entry->message[0] = '\0';
+}
+
+int markers_start()
+{
+    if (markers.table == NULL)
+    {
+        markers.table = (struct marker*)malloc(MARKERS_MAX * sizeof(struct marker));
+        if (markers.table == NULL)
+        {
+            log(LERR "Failed to allocate the marker table.");
+            return -1;
+        }
+    }
+    markers.count = 0;
+    markers.dropped = 0;
+    markers_enabled = 1;
+    return 0;
+}
+
+void markers_stop()
+{
+    markers_enabled = 0;
+}
+
+void markers_end()
+{
+    markers_enabled = 0;
+    free(markers.table);
+    markers.table = NULL;
+    markers.count = 0;
+}
+
+uint32_t markers_count()
+{
+    return markers.count;
+}
+
+const struct marker *markers_get(uint32_t index)
+{
+    return index < markers.count ? &markers.table[index] : NULL;
+}
+
+static int compare_spans(const void *a, const void *b)
+{
+    const struct span *sa = (const struct span*)a, *sb = (const struct span*)b;
+
+    if (sa->from != sb->from)
+        return sa->from < sb->from ? -1 : 1;
+    return sa->to < sb->to ? -1 : sa->to > sb->to;
+}
+
+int markers_report(FILE *file)
+{
+    struct span *spans;
+    struct marker *prev, *cur;
+    uint64_t delta;
+    uint32_t i, num_spans = 0;
+
+    fprintf(file, "%" PRIu32 " markers", markers.count);
+    if (markers.dropped)
+        fprintf(file, ", %" PRIu64 " more dropped", markers.dropped);
+    fprintf(file, "\n%16s  %-4s  %-7s %10s  %s\n", "cycle", "pc", "kind", "delta", "message");
+
+    for (i = 0; i < markers.count; i++)
+    {
+        cur = &markers.table[i];
+        fprintf(file, "%16" PRIu64 "  %04X  %-7s %10" PRIu64 "  %s\n", cur->cycle, cur->pc,
+                cur->kind == MARKER_BREAK ? "break" : "message", i ? cur->cycle - markers.table[i - 1].cycle : 0,
+                cur->message);
+    }
+
+    if (markers.count < 2)
+        return ferror(file) ? -1 : 0;
+
+    spans = (struct span*)malloc((markers.count - 1) * sizeof(struct span));
+    if (spans == NULL)
+        return -1;
+
+    for (i = 1; i < markers.count; i++)
+    {
+        prev = &markers.table[i - 1];
+        cur = &markers.table[i];
+        spans[i - 1] = (struct span){prev->pc, cur->pc, 1, 0, 0, cur->cycle - prev->cycle};
+    }
+    qsort(spans, markers.count - 1, sizeof(struct span), compare_spans);
+
+    // Merge spans between the same addresses.
+    for (i = 0; i < markers.count - 1; i++)
+    {
+        delta = spans[i].total;
+        if (num_spans > 0 && compare_spans(&spans[num_spans - 1], &spans[i]) == 0)
+        {
+            spans[num_spans - 1].count++;
+            spans[num_spans - 1].total += delta;
+            if (delta < spans[num_spans - 1].min)
+                spans[num_spans - 1].min = delta;
+            if (delta > spans[num_spans - 1].max)
+                spans[num_spans - 1].max = delta;
+        }
+        else
+        {
+            spans[num_spans] = spans[i];
+            spans[num_spans].min = spans[num_spans].max = delta;
+            num_spans++;
+        }
+    }
+
+    fprintf(file, "\n%-4s  %-4s %10s %10s %12s %10s\n", "from", "to", "count", "min", "avg", "max");
+    for (i = 0; i < num_spans; i++)
+    {
+        fprintf(file, "%04X  %04X %10" PRIu64 " %10" PRIu64 " %12.1f %10" PRIu64 "\n", spans[i].from, spans[i].to,
+                spans[i].count, spans[i].min, (double)spans[i].total / spans[i].count, spans[i].max);
+    }
+
+    free(spans);
+    return ferror(file) ? -1 : 0;
+}
@@ -0,0 +1,440 @@
+#include "movie.h"
+#include <stdlib.h>
+#include <string.h>
+#include "apu.h"
+#include "bus.h"
+#include "dma.h"
+#include "hash.h"
+#include "joypad.h"
+#include "log.h"
+#include "ppu.h"
+#include "savestate.h"
+#include "scheduler.h"
+#include "cpu/cpu.h"
+
+struct movie_struct movie;
+
+/* ----------- Hashing ----------- */
+
+static void hash_region(uint16_t start_address, uint16_t size, uint8_t *mem, uint8_t read_only, void *arg)
+{
+    uint64_t *hash = (uint64_t*)arg;
+
+    *hash = hash_u16(*hash, start_address);
+    *hash = hash_bytes(*hash, mem, size);
+}
+
+uint64_t movie_state_checksum()
+{
+    uint64_t hash = HASH_SEED;
+
+    // LY, STAT and the APU are only caught up lazily, bring them to the current cycle so the
+    // hash does not depend on when that last happened.
+    ppu_sync();
+    apu_sync();
+
+    hash = hash_u16(hash, cpu.regs.af);
+    hash = hash_u16(hash, cpu.regs.bc);
+    hash = hash_u16(hash, cpu.regs.de);
+    hash = hash_u16(hash, cpu.regs.hl);
+    hash = hash_u16(hash, cpu.regs.sp);
+    hash = hash_u16(hash, cpu.regs.pc);
+    hash = hash_u8(hash, cpu.state);
+    hash = hash_u8(hash, cpu.ime);
+    hash = hash_u8(hash, cpu.enable_irq);
+    hash = hash_u8(hash, cpu.disable_irq);
+    hash = hash_u8(hash, cpu.cycles);
+    hash = hash_u64(hash, cpu.cycle_count);
+    hash = hash_u8(hash, *(uint8_t*)&cpu.if_flags);
+    hash = hash_u8(hash, *(uint8_t*)&cpu.ie_flags);
+    hash = hash_u16(hash, cpu.timer_regs.div);
+    hash = hash_u8(hash, cpu.timer_regs.tac);
+    hash = hash_u8(hash, cpu.timer_regs.tima);
+    hash = hash_u8(hash, cpu.timer_regs.tma);
+    hash = hash_u8(hash, cpu.timer_regs.overflow_counter);
+
+    hash = hash_bytes(hash, &ppu.regs, sizeof(ppu.regs));
+    hash = hash_u64(hash, ppu.frame_start);
+    hash = hash_bytes(hash, apu.regs, sizeof(apu.regs));
+    hash = hash_u8(hash, dma.source);
+    hash = hash_u8(hash, joypad.select);
+    hash = hash_u8(hash, joypad.buttons);
+
+    // VRAM, OAM, wave RAM and every other buffer on the bus.
+    bus_for_each_memory(hash_region, &hash);
+    return hash;
+}
+
+uint64_t movie_rom_hash()
+{
+    uint8_t *rom = bus_get_memory(MOVIE_ROM_ADDR, MOVIE_ROM_SIZE);
+    uint64_t hash = HASH_SEED;
+    uint32_t addr;
+    uint8_t val;
+
+    if (rom != NULL)
+    {
+        return hash_bytes(hash, rom, MOVIE_ROM_SIZE);
+    }
+
+    for (addr = MOVIE_ROM_ADDR; addr < MOVIE_ROM_ADDR + MOVIE_ROM_SIZE; addr++)
+    {
+        if (bus_read(&val, addr))
+        {
+            val = 0xFF;
+        }
+        hash = hash_u8(hash, val);
+    }
+    return hash;
+}
+
+/* ----------- File format ----------- */
+
+static void put_le(uint8_t *dst, uint64_t val, uint8_t size)
+{
+    uint8_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        dst[i] = (uint8_t)(val >> (i * 8));
+    }
+}
+
+static uint64_t get_le(const uint8_t *src, uint8_t size)
+{
+    uint64_t val = 0;
+    uint8_t i;
+
+    for (i = 0; i < size; i++)
+    {
+        val |= (uint64_t)src[i] << (i * 8);
+    }
+    return val;
+}
+
+static void write_record(enum movie_record type, uint64_t cycle, uint64_t payload, uint8_t payload_size)
+{
+    uint8_t buffer[1 + 10 + 8];
+    uint64_t delta = cycle - movie.last_cycle;
+    uint8_t size = 0;
+
+    buffer[size++] = type;
+    do
+    {
+        buffer[size] = delta & 0x7F;
+        delta >>= 7;
+        if (delta)
+        {
+            buffer[size] |= 0x80;
+        }
+        size++;
+    } while (delta);
+
+    put_le(&buffer[size], payload, payload_size);
+    size += payload_size;
+
+    fwrite(buffer, 1, size, movie.file);
+    movie.last_cycle = cycle;
+}
+
+static int read_varint(const uint8_t **pos, const uint8_t *end, uint64_t *val)
+{
+    uint8_t shift = 0;
+
+    *val = 0;
+    while (*pos < end && shift < 64)
+    {
+        *val |= (uint64_t)(**pos & 0x7F) << shift;
+        if (!(*(*pos)++ & 0x80))
+        {
+            return 0;
+        }
+        shift += 7;
+    }
+    return -1;
+}
+
+// Split the records into inputs and checksums, both in cycle order.
+static int parse_records(const uint8_t *pos, const uint8_t *end)
+{
+    uint64_t cycle = movie.start_cycle, delta;
+    uint8_t type;
+
+    // Every record takes at least two bytes, which bounds both arrays.
+    movie.inputs = (struct movie_input*)malloc((end - pos) / 2 * sizeof(struct movie_input) + 1);
+    movie.checksums = (struct movie_checksum*)malloc((end - pos) / 2 * sizeof(struct movie_checksum) + 1);
+    if (movie.inputs == NULL || movie.checksums == NULL)
+    {
+        return -1;
+    }
+
+    while (pos < end)
+    {
+        type = *pos++;
+        if (read_varint(&pos, end, &delta))
+        {
+            return -1;
+        }
+        cycle += delta;
+
+        switch (type)
+        {
+        case MOVIE_RECORD_INPUT:
+            if (end - pos < 1)
+                return -1;
+            movie.inputs[movie.num_inputs++] = (struct movie_input){cycle, *pos};
+            pos += 1;
+            break;
+        case MOVIE_RECORD_CHECKSUM:
+            if (end - pos < 8)
+                return -1;
+            movie.checksums[movie.num_checksums++] = (struct movie_checksum){cycle, get_le(pos, 8)};
+            pos += 8;
+            break;
+        case MOVIE_RECORD_END:
+            movie.end_cycle = cycle;
+            return 0;
+        default:
+            return -1;
+        }
+    }
+
+    // A movie that was never ended plays until its last record.
+    movie.end_cycle = cycle;
+    return 0;
+}
+
+/* ----------- Record and replay ----------- */
+
+static void diverge(uint64_t cycle)
+{
+    if (movie.diverged_cycle == SCHED_NEVER)
+    {
+        log(LWARN "Movie replay diverged at cycle %" PRIu64, cycle);
+        movie.diverged_cycle = cycle;
+    }
+}
+
+// Keep the joypad queue topped up with the inputs still ahead.
+static void queue_inputs()
+{
+    while (movie.queued_inputs < movie.num_inputs && joypad.queue_count < JOYPAD_QUEUE_SIZE)
+    {
+        if (joypad_queue(movie.inputs[movie.queued_inputs].cycle, movie.inputs[movie.queued_inputs].buttons))
+        {
+            break;
+        }
+        movie.queued_inputs++;
+    }
+}
+
+static void movie_input(uint64_t cycle, uint8_t buttons)
+{
+    struct movie_input *input;
+
+    if (movie.mode == MOVIE_RECORDING)
+    {
+        write_record(MOVIE_RECORD_INPUT, cycle, buttons, 1);
+        return;
+    }
+
+    if (movie.next_input == movie.num_inputs)
+    {
+        diverge(cycle);
+        return;
+    }
+
+    input = &movie.inputs[movie.next_input++];
+    if (input->cycle != cycle || input->buttons != buttons)
+    {
+        diverge(cycle);
+    }
+    queue_inputs();
+}
+
+static void movie_event(uint64_t cycle)
+{
+    if (movie.mode == MOVIE_RECORDING)
+    {
+        write_record(MOVIE_RECORD_CHECKSUM, cycle, movie_state_checksum(), 8);
+        sched_set(SCHED_MOVIE, cycle + movie.interval);
+        return;
+    }
+
+    if (movie.checksums[movie.next_checksum].checksum != movie_state_checksum())
+    {
+        diverge(cycle);
+    }
+    movie.next_checksum++;
+    if (movie.next_checksum < movie.num_checksums)
+    {
+        sched_set(SCHED_MOVIE, movie.checksums[movie.next_checksum].cycle);
+    }
+}
+
+static void reset()
+{
+    memset(&movie, 0, sizeof(movie));
+    movie.diverged_cycle = SCHED_NEVER;
+    movie.end_cycle = SCHED_NEVER;
+}
+
+int movie_record(const char *path, uint32_t interval)
+{
+    uint8_t header[MOVIE_HEADER_SIZE];
+    uint32_t state_size = savestate_size();
+    uint8_t *state = NULL;
+
+    reset();
+    movie.rom_hash = movie_rom_hash();
+    movie.start_cycle = cpu.cycle_count;
+    movie.last_cycle = cpu.cycle_count;
+    movie.interval = interval;
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, MOVIE_MAGIC, 4);
+    put_le(header + 4, MOVIE_VERSION, 2);
+    put_le(header + 8, movie.rom_hash, 8);
+    put_le(header + 16, movie.start_cycle, 8);
+    put_le(header + 24, movie_state_checksum(), 8);
+    put_le(header + 32, interval, 4);
+    put_le(header + 36, state_size, 4);
+
+    state = (uint8_t*)malloc(state_size);
+    if (state == NULL || savestate_save(state, state_size))
+    {
+        goto error;
+    }
+
+    movie.file = fopen(path, "wb");
+    if (movie.file == NULL || fwrite(header, 1, sizeof(header), movie.file) != sizeof(header) ||
+        fwrite(state, 1, state_size, movie.file) != state_size || sched_register(SCHED_MOVIE, movie_event))
+    {
+        goto error;
+    }
+    free(state);
+
+    movie.mode = MOVIE_RECORDING;
+    joypad_set_input_callback(movie_input);
+    sched_set(SCHED_MOVIE, movie.start_cycle + interval);
+    return 0;
+
+error:
+    free(state);
+    if (movie.file != NULL)
+        fclose(movie.file);
+    movie.file = NULL;
+    log(LERR "Failed to record movie %s", path);
+    return -1;
+}
+
+int movie_replay(const char *path)
+{
+    FILE *file;
+    uint8_t *data = NULL;
+    uint32_t state_size;
+    long size;
+
+    reset();
+
+    file = fopen(path, "rb");
+    if (file == NULL || fseek(file, 0, SEEK_END) || (size = ftell(file)) < MOVIE_HEADER_SIZE || fseek(file, 0, SEEK_SET))
+    {
+        goto error;
+    }
+    data = (uint8_t*)malloc(size);
+    if (data == NULL || fread(data, 1, size, file) != (size_t)size)
+    {
+        goto error;
+    }
+    fclose(file);
+    file = NULL;
+
+    if (memcmp(data, MOVIE_MAGIC, 4) || get_le(data + 4, 2) != MOVIE_VERSION)
+    {
+        log(LERR "%s is not a version %d movie", path, MOVIE_VERSION);
+        goto error;
+    }
+
+    movie.rom_hash = get_le(data + 8, 8);
+    movie.start_cycle = get_le(data + 16, 8);
+    movie.interval = (uint32_t)get_le(data + 32, 4);
+    state_size = (uint32_t)get_le(data + 36, 4);
+    if (movie.rom_hash != movie_rom_hash())
+    {
+        log(LERR "Movie %s was recorded on a different ROM", path);
+        goto error;
+    }
+    if (state_size > size - MOVIE_HEADER_SIZE || savestate_load(data + MOVIE_HEADER_SIZE, state_size))
+    {
+        log(LERR "Movie %s start state does not load into this machine", path);
+        goto error;
+    }
+    if (movie.start_cycle != cpu.cycle_count || get_le(data + 24, 8) != movie_state_checksum())
+    {
+        log(LERR "Movie %s start state does not match its checksum", path);
+        goto error;
+    }
+
+    if (parse_records(data + MOVIE_HEADER_SIZE + state_size, data + size) || sched_register(SCHED_MOVIE, movie_event))
+    {
+        log(LERR "Movie %s is corrupt", path);
+        goto error;
+    }
+    free(data);
+
+    movie.mode = MOVIE_REPLAYING;
+    joypad_clear_queue();
+    joypad_set_input_callback(movie_input);
+    queue_inputs();
+    if (movie.num_checksums)
+    {
+        sched_set(SCHED_MOVIE, movie.checksums[0].cycle);
+    }
+    return 0;
+
+error:
+    if (file != NULL)
+        fclose(file);
+    free(data);
+    free(movie.inputs);
+    free(movie.checksums);
+    reset();
+    log(LERR "Failed to replay movie %s", path);
+    return -1;
+}
+
+int movie_end()
+{
+    int ret = 0;
+
+    if (movie.mode == MOVIE_OFF)
+    {
+        return 0;
+    }
+
+    sched_cancel(SCHED_MOVIE);
+    joypad_set_input_callback(NULL);
+
+    if (movie.mode == MOVIE_RECORDING)
+    {
+        write_record(MOVIE_RECORD_END, cpu.cycle_count, 0, 0);
+        if (ferror(movie.file) | fclose(movie.file))
+        {
+            log(LERR "Failed to write movie.");
+            ret = -1;
+        }
+    }
+    else
+    {
+        joypad_clear_queue();
+        free(movie.inputs);
+        free(movie.checksums);
+    }
+
+    movie.mode = MOVIE_OFF;
+    movie.file = NULL;
+    movie.inputs = NULL;
+    movie.checksums = NULL;
+    return ret;
+}
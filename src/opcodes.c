@@ -1,9 +1,13 @@
 #include "cpu/opcodes.h"
 #include "bus.h"
+#include "callgraph.h"
+#include "coverage.h"
 #include "log.h"
+#include "markers.h"
 #include "mem_utils.h"
 
 struct opcode opcodes[NUM_OPCODES] = {INVAL};
+uint8_t cb_opcode;
 
 /* ----------- Utils ----------- */
 
@@ -196,6 +200,7 @@ OPCODE(CB)
     {
         return -1;
     }
+    cb_opcode = type;
 
     switch (type)
     {
@@ -964,6 +969,7 @@ OPCODE(LD_B_A)
 
 OPCODE(LD_B_B)
 {
+    marker(MARKER_BREAK, regs->pc);
     log(LDEBUG "LD B, B");
     return 0;
 }
@@ -1088,6 +1094,7 @@ OPCODE(LD_D_C)
 
 OPCODE(LD_D_D)
 {
+    marker(MARKER_MESSAGE, regs->pc);
     log(LDEBUG "LD D, D");
     return 0;
 }
@@ -3258,6 +3265,7 @@ OPCODE(JP)
         return -1;
     }
 
+    coverage_edge(regs->pc, addr);
     regs->pc = addr;
 
     log(LDEBUG "JP 0x%04x", addr);
@@ -3292,6 +3300,7 @@ OPCODE(JP_NZ)
     }
 #endif
 
+    coverage_edge(regs->pc, addr);
     regs->pc = addr;
     return 0;
 }
@@ -3324,6 +3333,7 @@ OPCODE(JP_Z)
     }
 #endif
 
+    coverage_edge(regs->pc, addr);
     regs->pc = addr;
     return 0;
 }
@@ -3356,6 +3366,7 @@ OPCODE(JP_NC)
     }
 #endif
 
+    coverage_edge(regs->pc, addr);
     regs->pc = addr;
     return 0;
 }
@@ -3388,6 +3399,7 @@ OPCODE(JP_C)
     }
 #endif
 
+    coverage_edge(regs->pc, addr);
     regs->pc = addr;
     return 0;
 }
@@ -3401,6 +3413,7 @@ OPCODE(JP_HL)
         return -1;
     }
 
+    coverage_edge(regs->pc, address);
     regs->pc = address;
     log(LDEBUG "JP (HL)");
     return 0;
@@ -3415,6 +3428,7 @@ OPCODE(JR)
         return -1;
     }
 
+    coverage_edge(regs->pc, regs->pc + offset);
     regs->pc += offset;
     log(LDEBUG "JR 0x%02x", offset);
     return 0;
@@ -3448,6 +3462,7 @@ OPCODE(JR_NZ)
     }
 #endif
 
+    coverage_edge(regs->pc, regs->pc + offset);
     regs->pc += offset;
     return 0;
 }
@@ -3480,6 +3495,7 @@ OPCODE(JR_Z)
     }
 #endif
 
+    coverage_edge(regs->pc, regs->pc + offset);
     regs->pc += offset;
     return 0;
 }
@@ -3512,6 +3528,7 @@ OPCODE(JR_NC)
     }
 #endif
 
+    coverage_edge(regs->pc, regs->pc + offset);
     regs->pc += offset;
     return 0;
 }
@@ -3544,6 +3561,7 @@ OPCODE(JR_C)
     }
 #endif
 
+    coverage_edge(regs->pc, regs->pc + offset);
     regs->pc += offset;
     return 0;
 }
@@ -3564,6 +3582,8 @@ OPCODE(CALL)
     {
         return -1;
     }
+    coverage_edge(regs->pc, address);
+    callgraph_call(address, regs->sp);
     regs->pc = address;
     log(LDEBUG "CALL 0x%04x", address);
     return 0;
@@ -3602,6 +3622,8 @@ OPCODE(CALL_NZ)
         return -1;
     }
 
+    coverage_edge(regs->pc, address);
+    callgraph_call(address, regs->sp);
     regs->pc = address;
     return 0;
 }
@@ -3639,6 +3661,8 @@ OPCODE(CALL_Z)
         return -1;
     }
 
+    coverage_edge(regs->pc, address);
+    callgraph_call(address, regs->sp);
     regs->pc = address;
     return 0;
 }
@@ -3676,6 +3700,8 @@ OPCODE(CALL_NC)
         return -1;
     }
 
+    coverage_edge(regs->pc, address);
+    callgraph_call(address, regs->sp);
     regs->pc = address;
     return 0;
 }
@@ -3713,6 +3739,8 @@ OPCODE(CALL_C)
         return -1;
     }
 
+    coverage_edge(regs->pc, address);
+    callgraph_call(address, regs->sp);
     regs->pc = address;
     return 0;
 }
@@ -3727,6 +3755,8 @@ OPCODE(RST_00)
         return -1;
     }
 
+    coverage_edge(regs->pc, 0x0000);
+    callgraph_call(0x0000, regs->sp);
     regs->pc = 0x0000;
     log(LDEBUG "RST $00");
     return 0;
@@ -3740,6 +3770,8 @@ OPCODE(RST_08)
         return -1;
     }
 
+    coverage_edge(regs->pc, 0x0008);
+    callgraph_call(0x0008, regs->sp);
     regs->pc = 0x0008;
     log(LDEBUG "RST $08");
     return 0;
@@ -3753,6 +3785,8 @@ OPCODE(RST_10)
         return -1;
     }
 
+    coverage_edge(regs->pc, 0x0010);
+    callgraph_call(0x0010, regs->sp);
     regs->pc = 0x0010;
     log(LDEBUG "RST $10");
     return 0;
@@ -3766,6 +3800,8 @@ OPCODE(RST_18)
         return -1;
     }
 
+    coverage_edge(regs->pc, 0x0018);
+    callgraph_call(0x0018, regs->sp);
     regs->pc = 0x0018;
     log(LDEBUG "RST $18");
     return 0;
@@ -3779,6 +3815,8 @@ OPCODE(RST_20)
         return -1;
     }
 
+    coverage_edge(regs->pc, 0x0020);
+    callgraph_call(0x0020, regs->sp);
     regs->pc = 0x0020;
     log(LDEBUG "RST $20");
     return 0;
@@ -3792,6 +3830,8 @@ OPCODE(RST_28)
         return -1;
     }
 
+    coverage_edge(regs->pc, 0x0028);
+    callgraph_call(0x0028, regs->sp);
     regs->pc = 0x0028;
     log(LDEBUG "RST $28");
     return 0;
@@ -3805,6 +3845,8 @@ OPCODE(RST_30)
         return -1;
     }
 
+    coverage_edge(regs->pc, 0x0030);
+    callgraph_call(0x0030, regs->sp);
     regs->pc = 0x0030;
     log(LDEBUG "RST $30");
     return 0;
@@ -3818,6 +3860,8 @@ OPCODE(RST_38)
         return -1;
     }
 
+    coverage_edge(regs->pc, 0x0038);
+    callgraph_call(0x0038, regs->sp);
     regs->pc = 0x0038;
     log(LDEBUG "RST $38");
     return 0;
@@ -3833,8 +3877,10 @@ OPCODE(RET)
     {
         return -1;
     }
+    callgraph_ret(regs->sp);
     regs->sp += 2;
 
+    coverage_edge(regs->pc, address);
     regs->pc = address;
     log(LDEBUG "RET");
     return 0;
@@ -3854,8 +3900,10 @@ OPCODE(RET_NZ)
     {
         return -1;
     }
+    callgraph_ret(regs->sp);
     regs->sp += 2;
 
+    coverage_edge(regs->pc, address);
     regs->pc = address;
     return 0;
 }
@@ -3874,8 +3922,10 @@ OPCODE(RET_Z)
     {
         return -1;
     }
+    callgraph_ret(regs->sp);
     regs->sp += 2;
 
+    coverage_edge(regs->pc, address);
     regs->pc = address;
     return 0;
 }
@@ -3894,8 +3944,10 @@ OPCODE(RET_NC)
     {
         return -1;
     }
+    callgraph_ret(regs->sp);
     regs->sp += 2;
 
+    coverage_edge(regs->pc, address);
     regs->pc = address;
     return 0;
 }
@@ -3914,8 +3966,10 @@ OPCODE(RET_C)
     {
         return -1;
     }
+    callgraph_ret(regs->sp);
     regs->sp += 2;
 
+    coverage_edge(regs->pc, address);
     regs->pc = address;
     return 0;
 }
@@ -3928,8 +3982,10 @@ OPCODE(RETI)
     {
         return -1;
     }
+    callgraph_ret(regs->sp);
     regs->sp += 2;
 
+    coverage_edge(regs->pc, address);
     regs->pc = address;
     *enable_irq = 2;
     log(LDEBUG "RETI");
@@ -0,0 +1,143 @@
+#include "opstats.h"
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+
+#define CB_OPCODE 0xCB
+
+struct opstats_struct opstats;
+
+static const char *dump_path = NULL;
+static uint8_t exit_registered = 0;
+
+void opstats_count(uint8_t opcode, uint8_t cb_opcode, uint8_t cycles)
+{
+    opstats.executions[opcode]++;
+    opstats.cycles[opcode] += cycles;
+
+    if (opcode == CB_OPCODE)
+    {
+        opstats.cb_executions[cb_opcode]++;
+        opstats.cb_cycles[cb_opcode] += cycles;
+    }
+}
+
+static void dump_at_exit()
+{
+    if (dump_path != NULL)
+    {
+        opstats_dump(dump_path);
+    }
+}
+
+int opstats_enable(const char *exit_path)
+{
+    opstats_clear();
+
+    if (exit_path != NULL && !exit_registered)
+    {
+        if (atexit(dump_at_exit))
+        {
+            log(LERR "Failed to register the opcode stats dump.");
+            return -1;
+        }
+        exit_registered = 1;
+    }
+    dump_path = exit_path;
+    opstats.enabled = 1;
+    return 0;
+}
+
+void opstats_disable()
+{
+    opstats.enabled = 0;
+    dump_path = NULL;
+}
+
+void opstats_clear()
+{
+    uint8_t enabled = opstats.enabled;
+
+    memset(&opstats, 0, sizeof(opstats));
+    opstats.enabled = enabled;
+}
+
+int opstats_write_csv(FILE *file)
+{
+    uint32_t i;
+
+    fprintf(file, "opcode,executions,cycles\n");
+    for (i = 0; i < OPSTATS_NUM_OPCODES; i++)
+    {
+        if (opstats.executions[i])
+            fprintf(file, "0x%02X,%" PRIu64 ",%" PRIu64 "\n", i, opstats.executions[i], opstats.cycles[i]);
+    }
+    for (i = 0; i < OPSTATS_NUM_OPCODES; i++)
+    {
+        if (opstats.cb_executions[i])
+            fprintf(file, "0xCB%02X,%" PRIu64 ",%" PRIu64 "\n", i, opstats.cb_executions[i], opstats.cb_cycles[i]);
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+static void write_json_table(FILE *file, const char *name, const char *prefix, const uint64_t *executions,
+                             const uint64_t *cycles)
+{
+    uint32_t i;
+    const char *sep = "";
+
+    fprintf(file, "  \"%s\": [", name);
+    for (i = 0; i < OPSTATS_NUM_OPCODES; i++)
+    {
+        if (executions[i])
+        {
+            fprintf(file, "%s\n    {\"opcode\": \"%s%02X\", \"executions\": %" PRIu64 ", \"cycles\": %" PRIu64 "}",
+                    sep, prefix, i, executions[i], cycles[i]);
+            sep = ",";
+        }
+    }
+    fprintf(file, "\n  ]");
+}
+
+int opstats_write_json(FILE *file)
+{
+    uint64_t executions = 0, cycles = 0;
+    uint32_t i;
+
+    for (i = 0; i < OPSTATS_NUM_OPCODES; i++)
+    {
+        executions += opstats.executions[i];
+        cycles += opstats.cycles[i];
+    }
+
+    fprintf(file, "{\n  \"executions\": %" PRIu64 ",\n  \"cycles\": %" PRIu64 ",\n", executions, cycles);
+    write_json_table(file, "opcodes", "0x", opstats.executions, opstats.cycles);
+    fprintf(file, ",\n");
+    write_json_table(file, "cb_opcodes", "0xCB", opstats.cb_executions, opstats.cb_cycles);
+    fprintf(file, "\n}\n");
+    return ferror(file) ? -1 : 0;
+}
+
+int opstats_dump(const char *path)
+{
+    FILE *file = fopen(path, "w");
+    size_t len = strlen(path);
+    int ret;
+
+    if (file == NULL)
+    {
+        log(LERR "Failed to open %s", path);
+        return -1;
+    }
+
+    if (len >= 5 && strcmp(path + len - 5, ".json") == 0)
+        ret = opstats_write_json(file);
+    else
+        ret = opstats_write_csv(file);
+
+    if (fclose(file))
+        ret = -1;
+    if (ret)
+        log(LERR "Failed to write opcode stats to %s", path);
+    return ret;
+}
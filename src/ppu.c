@@ -0,0 +1,630 @@
+#include "ppu.h"
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+#include "bus.h"
+#include "log.h"
+#include "scheduler.h"
+#include "cpu/cpu.h"
+
+#define SPRITE_BG_PRIORITY(flags) (flags & 0x80)
+#define SPRITE_FLIP_Y(flags)      (flags & 0x40)
+#define SPRITE_FLIP_X(flags)      (flags & 0x20)
+#define SPRITE_PALETTE(flags)     (flags & 0x10)
+
+struct ppu_struct ppu;
+
+static ppu_frame_callback_t frame_callback = NULL;
+
+/* ----------- Rendering ----------- */
+
+static inline uint8_t tile_pixel(uint16_t tile_offset, uint8_t x, uint8_t y)
+{
+    uint8_t lsb = ppu.vram[tile_offset + y * 2];
+    uint8_t msb = ppu.vram[tile_offset + y * 2 + 1];
+
+    return (((msb >> (7 - x)) & 1) << 1) | ((lsb >> (7 - x)) & 1);
+}
+
+// VRAM offset of a background/window tile, LCDC selects between unsigned and signed indexing.
+static inline uint16_t bg_tile_offset(uint8_t tile)
+{
+    if (LCDC_TILE_DATA(ppu.regs.lcdc))
+    {
+        return tile * 16;
+    }
+    return 0x1000 + (int8_t)tile * 16;
+}
+
+static inline uint8_t palette_shade(uint8_t palette, uint8_t color)
+{
+    return (palette >> (color * 2)) & 3;
+}
+
+// Mask of the OAM entries whose Y range covers line ly, bit i for sprite i.
+#ifdef __SSE2__
+static inline uint64_t sprites_on_line(uint8_t ly, uint8_t height)
+{
+    const __m128i top = _mm_set1_epi8((char)(ly + 16));
+    const __m128i max_row = _mm_set1_epi8((char)(height - 1));
+    __m128i row;
+    uint64_t mask = 0;
+    uint8_t i;
+
+    // Row of the sprite covering ly is (ly + 16 - y) mod 256, visible while it is below height.
+    for (i = 0; i < OAM_SOA_SIZE; i += 16)
+    {
+        row = _mm_sub_epi8(top, _mm_load_si128((const __m128i*)&ppu.oam_y[i]));
+        row = _mm_cmpeq_epi8(_mm_min_epu8(row, max_row), row);
+        mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(row) << i;
+    }
+    return mask;
+}
+#else
+static inline uint64_t sprites_on_line(uint8_t ly, uint8_t height)
+{
+    uint64_t mask = 0;
+    uint8_t i;
+
+    for (i = 0; i < NUM_SPRITES; i++)
+    {
+        if ((uint8_t)(ly + 16 - ppu.oam_y[i]) < height)
+        {
+            mask |= (uint64_t)1 << i;
+        }
+    }
+    return mask;
+}
+#endif
+
+uint8_t ppu_find_sprites(uint8_t ly, uint8_t *sprites)
+{
+    uint64_t mask = sprites_on_line(ly, LCDC_OBJ_SIZE(ppu.regs.lcdc) ? 16 : 8);
+    uint8_t i, j, count = 0;
+
+    // Only the first 10 matches in OAM order are visible, lower X wins, ties are won by the
+    // lower OAM index.
+    while (mask && count < MAX_SPRITES_PER_LINE)
+    {
+        i = __builtin_ctzll(mask);
+        mask &= mask - 1;
+
+        for (j = count; j > 0 && ppu.oam_x[sprites[j - 1]] > ppu.oam_x[i]; j--)
+        {
+            sprites[j] = sprites[j - 1];
+        }
+        sprites[j] = i;
+        count++;
+    }
+    return count;
+}
+
+static void render_sprites(uint8_t ly, uint8_t *line, const uint8_t *bg_colors)
+{
+    uint8_t sprites[MAX_SPRITES_PER_LINE];
+    uint8_t count, height = LCDC_OBJ_SIZE(ppu.regs.lcdc) ? 16 : 8;
+    uint8_t *sprite, tile, flags, row, color, px;
+    int16_t x, screen_x;
+
+    count = ppu_find_sprites(ly, sprites);
+
+    // Draw from lowest to highest priority so higher priority sprites end up on top.
+    while (count-- > 0)
+    {
+        sprite = &ppu.oam[sprites[count] * 4];
+        flags = sprite[3];
+        tile = height == 16 ? sprite[2] & 0xFE : sprite[2];
+        row = ly - (sprite[0] - 16);
+        if (SPRITE_FLIP_Y(flags))
+        {
+            row = height - 1 - row;
+        }
+
+        for (x = 0; x < 8; x++)
+        {
+            screen_x = sprite[1] - 8 + x;
+            if (screen_x < 0 || screen_x >= LCD_WIDTH)
+            {
+                continue;
+            }
+
+            px = SPRITE_FLIP_X(flags) ? 7 - x : x;
+            color = tile_pixel(tile * 16 + (row & 8) * 2, px, row & 7);
+            if (color == 0 || (SPRITE_BG_PRIORITY(flags) && bg_colors[screen_x]))
+            {
+                continue;
+            }
+            line[screen_x] = palette_shade(SPRITE_PALETTE(flags) ? ppu.regs.obp1 : ppu.regs.obp0, color);
+        }
+    }
+}
+
+static void render_scanline(uint8_t ly)
+{
+    uint8_t bg_colors[LCD_WIDTH];
+    uint8_t *line = ppu.framebuffer[ly];
+    uint8_t x, map_x, map_y, color, window = 0;
+    uint16_t map;
+    int16_t win_x = (int16_t)ppu.regs.wx - 7;
+
+    if (LCDC_WIN_ENABLE(ppu.regs.lcdc) && ppu.regs.wy <= ly && ppu.regs.wx <= 166)
+    {
+        window = 1;
+    }
+
+    for (x = 0; x < LCD_WIDTH; x++)
+    {
+        if (!LCDC_BG_ENABLE(ppu.regs.lcdc))
+        {
+            color = 0;
+        }
+        else if (window && x >= win_x)
+        {
+            map = LCDC_WIN_MAP(ppu.regs.lcdc) ? 0x1C00 : 0x1800;
+            map_x = x - win_x;
+            map_y = ppu.window_line;
+            color = tile_pixel(bg_tile_offset(ppu.vram[map + (map_y / 8) * 32 + map_x / 8]), map_x & 7, map_y & 7);
+        }
+        else
+        {
+            map = LCDC_BG_MAP(ppu.regs.lcdc) ? 0x1C00 : 0x1800;
+            map_x = x + ppu.regs.scx;
+            map_y = ly + ppu.regs.scy;
+            color = tile_pixel(bg_tile_offset(ppu.vram[map + (map_y / 8) * 32 + map_x / 8]), map_x & 7, map_y & 7);
+        }
+        bg_colors[x] = color;
+        line[x] = palette_shade(ppu.regs.bgp, color);
+    }
+
+    if (window && LCDC_BG_ENABLE(ppu.regs.lcdc))
+    {
+        ppu.window_line++;
+    }
+
+    if (LCDC_OBJ_ENABLE(ppu.regs.lcdc))
+    {
+        render_sprites(ly, line, bg_colors);
+    }
+}
+
+/* ----------- Timing ----------- */
+
+// The PPU does no work per clock cycle. Its mode and LY are derived from the cycle counter on
+// demand, scanlines are rendered in a batch whenever the CPU is about to change what they would
+// show, and the scheduler only wakes it up when an interrupt may have to be requested.
+
+static inline uint32_t frame_pos(uint64_t cycle)
+{
+    return (cycle - ppu.frame_start) % FRAME_CYCLES;
+}
+
+static inline enum ppu_mode pos_mode(uint32_t pos)
+{
+    uint16_t dot = pos % LINE_CYCLES;
+
+    if (pos >= VBLANK_LINE * LINE_CYCLES)
+        return PPU_MODE_VBLANK;
+    if (dot < OAM_SCAN_CYCLES)
+        return PPU_MODE_OAM;
+    if (dot < OAM_SCAN_CYCLES + TRANSFER_CYCLES)
+        return PPU_MODE_TRANSFER;
+    return PPU_MODE_HBLANK;
+}
+
+// State of the STAT interrupt line at the given cycle, assuming the current STAT and LYC.
+static uint8_t stat_line_at(uint64_t cycle)
+{
+    uint32_t pos = frame_pos(cycle);
+    uint8_t stat = ppu.regs.stat;
+    enum ppu_mode mode = pos_mode(pos);
+
+    return ((stat & STAT_LYC_IRQ) && pos / LINE_CYCLES == ppu.regs.lyc) ||
+           ((stat & STAT_OAM_IRQ) && mode == PPU_MODE_OAM) ||
+           ((stat & STAT_VBLANK_IRQ) && mode == PPU_MODE_VBLANK) ||
+           ((stat & STAT_HBLANK_IRQ) && mode == PPU_MODE_HBLANK);
+}
+
+// First cycle after 'cycle' that is at the given position in the frame.
+static inline uint64_t next_pos_cycle(uint64_t cycle, uint32_t target)
+{
+    uint32_t pos = frame_pos(cycle);
+
+    if (target > pos)
+        return cycle + (target - pos);
+    return cycle + FRAME_CYCLES - pos + target;
+}
+
+// First cycle after 'cycle' at the given dot of a visible line.
+static uint64_t next_line_dot_cycle(uint64_t cycle, uint16_t dot)
+{
+    uint32_t pos = frame_pos(cycle);
+    uint16_t line = pos / LINE_CYCLES;
+
+    if (line < VBLANK_LINE && pos % LINE_CYCLES < dot)
+        return cycle + dot - pos % LINE_CYCLES;
+    if (line + 1 < VBLANK_LINE)
+        return next_pos_cycle(cycle, (line + 1) * LINE_CYCLES + dot);
+    return next_pos_cycle(cycle, dot);
+}
+
+// Render every scanline whose transfer mode started at or before 'cycle'.
+static void render_until(uint64_t cycle)
+{
+    uint8_t ly;
+
+    while (ppu.render_cycle <= cycle)
+    {
+        ly = frame_pos(ppu.render_cycle) / LINE_CYCLES;
+        if (ly == 0)
+        {
+            ppu.window_line = 0;
+        }
+        render_scanline(ly);
+
+        if (ly == VBLANK_LINE - 1)
+            ppu.render_cycle += LINE_CYCLES * (NUM_LINES - VBLANK_LINE + 1);
+        else
+            ppu.render_cycle += LINE_CYCLES;
+    }
+}
+
+// Bring LY, the STAT mode and the framebuffer up to date with the given cycle.
+static void sync(uint64_t cycle)
+{
+    uint32_t pos;
+
+    if (!LCDC_ENABLE(ppu.regs.lcdc))
+    {
+        return;
+    }
+
+    if (ppu.render == PPU_RENDER_FULL)
+    {
+        render_until(cycle);
+    }
+
+    pos = frame_pos(cycle);
+    ppu.regs.ly = pos / LINE_CYCLES;
+    ppu.regs.stat = (ppu.regs.stat & ~3) | pos_mode(pos);
+    if (ppu.regs.ly == ppu.regs.lyc)
+        ppu.regs.stat |= STAT_LYC_EQUAL;
+    else
+        ppu.regs.stat &= ~STAT_LYC_EQUAL;
+}
+
+void ppu_sync()
+{
+    sync(cpu.cycle_count);
+}
+
+// Wake up at the next VBlank or at the next point an enabled STAT source may become active.
+static void schedule_next(uint64_t cycle)
+{
+    uint64_t next = next_pos_cycle(cycle, VBLANK_LINE * LINE_CYCLES), candidate;
+    uint8_t stat = ppu.regs.stat;
+
+    if (stat & STAT_HBLANK_IRQ)
+    {
+        candidate = next_line_dot_cycle(cycle, OAM_SCAN_CYCLES + TRANSFER_CYCLES);
+        next = candidate < next ? candidate : next;
+    }
+    if (stat & STAT_OAM_IRQ)
+    {
+        candidate = next_line_dot_cycle(cycle, 0);
+        next = candidate < next ? candidate : next;
+    }
+    if ((stat & STAT_LYC_IRQ) && ppu.regs.lyc < NUM_LINES)
+    {
+        candidate = next_pos_cycle(cycle, ppu.regs.lyc * LINE_CYCLES);
+        next = candidate < next ? candidate : next;
+    }
+    sched_set(SCHED_PPU, next);
+}
+
+// Re-evaluate the STAT interrupt line after a register write, requesting the interrupt on a
+// rising edge.
+static void update_stat_irq(uint64_t cycle)
+{
+    uint8_t line = LCDC_ENABLE(ppu.regs.lcdc) ? stat_line_at(cycle) : 0;
+
+    if (line && !ppu.stat_line)
+    {
+        cpu.if_flags.lcd_irq = 1;
+    }
+    ppu.stat_line = line;
+}
+
+static void ppu_event(uint64_t cycle)
+{
+    uint8_t line;
+
+    sync(cycle);
+
+    if (frame_pos(cycle) == VBLANK_LINE * LINE_CYCLES)
+    {
+        cpu.if_flags.vb_irq = 1;
+        ppu.frames++;
+        if (frame_callback != NULL)
+        {
+            frame_callback(&ppu.framebuffer[0][0]);
+        }
+    }
+
+    line = stat_line_at(cycle);
+    if (line && !stat_line_at(cycle - 1))
+    {
+        cpu.if_flags.lcd_irq = 1;
+    }
+    ppu.stat_line = line;
+
+    schedule_next(cycle);
+}
+
+static void lcd_on(uint64_t cycle)
+{
+    ppu.frame_start = cycle;
+    ppu.render_cycle = cycle + OAM_SCAN_CYCLES;
+    ppu.window_line = 0;
+    sync(cycle);
+    update_stat_irq(cycle);
+    schedule_next(cycle);
+}
+
+static void lcd_off()
+{
+    ppu.regs.ly = 0;
+    ppu.regs.stat &= ~3;
+    ppu.stat_line = 0;
+    sched_cancel(SCHED_PPU);
+}
+
+/* ----------- Bus handlers ----------- */
+
+int ppu_vram_write(uint8_t val, uint16_t addr)
+{
+    sync(cpu.cycle_count);
+    ppu.vram[addr] = val;
+    return 0;
+}
+
+int ppu_oam_write(uint8_t val, uint16_t addr)
+{
+    sync(cpu.cycle_count);
+    ppu.oam[addr] = val;
+    if ((addr & 3) == 0)
+    {
+        ppu.oam_y[addr / 4] = val;
+    }
+    else if ((addr & 3) == 1)
+    {
+        ppu.oam_x[addr / 4] = val;
+    }
+    return 0;
+}
+
+void ppu_set_frame_callback(ppu_frame_callback_t callback)
+{
+    frame_callback = callback;
+}
+
+void ppu_oam_dma(const uint8_t *src)
+{
+    sync(cpu.cycle_count);
+    memcpy(ppu.oam, src, OAM_SIZE);
+    bus_mark_dirty(OAM_ADDR, OAM_SIZE);
+    ppu_reload_oam();
+}
+
+void ppu_reload_oam()
+{
+    uint8_t i;
+
+    for (i = 0; i < NUM_SPRITES; i++)
+    {
+        ppu.oam_y[i] = ppu.oam[i * 4];
+        ppu.oam_x[i] = ppu.oam[i * 4 + 1];
+    }
+}
+
+int ppu_lcd_read(uint8_t *result, uint16_t addr)
+{
+    uint16_t abs_addr = LCDC_ADDR + addr;
+
+    sync(cpu.cycle_count);
+
+    switch (abs_addr)
+    {
+    case LCDC_ADDR:
+        *result = ppu.regs.lcdc;
+        break;
+    case STAT_ADDR:
+        *result = ppu.regs.stat | 0x80;
+        break;
+    case SCY_ADDR:
+        *result = ppu.regs.scy;
+        break;
+    case SCX_ADDR:
+        *result = ppu.regs.scx;
+        break;
+    case LY_ADDR:
+        *result = ppu.regs.ly;
+        break;
+    case LYC_ADDR:
+        *result = ppu.regs.lyc;
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+int ppu_lcd_write(uint8_t val, uint16_t addr)
+{
+    uint16_t abs_addr = LCDC_ADDR + addr;
+
+    sync(cpu.cycle_count);
+
+    switch (abs_addr)
+    {
+    case LCDC_ADDR:
+        if (LCDC_ENABLE(val) && !LCDC_ENABLE(ppu.regs.lcdc))
+        {
+            ppu.regs.lcdc = val;
+            lcd_on(cpu.cycle_count);
+        }
+        else if (!LCDC_ENABLE(val) && LCDC_ENABLE(ppu.regs.lcdc))
+        {
+            ppu.regs.lcdc = val;
+            lcd_off();
+        }
+        ppu.regs.lcdc = val;
+        break;
+    case STAT_ADDR:
+        ppu.regs.stat = (ppu.regs.stat & 0x07) | (val & 0x78);
+        if (LCDC_ENABLE(ppu.regs.lcdc))
+        {
+            update_stat_irq(cpu.cycle_count);
+            schedule_next(cpu.cycle_count);
+        }
+        break;
+    case SCY_ADDR:
+        ppu.regs.scy = val;
+        break;
+    case SCX_ADDR:
+        ppu.regs.scx = val;
+        break;
+    case LY_ADDR:
+        // Read only.
+        break;
+    case LYC_ADDR:
+        ppu.regs.lyc = val;
+        if (LCDC_ENABLE(ppu.regs.lcdc))
+        {
+            sync(cpu.cycle_count);
+            update_stat_irq(cpu.cycle_count);
+            schedule_next(cpu.cycle_count);
+        }
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+int ppu_pal_read(uint8_t *result, uint16_t addr)
+{
+    uint16_t abs_addr = BGP_ADDR + addr;
+
+    switch (abs_addr)
+    {
+    case BGP_ADDR:
+        *result = ppu.regs.bgp;
+        break;
+    case OBP0_ADDR:
+        *result = ppu.regs.obp0;
+        break;
+    case OBP1_ADDR:
+        *result = ppu.regs.obp1;
+        break;
+    case WY_ADDR:
+        *result = ppu.regs.wy;
+        break;
+    case WX_ADDR:
+        *result = ppu.regs.wx;
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+int ppu_pal_write(uint8_t val, uint16_t addr)
+{
+    uint16_t abs_addr = BGP_ADDR + addr;
+
+    sync(cpu.cycle_count);
+
+    switch (abs_addr)
+    {
+    case BGP_ADDR:
+        ppu.regs.bgp = val;
+        break;
+    case OBP0_ADDR:
+        ppu.regs.obp0 = val;
+        break;
+    case OBP1_ADDR:
+        ppu.regs.obp1 = val;
+        break;
+    case WY_ADDR:
+        ppu.regs.wy = val;
+        break;
+    case WX_ADDR:
+        ppu.regs.wx = val;
+        break;
+    default:
+        return -1;
+    }
+    return 0;
+}
+
+/* ----------- Init ----------- */
+
+int ppu_init(enum ppu_render render)
+{
+    memset(&ppu, 0, sizeof(ppu));
+    ppu.render = render;
+    ppu.regs.bgp = 0xFC;
+
+    if (sched_register(SCHED_PPU, ppu_event))
+    {
+        log(LERR "Failed to initialize PPU.");
+        return -1;
+    }
+
+    if (add_bus_memory(VRAM_ADDR, VRAM_SIZE, ppu.vram, ppu_vram_write))
+    {
+        goto error;
+    }
+    if (add_bus_memory(OAM_ADDR, OAM_SIZE, ppu.oam, ppu_oam_write))
+    {
+        goto error_vram;
+    }
+    if (add_bus_connection(LCDC_ADDR, LYC_ADDR - LCDC_ADDR + 1, ppu_lcd_read, ppu_lcd_write))
+    {
+        goto error_oam;
+    }
+    if (add_bus_connection(BGP_ADDR, WX_ADDR - BGP_ADDR + 1, ppu_pal_read, ppu_pal_write))
+    {
+        goto error_lcd;
+    }
+
+    // The boot ROM leaves the LCD on.
+    ppu.regs.lcdc = 0x91;
+    lcd_on(cpu.cycle_count);
+    return 0;
+
+error_lcd:
+    remove_bus_connection(LCDC_ADDR);
+error_oam:
+    remove_bus_connection(OAM_ADDR);
+error_vram:
+    remove_bus_connection(VRAM_ADDR);
+error:
+    log(LERR "Failed to initialize PPU.");
+    return -1;
+}
+
+int ppu_end()
+{
+    int ret = 0;
+
+    sched_cancel(SCHED_PPU);
+    frame_callback = NULL;
+    if (remove_bus_connection(VRAM_ADDR) || remove_bus_connection(OAM_ADDR) ||
+        remove_bus_connection(LCDC_ADDR) || remove_bus_connection(BGP_ADDR))
+    {
+        ret = -1;
+    }
+    return ret;
+}
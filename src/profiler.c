@@ -0,0 +1,421 @@
+#include "profiler.h"
+#include <stdlib.h>
+#include <string.h>
+#include "cart.h"
+#include "log.h"
+#include "scheduler.h"
+#include "cpu/cpu.h"
+
+#define ADDR_SPACE 0x10000
+#define BANK_ADDR  0x4000
+#define BANK_SIZE  0x4000
+#define MAX_BANKS  (CART_MAX_ROM_SIZE / CART_ROM_BANK_SIZE)
+
+struct symbol
+{
+    uint16_t bank;
+    uint16_t addr;
+    uint32_t parent; // Function of a local label, itself otherwise.
+    uint64_t hits;
+    char name[PROFILER_MAX_NAME];
+};
+
+// Hits of one bank:address pair, when it has no symbol.
+struct location
+{
+    uint16_t bank;
+    uint16_t addr;
+    uint64_t hits;
+};
+
+struct profiler_struct
+{
+    uint32_t interval;
+    uint64_t samples;
+    uint32_t *hits; // Per address outside of the switchable ROM area.
+    uint32_t *bank_hits[MAX_BANKS]; // Per address of each ROM bank, allocated when first sampled.
+    struct symbol *symbols; // Sorted by bank, then address.
+    uint32_t num_symbols;
+};
+
+static struct profiler_struct profiler;
+
+// Symbols only cover addresses up to the end of the memory area they are in.
+static inline uint8_t area(uint16_t addr)
+{
+    if (addr < 0x4000)
+        return 0;
+    if (addr < 0x8000)
+        return 1;
+    if (addr < 0xA000)
+        return 2;
+    if (addr < 0xC000)
+        return 3;
+    if (addr < 0xFE00)
+        return 4;
+    if (addr < 0xFF80)
+        return 5;
+    return 6;
+}
+
+static void sample_event(uint64_t cycle)
+{
+    uint16_t pc = cpu.regs.pc;
+    uint32_t bank;
+
+    if (pc >= BANK_ADDR && pc < BANK_ADDR + BANK_SIZE)
+    {
+        bank = cart_rom_bank() % MAX_BANKS;
+        if (profiler.bank_hits[bank] == NULL)
+            profiler.bank_hits[bank] = (uint32_t*)calloc(BANK_SIZE, sizeof(uint32_t));
+        if (profiler.bank_hits[bank] != NULL)
+            profiler.bank_hits[bank][pc - BANK_ADDR]++;
+    }
+    else
+    {
+        profiler.hits[pc]++;
+    }
+
+    profiler.samples++;
+    sched_set(SCHED_PROFILER, cycle + profiler.interval);
+}
+
+static void free_hits()
+{
+    uint32_t bank;
+
+    free(profiler.hits);
+    profiler.hits = NULL;
+    for (bank = 0; bank < MAX_BANKS; bank++)
+    {
+        free(profiler.bank_hits[bank]);
+        profiler.bank_hits[bank] = NULL;
+    }
+    profiler.samples = 0;
+}
+
+int profiler_start(uint32_t interval)
+{
+    if (interval == 0)
+    {
+        log(LERR "Profiler interval has to be at least one cycle.");
+        return -1;
+    }
+
+    free_hits();
+    profiler.hits = (uint32_t*)calloc(ADDR_SPACE, sizeof(uint32_t));
+    if (profiler.hits == NULL || sched_register(SCHED_PROFILER, sample_event))
+    {
+        free_hits();
+        log(LERR "Failed to start the profiler.");
+        return -1;
+    }
+
+    profiler.interval = interval;
+    sched_set(SCHED_PROFILER, cpu.cycle_count + interval);
+    return 0;
+}
+
+void profiler_stop()
+{
+    sched_cancel(SCHED_PROFILER);
+}
+
+void profiler_end()
+{
+    profiler_stop();
+    free_hits();
+    free(profiler.symbols);
+    profiler.symbols = NULL;
+    profiler.num_symbols = 0;
+}
+
+/* ----------- Symbols ----------- */
+
+static int compare_symbols(const void *a, const void *b)
+{
+    const struct symbol *sa = (const struct symbol*)a, *sb = (const struct symbol*)b;
+
+    if (sa->bank != sb->bank)
+        return sa->bank < sb->bank ? -1 : 1;
+    if (sa->addr != sb->addr)
+        return sa->addr < sb->addr ? -1 : 1;
+    return strcmp(sa->name, sb->name);
+}
+
+static void link_parents()
+{
+    uint32_t i, parent = 0;
+
+    for (i = 0; i < profiler.num_symbols; i++)
+    {
+        // Local labels follow their function within its section.
+        if (strchr(profiler.symbols[i].name, '.') == NULL || i == 0 ||
+            profiler.symbols[parent].bank != profiler.symbols[i].bank)
+        {
+            parent = i;
+        }
+        profiler.symbols[i].parent = parent;
+    }
+}
+
+int profiler_load_symbols(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[PROFILER_MAX_NAME + 32];
+    struct symbol sym, *grown;
+    uint32_t capacity = 0;
+    unsigned int bank, addr;
+
+    if (file == NULL)
+    {
+        log(LERR "Failed to open %s", path);
+        return -1;
+    }
+
+    free(profiler.symbols);
+    profiler.symbols = NULL;
+    profiler.num_symbols = 0;
+
+    memset(&sym, 0, sizeof(sym));
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        // Comments and anything that is not a label are skipped.
+        if (sscanf(line, "%x:%x %127s", &bank, &addr, sym.name) != 3 || addr >= ADDR_SPACE)
+            continue;
+
+        if (profiler.num_symbols == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 256;
+            grown = (struct symbol*)realloc(profiler.symbols, capacity * sizeof(struct symbol));
+            if (grown == NULL)
+            {
+                fclose(file);
+                log(LERR "Failed to load symbols from %s", path);
+                return -1;
+            }
+            profiler.symbols = grown;
+        }
+
+        sym.bank = (uint16_t)bank;
+        sym.addr = (uint16_t)addr;
+        profiler.symbols[profiler.num_symbols++] = sym;
+    }
+    fclose(file);
+
+    qsort(profiler.symbols, profiler.num_symbols, sizeof(struct symbol), compare_symbols);
+    link_parents();
+    return 0;
+}
+
+// Symbol covering bank:addr, -1 for none.
+static int64_t find_symbol(uint16_t bank, uint16_t addr)
+{
+    uint32_t lo = 0, hi = profiler.num_symbols, mid;
+    struct symbol *sym;
+
+    // First symbol after bank:addr.
+    while (lo < hi)
+    {
+        mid = lo + (hi - lo) / 2;
+        sym = &profiler.symbols[mid];
+        if (sym->bank < bank || (sym->bank == bank && sym->addr <= addr))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+
+    if (lo == 0)
+        return -1;
+    sym = &profiler.symbols[lo - 1];
+    if (sym->bank != bank || area(sym->addr) != area(addr))
+        return -1;
+    return lo - 1;
+}
+
+void profiler_symbol_name(uint16_t bank, uint16_t addr, char *name, uint32_t size)
+{
+    int64_t sym = find_symbol(bank, addr);
+
+    if (sym < 0)
+        snprintf(name, size, "%02X:%04X", bank, addr);
+    else if (profiler.symbols[sym].addr == addr)
+        snprintf(name, size, "%s", profiler.symbols[sym].name);
+    else
+        snprintf(name, size, "%s+0x%X", profiler.symbols[sym].name, addr - profiler.symbols[sym].addr);
+}
+
+/* ----------- Reports ----------- */
+
+// Attribute hits to the symbol of bank:addr, or append them to locations.
+static int add_hits(uint16_t bank, uint16_t addr, uint64_t hits, struct location **locations,
+                    uint32_t *num_locations, uint32_t *capacity)
+{
+    struct location *grown;
+    int64_t sym = find_symbol(bank, addr);
+
+    if (sym >= 0)
+    {
+        profiler.symbols[sym].hits += hits;
+        return 0;
+    }
+
+    if (*num_locations == *capacity)
+    {
+        *capacity = *capacity ? *capacity * 2 : 256;
+        grown = (struct location*)realloc(*locations, *capacity * sizeof(struct location));
+        if (grown == NULL)
+            return -1;
+        *locations = grown;
+    }
+    (*locations)[(*num_locations)++] = (struct location){bank, addr, hits};
+    return 0;
+}
+
+// Attribute every sampled address to its symbol. Addresses without one are returned in a list,
+// ordered by bank and address.
+static struct location *resolve(uint32_t *num_locations)
+{
+    struct location *locations = NULL;
+    uint32_t capacity = 0, bank, addr;
+    int ret = 0;
+
+    *num_locations = 0;
+    for (addr = 0; addr < profiler.num_symbols; addr++)
+    {
+        profiler.symbols[addr].hits = 0;
+    }
+
+    for (addr = 0; profiler.hits != NULL && addr < ADDR_SPACE && ret == 0; addr++)
+    {
+        if (profiler.hits[addr])
+            ret = add_hits(0, addr, profiler.hits[addr], &locations, num_locations, &capacity);
+    }
+    for (bank = 0; bank < MAX_BANKS && ret == 0; bank++)
+    {
+        for (addr = 0; profiler.bank_hits[bank] != NULL && addr < BANK_SIZE && ret == 0; addr++)
+        {
+            if (profiler.bank_hits[bank][addr])
+                ret = add_hits(bank, BANK_ADDR + addr, profiler.bank_hits[bank][addr], &locations,
+                               num_locations, &capacity);
+        }
+    }
+    return locations;
+}
+
+struct report_entry
+{
+    uint64_t hits;
+    uint16_t bank;
+    uint16_t addr;
+    const char *name; // NULL for an address without a symbol.
+};
+
+static int compare_entries(const void *a, const void *b)
+{
+    const struct report_entry *ea = (const struct report_entry*)a, *eb = (const struct report_entry*)b;
+
+    if (ea->hits != eb->hits)
+        return ea->hits > eb->hits ? -1 : 1;
+    if (ea->bank != eb->bank)
+        return ea->bank < eb->bank ? -1 : 1;
+    return ea->addr < eb->addr ? -1 : ea->addr > eb->addr;
+}
+
+int profiler_report(FILE *file, uint32_t num)
+{
+    struct location *locations;
+    struct report_entry *entries;
+    uint64_t *function_hits;
+    uint32_t num_locations, num_entries = 0, i;
+
+    locations = resolve(&num_locations);
+    entries = (struct report_entry*)malloc((profiler.num_symbols + num_locations + 1) * sizeof(struct report_entry));
+    function_hits = (uint64_t*)calloc(profiler.num_symbols + 1, sizeof(uint64_t));
+    if (entries == NULL || function_hits == NULL)
+    {
+        free(locations);
+        free(entries);
+        free(function_hits);
+        return -1;
+    }
+
+    for (i = 0; i < profiler.num_symbols; i++)
+    {
+        function_hits[profiler.symbols[i].parent] += profiler.symbols[i].hits;
+    }
+    for (i = 0; i < profiler.num_symbols; i++)
+    {
+        if (function_hits[i])
+        {
+            entries[num_entries++] = (struct report_entry){function_hits[i], profiler.symbols[i].bank,
+                                                           profiler.symbols[i].addr, profiler.symbols[i].name};
+        }
+    }
+    for (i = 0; i < num_locations; i++)
+    {
+        entries[num_entries++] = (struct report_entry){locations[i].hits, locations[i].bank, locations[i].addr, NULL};
+    }
+    qsort(entries, num_entries, sizeof(struct report_entry), compare_entries);
+
+    fprintf(file, "%" PRIu64 " samples every %" PRIu32 " cycles\n", profiler.samples, profiler.interval);
+    for (i = 0; i < num_entries && i < num; i++)
+    {
+        fprintf(file, "%6.2f%% %10" PRIu64 "  %02X:%04X%s%s\n", entries[i].hits * 100.0 / profiler.samples,
+                entries[i].hits, entries[i].bank, entries[i].addr, entries[i].name ? "  " : "",
+                entries[i].name ? entries[i].name : "");
+    }
+
+    free(locations);
+    free(entries);
+    free(function_hits);
+    return ferror(file) ? -1 : 0;
+}
+
+int profiler_write_folded(FILE *file)
+{
+    struct location *locations;
+    struct symbol *sym;
+    uint32_t num_locations, i;
+
+    locations = resolve(&num_locations);
+
+    for (i = 0; i < profiler.num_symbols; i++)
+    {
+        sym = &profiler.symbols[i];
+        if (sym->hits == 0)
+            continue;
+
+        if (sym->parent != i)
+            fprintf(file, "%s;%s %" PRIu64 "\n", profiler.symbols[sym->parent].name, sym->name, sym->hits);
+        else
+            fprintf(file, "%s %" PRIu64 "\n", sym->name, sym->hits);
+    }
+    for (i = 0; i < num_locations; i++)
+    {
+        fprintf(file, "%02X:%04X %" PRIu64 "\n", locations[i].bank, locations[i].addr, locations[i].hits);
+    }
+
+    free(locations);
+    return ferror(file) ? -1 : 0;
+}
+
+void profiler_get_stats(struct profiler_stats *stats)
+{
+    uint32_t bank, addr;
+
+    stats->samples = profiler.samples;
+    stats->symbols = profiler.num_symbols;
+    stats->addresses = 0;
+    for (addr = 0; profiler.hits != NULL && addr < ADDR_SPACE; addr++)
+    {
+        stats->addresses += profiler.hits[addr] != 0;
+    }
+    for (bank = 0; bank < MAX_BANKS; bank++)
+    {
+        for (addr = 0; profiler.bank_hits[bank] != NULL && addr < BANK_SIZE; addr++)
+        {
+            stats->addresses += profiler.bank_hits[bank][addr] != 0;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#include "ram.h"
+#include <string.h>
+#include "bus.h"
+#include "log.h"
+
+struct ram_struct ram;
+
+int ram_echo_read(uint8_t *result, uint16_t addr)
+{
+    *result = ram.wram[addr];
+    return 0;
+}
+
+int ram_echo_write(uint8_t val, uint16_t addr)
+{
+    ram.wram[addr] = val;
+    bus_mark_dirty(WRAM_ADDR + addr, 1);
+    return 0;
+}
+
+int ram_init()
+{
+    memset(&ram, 0, sizeof(ram));
+
+    if (add_bus_memory(WRAM_ADDR, WRAM_SIZE, ram.wram, NULL))
+    {
+        goto error;
+    }
+    if (add_bus_connection(ECHO_ADDR, ECHO_SIZE, ram_echo_read, ram_echo_write))
+    {
+        goto error_wram;
+    }
+    if (add_bus_memory(HRAM_ADDR, HRAM_SIZE, ram.hram, NULL))
+    {
+        goto error_echo;
+    }
+    return 0;
+
+error_echo:
+    remove_bus_connection(ECHO_ADDR);
+error_wram:
+    remove_bus_connection(WRAM_ADDR);
+error:
+    log(LERR "Failed to initialize RAM.");
+    return -1;
+}
+
+int ram_end()
+{
+    int ret = 0;
+
+    if (remove_bus_connection(HRAM_ADDR))
+        ret = -1;
+    if (remove_bus_connection(ECHO_ADDR))
+        ret = -1;
+    if (remove_bus_connection(WRAM_ADDR))
+        ret = -1;
+    return ret;
+}
@@ -0,0 +1,319 @@
+#include "recorder.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "apu.h"
+#include "hosttime.h"
+#include "log.h"
+#include "ppu.h"
+#include "ring.h"
+#include "scheduler.h"
+#include "cpu/cpu.h"
+
+#define WAV_HEADER_SIZE 44
+#define WRITER_IDLE_NS 1000000 // Writer sleep when both queues are empty.
+
+struct audio_block
+{
+    uint32_t frames;
+    int16_t samples[RECORDER_AUDIO_FRAMES * 2];
+};
+
+struct recorder_struct
+{
+    FILE *video;
+    FILE *audio;
+    struct ring video_ring;
+    struct ring audio_ring;
+    pthread_t writer;
+    uint8_t started; // Set once the writer thread runs.
+    _Atomic uint8_t stop;
+    uint8_t write_error; // Set by the writer thread, read once it is joined.
+    uint64_t audio_interval; // Cycles between pulls from the APU, half a block's worth of frames.
+    struct recorder_stats stats; // Written counts by the writer thread, the rest by the emulation thread.
+};
+
+static struct recorder_struct recorder;
+
+// Luma of the four DMG shades.
+static const uint8_t shade_luma[4] = {255, 170, 85, 0};
+
+static void put_le16(uint8_t *dst, uint16_t val)
+{
+    dst[0] = (uint8_t)val;
+    dst[1] = (uint8_t)(val >> 8);
+}
+
+static void put_le32(uint8_t *dst, uint32_t val)
+{
+    put_le16(dst, (uint16_t)val);
+    put_le16(dst + 2, (uint16_t)(val >> 16));
+}
+
+static int write_wav_header(FILE *file, uint32_t sample_rate, uint32_t data_size)
+{
+    uint8_t header[WAV_HEADER_SIZE];
+
+    memcpy(header, "RIFF", 4);
+    put_le32(header + 4, WAV_HEADER_SIZE - 8 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put_le32(header + 16, 16); // fmt chunk size
+    put_le16(header + 20, 1); // PCM
+    put_le16(header + 22, 2); // Channels
+    put_le32(header + 24, sample_rate);
+    put_le32(header + 28, sample_rate * 4); // Byte rate
+    put_le16(header + 32, 4); // Block align
+    put_le16(header + 34, 16); // Bits per sample
+    memcpy(header + 36, "data", 4);
+    put_le32(header + 40, data_size);
+
+    if (fseek(file, 0, SEEK_SET) || fwrite(header, 1, sizeof(header), file) != sizeof(header))
+    {
+        return -1;
+    }
+    return fseek(file, 0, SEEK_END);
+}
+
+/* ----------- Writer thread ----------- */
+
+// Write out everything queued, returns the number of blocks consumed. Blocks are still consumed
+// after a failed write so the emulation thread never stalls, only the counts stop.
+static uint32_t drain()
+{
+    uint32_t written = 0;
+    uint8_t *frame;
+    struct audio_block *block;
+
+    while ((frame = (uint8_t*)ring_consume(&recorder.video_ring)) != NULL)
+    {
+        if (fputs("FRAME\n", recorder.video) == EOF ||
+            fwrite(frame, 1, LCD_WIDTH * LCD_HEIGHT, recorder.video) != LCD_WIDTH * LCD_HEIGHT)
+        {
+            recorder.write_error = 1;
+        }
+        else
+        {
+            recorder.stats.frames++;
+        }
+        ring_release(&recorder.video_ring);
+        written++;
+    }
+
+    while ((block = (struct audio_block*)ring_consume(&recorder.audio_ring)) != NULL)
+    {
+        // Samples are stored little endian, as is every host this builds on.
+        if (fwrite(block->samples, 4, block->frames, recorder.audio) != block->frames)
+        {
+            recorder.write_error = 1;
+        }
+        else
+        {
+            recorder.stats.audio_frames += block->frames;
+        }
+        ring_release(&recorder.audio_ring);
+        written++;
+    }
+
+    return written;
+}
+
+static void *writer_thread(void *arg)
+{
+    struct timespec idle = {0, WRITER_IDLE_NS};
+    uint8_t stop;
+
+    while (1)
+    {
+        // Read stop before draining so nothing queued ahead of it is left behind.
+        stop = atomic_load_explicit(&recorder.stop, memory_order_acquire);
+        if (drain() == 0)
+        {
+            if (stop)
+            {
+                break;
+            }
+            nanosleep(&idle, NULL);
+        }
+    }
+    return NULL;
+}
+
+/* ----------- Emulation thread ----------- */
+
+// Move one block of samples out of the APU, returns the number of frames taken. With wait set,
+// sleep until the writer frees a slot instead of dropping the samples.
+static uint32_t queue_audio(uint8_t wait)
+{
+    struct timespec idle = {0, WRITER_IDLE_NS};
+    struct audio_block *block;
+    uint32_t frames;
+
+    while ((block = (struct audio_block*)ring_produce(&recorder.audio_ring)) == NULL)
+    {
+        if (!wait)
+        {
+            // Keep the APU buffer from filling up, the samples are lost either way.
+            frames = apu_read_samples(NULL, RECORDER_AUDIO_FRAMES);
+            recorder.stats.dropped_audio_frames += frames;
+            return frames;
+        }
+        nanosleep(&idle, NULL);
+    }
+
+    frames = apu_read_samples(block->samples, RECORDER_AUDIO_FRAMES);
+    block->frames = frames;
+    ring_commit(&recorder.audio_ring);
+    return frames;
+}
+
+// Pulled on the cycle count rather than on VBlank, which stops while the LCD is off and would
+// leave the APU to overflow its buffer.
+static void audio_event(uint64_t cycle)
+{
+    uint64_t start = host_ns();
+
+    while (queue_audio(0) == RECORDER_AUDIO_FRAMES);
+    sched_set(SCHED_RECORDER, cycle + recorder.audio_interval);
+
+    recorder.stats.queue_ns += host_ns() - start;
+}
+
+static void recorder_frame(const uint8_t *framebuffer)
+{
+    uint64_t start = host_ns();
+    uint8_t *frame;
+    uint32_t i;
+
+    frame = (uint8_t*)ring_produce(&recorder.video_ring);
+    if (frame == NULL)
+    {
+        recorder.stats.dropped_frames++;
+    }
+    else
+    {
+        for (i = 0; i < LCD_WIDTH * LCD_HEIGHT; i++)
+        {
+            frame[i] = shade_luma[framebuffer[i]];
+        }
+        ring_commit(&recorder.video_ring);
+    }
+
+    recorder.stats.queue_ns += host_ns() - start;
+}
+
+/* ----------- Init ----------- */
+
+int recorder_start(const char *video_path, const char *audio_path)
+{
+    memset(&recorder, 0, sizeof(recorder));
+    atomic_init(&recorder.stop, 0);
+
+    if (ring_init(&recorder.video_ring, RECORDER_VIDEO_SLOTS, LCD_WIDTH * LCD_HEIGHT))
+    {
+        goto error;
+    }
+    if (ring_init(&recorder.audio_ring, RECORDER_AUDIO_SLOTS, sizeof(struct audio_block)))
+    {
+        goto error_video_ring;
+    }
+
+    if (video_path != NULL)
+    {
+        recorder.video = fopen(video_path, "wb");
+        if (recorder.video == NULL)
+        {
+            goto error_audio_ring;
+        }
+        fprintf(recorder.video, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 Cmono\n", LCD_WIDTH, LCD_HEIGHT, CPU_FREQ, FRAME_CYCLES);
+    }
+
+    if (audio_path != NULL)
+    {
+        recorder.audio = fopen(audio_path, "wb");
+        if (recorder.audio == NULL || write_wav_header(recorder.audio, apu.sample_rate, 0) ||
+            sched_register(SCHED_RECORDER, audio_event))
+        {
+            goto error_files;
+        }
+        recorder.audio_interval = (uint64_t)CPU_FREQ * (RECORDER_AUDIO_FRAMES / 2) / apu.sample_rate;
+    }
+
+    if (pthread_create(&recorder.writer, NULL, writer_thread, NULL))
+    {
+        goto error_files;
+    }
+
+    if (recorder.video != NULL)
+    {
+        ppu_set_frame_callback(recorder_frame);
+    }
+    if (recorder.audio != NULL)
+    {
+        sched_set(SCHED_RECORDER, cpu.cycle_count + recorder.audio_interval);
+    }
+    recorder.started = 1;
+    return 0;
+
+error_files:
+    if (recorder.audio != NULL)
+        fclose(recorder.audio);
+    if (recorder.video != NULL)
+        fclose(recorder.video);
+    recorder.audio = NULL;
+    recorder.video = NULL;
+error_audio_ring:
+    ring_free(&recorder.audio_ring);
+error_video_ring:
+    ring_free(&recorder.video_ring);
+error:
+    log(LERR "Failed to start recording.");
+    return -1;
+}
+
+int recorder_stop(struct recorder_stats *stats)
+{
+    int ret = 0;
+
+    if (!recorder.started)
+    {
+        return -1;
+    }
+
+    ppu_set_frame_callback(NULL);
+    if (recorder.audio != NULL)
+    {
+        // Flush what the APU synthesized since the last pull.
+        sched_cancel(SCHED_RECORDER);
+        while (queue_audio(1) == RECORDER_AUDIO_FRAMES);
+    }
+    atomic_store_explicit(&recorder.stop, 1, memory_order_release);
+    pthread_join(recorder.writer, NULL);
+
+    if (recorder.video != NULL && fclose(recorder.video))
+    {
+        ret = -1;
+    }
+    if (recorder.audio != NULL)
+    {
+        if (write_wav_header(recorder.audio, apu.sample_rate, recorder.stats.audio_frames * 4) || fclose(recorder.audio))
+        {
+            ret = -1;
+        }
+    }
+
+    ring_free(&recorder.audio_ring);
+    ring_free(&recorder.video_ring);
+    recorder.started = 0;
+
+    if (recorder.write_error)
+    {
+        log(LERR "Failed to write the recording, the output is truncated.");
+        ret = -1;
+    }
+    if (stats != NULL)
+    {
+        *stats = recorder.stats;
+    }
+    return ret;
+}
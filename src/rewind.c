@@ -0,0 +1,342 @@
+#include "rewind.h"
+#include <stdlib.h>
+#include <string.h>
+#include "hosttime.h"
+#include "log.h"
+#include "savestate.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define TOKEN_LITERAL 0x8000
+#define TOKEN_MAX_BLOCKS 0x7FFF
+
+struct rewind_entry
+{
+    uint32_t offset; // Position in the store.
+    uint32_t size;
+    uint8_t keyframe;
+};
+
+struct rewind_struct
+{
+    uint8_t *store; // Encoded snapshots, oldest to newest, wrapping around.
+    uint32_t budget;
+    uint32_t write_pos; // End of the newest snapshot.
+    struct rewind_entry *entries; // Oldest first, starting at first and wrapping around.
+    uint32_t first;
+    uint32_t count;
+    uint32_t keyframe_interval;
+    uint32_t since_keyframe; // Snapshots taken since the last keyframe, the keyframe included.
+    uint32_t state_size;
+    uint32_t blocks; // State size in blocks, rounded up.
+    uint8_t *state; // Snapshot being taken or restored, zero padded to whole blocks.
+    uint8_t *keyframe; // Last keyframe, decoded.
+    uint8_t *zeroes; // Reference for keyframes.
+    uint8_t *scratch; // Encoder output.
+    struct rewind_stats stats;
+};
+
+static struct rewind_struct rewind_buffer;
+
+/* ----------- Block coding ----------- */
+
+// Store the XOR of one block of cur and ref at dst, returns whether it has any bit set.
+static inline int xor_block(uint8_t *dst, const uint8_t *cur, const uint8_t *ref)
+{
+#ifdef __SSE2__
+    __m128i diff = _mm_xor_si128(_mm_loadu_si128((const __m128i*)cur), _mm_loadu_si128((const __m128i*)ref));
+
+    _mm_storeu_si128((__m128i*)dst, diff);
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(diff, _mm_setzero_si128())) != 0xFFFF;
+#else
+    uint64_t a[2], b[2];
+
+    memcpy(a, cur, sizeof(a));
+    memcpy(b, ref, sizeof(b));
+    a[0] ^= b[0];
+    a[1] ^= b[1];
+    memcpy(dst, a, sizeof(a));
+    return (a[0] | a[1]) != 0;
+#endif
+}
+
+// XOR one block of src into dst.
+static inline void apply_block(uint8_t *dst, const uint8_t *src)
+{
+#ifdef __SSE2__
+    _mm_storeu_si128((__m128i*)dst, _mm_xor_si128(_mm_loadu_si128((const __m128i*)dst), _mm_loadu_si128((const __m128i*)src)));
+#else
+    uint8_t i;
+
+    for (i = 0; i < REWIND_BLOCK_SIZE; i++)
+    {
+        dst[i] ^= src[i];
+    }
+#endif
+}
+
+static inline void put_token(uint8_t *dst, uint16_t token)
+{
+    dst[0] = (uint8_t)token;
+    dst[1] = (uint8_t)(token >> 8);
+}
+
+// Encode cur against ref into out, which must hold blocks * (REWIND_BLOCK_SIZE + 2) + 4 +
+// REWIND_BLOCK_SIZE bytes. Every block is XORed straight to where it goes if it turns out to
+// differ, so changed blocks are only touched once.
+static uint32_t encode(uint8_t *out, const uint8_t *cur, const uint8_t *ref, uint32_t blocks)
+{
+    uint32_t pos = 0, run = 0, data_pos, block;
+    uint8_t literal = 0, changed;
+
+    for (block = 0; block < blocks; block++)
+    {
+        if (run == TOKEN_MAX_BLOCKS)
+        {
+            put_token(&out[pos], (literal ? TOKEN_LITERAL : 0) | run);
+            pos += 2 + (literal ? run * REWIND_BLOCK_SIZE : 0);
+            run = 0;
+        }
+
+        // Past the open literal run, or past the token of the open zero run and a new one.
+        data_pos = pos + 2 + (literal ? run * REWIND_BLOCK_SIZE : (run ? 2 : 0));
+        changed = xor_block(&out[data_pos], &cur[block * REWIND_BLOCK_SIZE], &ref[block * REWIND_BLOCK_SIZE]);
+
+        if (run && changed != literal)
+        {
+            put_token(&out[pos], (literal ? TOKEN_LITERAL : 0) | run);
+            pos += 2 + (literal ? run * REWIND_BLOCK_SIZE : 0);
+            run = 0;
+        }
+        literal = changed;
+        run++;
+    }
+
+    if (run)
+    {
+        put_token(&out[pos], (literal ? TOKEN_LITERAL : 0) | run);
+        pos += 2 + (literal ? run * REWIND_BLOCK_SIZE : 0);
+    }
+    return pos;
+}
+
+// XOR an encoded snapshot into dst.
+static void decode(uint8_t *dst, const uint8_t *in, uint32_t size)
+{
+    uint32_t pos = 0, block = 0, i;
+    uint16_t token;
+
+    while (pos < size)
+    {
+        token = in[pos] | in[pos + 1] << 8;
+        pos += 2;
+        if (token & TOKEN_LITERAL)
+        {
+            token &= TOKEN_MAX_BLOCKS;
+            for (i = 0; i < token; i++)
+            {
+                apply_block(&dst[(block + i) * REWIND_BLOCK_SIZE], &in[pos]);
+                pos += REWIND_BLOCK_SIZE;
+            }
+        }
+        block += token;
+    }
+}
+
+/* ----------- Snapshot store ----------- */
+
+static inline struct rewind_entry *entry(uint32_t index)
+{
+    return &rewind_buffer.entries[(rewind_buffer.first + index) % REWIND_MAX_SNAPSHOTS];
+}
+
+static void evict_oldest()
+{
+    struct rewind_entry *oldest = entry(0);
+
+    rewind_buffer.stats.bytes_used -= oldest->size;
+    rewind_buffer.stats.keyframes -= oldest->keyframe;
+    rewind_buffer.first = (rewind_buffer.first + 1) % REWIND_MAX_SNAPSHOTS;
+    rewind_buffer.count--;
+}
+
+static inline int overlaps(struct rewind_entry *e, uint32_t pos, uint32_t size)
+{
+    return e->offset < pos + size && pos < e->offset + e->size;
+}
+
+// Evict the oldest snapshots until size bytes fit, returns where they go.
+static uint32_t make_room(uint32_t size)
+{
+    uint32_t pos = rewind_buffer.write_pos;
+
+    if (rewind_buffer.count == REWIND_MAX_SNAPSHOTS)
+    {
+        evict_oldest();
+    }
+
+    if (pos + size > rewind_buffer.budget)
+    {
+        // Whatever sits past the write position is older than anything at the start.
+        while (rewind_buffer.count && entry(0)->offset >= rewind_buffer.write_pos)
+        {
+            evict_oldest();
+        }
+        pos = 0;
+    }
+
+    while (rewind_buffer.count && overlaps(entry(0), pos, size))
+    {
+        evict_oldest();
+    }
+
+    // Deltas are useless without their keyframe.
+    while (rewind_buffer.count && !entry(0)->keyframe)
+    {
+        evict_oldest();
+    }
+    return pos;
+}
+
+int rewind_push()
+{
+    uint64_t start = host_ns();
+    uint8_t keyframe;
+    uint32_t size, pos;
+    struct rewind_entry *e;
+
+    if (savestate_size() != rewind_buffer.state_size || savestate_save(rewind_buffer.state, rewind_buffer.state_size))
+    {
+        log(LERR "Failed to take rewind snapshot.");
+        return -1;
+    }
+
+    keyframe = rewind_buffer.stats.keyframes == 0 || rewind_buffer.since_keyframe >= rewind_buffer.keyframe_interval;
+    while (1)
+    {
+        size = encode(rewind_buffer.scratch, rewind_buffer.state, keyframe ? rewind_buffer.zeroes : rewind_buffer.keyframe, rewind_buffer.blocks);
+        if (size > rewind_buffer.budget)
+        {
+            log(LERR "Rewind snapshot of %" PRIu32 " bytes does not fit the budget.", size);
+            return -1;
+        }
+        pos = make_room(size);
+
+        // Making room took the keyframe this delta was made against.
+        if (keyframe || rewind_buffer.stats.keyframes)
+        {
+            break;
+        }
+        keyframe = 1;
+    }
+
+    memcpy(&rewind_buffer.store[pos], rewind_buffer.scratch, size);
+    e = entry(rewind_buffer.count++);
+    e->offset = pos;
+    e->size = size;
+    e->keyframe = keyframe;
+    rewind_buffer.write_pos = pos + size;
+
+    if (keyframe)
+    {
+        memcpy(rewind_buffer.keyframe, rewind_buffer.state, rewind_buffer.blocks * REWIND_BLOCK_SIZE);
+        rewind_buffer.since_keyframe = 0;
+    }
+    rewind_buffer.since_keyframe++;
+
+    rewind_buffer.stats.keyframes += keyframe;
+    rewind_buffer.stats.bytes_used += size;
+    rewind_buffer.stats.pushes++;
+    rewind_buffer.stats.pushed_bytes += size;
+    rewind_buffer.stats.push_ns += host_ns() - start;
+    return 0;
+}
+
+int rewind_step_back(uint32_t steps)
+{
+    uint32_t target, key, i;
+    struct rewind_entry *e;
+
+    if (steps >= rewind_buffer.count)
+    {
+        return -1;
+    }
+    target = rewind_buffer.count - 1 - steps;
+
+    // The oldest snapshot held is always a keyframe.
+    for (key = target; !entry(key)->keyframe; key--);
+
+    memset(rewind_buffer.keyframe, 0, rewind_buffer.blocks * REWIND_BLOCK_SIZE);
+    decode(rewind_buffer.keyframe, &rewind_buffer.store[entry(key)->offset], entry(key)->size);
+    memcpy(rewind_buffer.state, rewind_buffer.keyframe, rewind_buffer.blocks * REWIND_BLOCK_SIZE);
+    if (target != key)
+    {
+        decode(rewind_buffer.state, &rewind_buffer.store[entry(target)->offset], entry(target)->size);
+    }
+
+    if (savestate_load(rewind_buffer.state, rewind_buffer.state_size))
+    {
+        return -1;
+    }
+
+    // Drop everything newer than the snapshot just restored.
+    for (i = target + 1; i < rewind_buffer.count; i++)
+    {
+        e = entry(i);
+        rewind_buffer.stats.bytes_used -= e->size;
+        rewind_buffer.stats.keyframes -= e->keyframe;
+    }
+    rewind_buffer.count = target + 1;
+    e = entry(target);
+    rewind_buffer.write_pos = e->offset + e->size;
+    rewind_buffer.since_keyframe = target - key + 1;
+    return 0;
+}
+
+void rewind_get_stats(struct rewind_stats *stats)
+{
+    *stats = rewind_buffer.stats;
+    stats->snapshots = rewind_buffer.count;
+}
+
+/* ----------- Init ----------- */
+
+int rewind_init(uint32_t budget, uint32_t keyframe_interval)
+{
+    uint32_t padded;
+
+    memset(&rewind_buffer, 0, sizeof(rewind_buffer));
+    rewind_buffer.budget = budget;
+    rewind_buffer.keyframe_interval = keyframe_interval ? keyframe_interval : 1;
+    rewind_buffer.state_size = savestate_size();
+    rewind_buffer.blocks = (rewind_buffer.state_size + REWIND_BLOCK_SIZE - 1) / REWIND_BLOCK_SIZE;
+    padded = rewind_buffer.blocks * REWIND_BLOCK_SIZE;
+
+    rewind_buffer.store = (uint8_t*)malloc(budget);
+    rewind_buffer.entries = (struct rewind_entry*)malloc(REWIND_MAX_SNAPSHOTS * sizeof(struct rewind_entry));
+    rewind_buffer.state = (uint8_t*)calloc(padded, 1);
+    rewind_buffer.keyframe = (uint8_t*)calloc(padded, 1);
+    rewind_buffer.zeroes = (uint8_t*)calloc(padded, 1);
+    rewind_buffer.scratch = (uint8_t*)malloc(rewind_buffer.blocks * (REWIND_BLOCK_SIZE + 2) + 4 + REWIND_BLOCK_SIZE);
+
+    if (rewind_buffer.store == NULL || rewind_buffer.entries == NULL || rewind_buffer.state == NULL ||
+        rewind_buffer.keyframe == NULL || rewind_buffer.zeroes == NULL || rewind_buffer.scratch == NULL)
+    {
+        log(LERR "Failed to initialize rewind.");
+        rewind_end();
+        return -1;
+    }
+    return 0;
+}
+
+void rewind_end()
+{
+    free(rewind_buffer.store);
+    free(rewind_buffer.entries);
+    free(rewind_buffer.state);
+    free(rewind_buffer.keyframe);
+    free(rewind_buffer.zeroes);
+    free(rewind_buffer.scratch);
+    memset(&rewind_buffer, 0, sizeof(rewind_buffer));
+}
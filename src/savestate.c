@@ -0,0 +1,325 @@
+#include "savestate.h"
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "apu.h"
+#include "bus.h"
+#include "cart.h"
+#include "dma.h"
+#include "joypad.h"
+#include "log.h"
+#include "ppu.h"
+#include "scheduler.h"
+#include "serial.h"
+#include "cpu/cpu.h"
+
+#define NUM_DEVICE_SECTIONS 9
+
+enum transfer_mode
+{
+    TRANSFER_SIZE, // Only count the bytes.
+    TRANSFER_SAVE,
+    TRANSFER_CHECK, // Check the layout against the machine without touching it.
+    TRANSFER_LOAD
+};
+
+struct transfer
+{
+    enum transfer_mode mode;
+    uint8_t *buffer;
+    uint32_t size;
+    uint32_t pos;
+    int error;
+};
+
+struct section
+{
+    const char *tag;
+    void *data;
+    uint32_t size;
+};
+
+// Events of emulated devices. Joypad and movie deadlines belong to the host's input and are left
+// as they are.
+static const enum sched_event saved_events[] = {SCHED_PPU, SCHED_DMA, SCHED_SERIAL};
+#define NUM_SAVED_EVENTS (sizeof(saved_events) / sizeof(saved_events[0]))
+
+static uint64_t sched_state[NUM_SAVED_EVENTS];
+
+// Host state (the framebuffer, sample buffers, the output setup, the input queue and the captured
+// serial output) is left out, and so are VRAM, OAM and wave RAM, which are saved with the rest of
+// the bus memory.
+static const struct section device_sections[NUM_DEVICE_SECTIONS] = {
+    {"CPU ", &cpu, sizeof(cpu)},
+    {"SCHD", sched_state, sizeof(sched_state)},
+    {"PPU ", &ppu, offsetof(struct ppu_struct, vram)},
+    {"APUR", apu.regs, sizeof(apu.regs)},
+    {"APU ", apu.channels, offsetof(struct apu_struct, output) - offsetof(struct apu_struct, channels)},
+    {"DMA ", &dma, sizeof(dma)},
+    {"JOYP", &joypad, offsetof(struct joypad_struct, queue)},
+    {"CART", &cart.regs, sizeof(cart.regs)},
+    {"SERL", &serial, offsetof(struct serial_struct, output)}
+};
+
+static void put_le32(uint8_t *dst, uint32_t val)
+{
+    dst[0] = (uint8_t)val;
+    dst[1] = (uint8_t)(val >> 8);
+    dst[2] = (uint8_t)(val >> 16);
+    dst[3] = (uint8_t)(val >> 24);
+}
+
+static uint32_t get_le32(const uint8_t *src)
+{
+    return src[0] | src[1] << 8 | src[2] << 16 | (uint32_t)src[3] << 24;
+}
+
+// Save, check or load one section. Memory sections start their payload with the region address.
+static void transfer_section(struct transfer *t, const char *tag, uint8_t *data, uint32_t size, uint16_t address, uint8_t has_address)
+{
+    uint32_t payload_size = size + (has_address ? 2 : 0);
+    uint8_t *pos;
+
+    if (t->error)
+    {
+        return;
+    }
+    if (t->mode == TRANSFER_SIZE)
+    {
+        t->pos += SAVESTATE_SECTION_HEADER_SIZE + payload_size;
+        return;
+    }
+    if (t->size - t->pos < SAVESTATE_SECTION_HEADER_SIZE + payload_size)
+    {
+        t->error = 1;
+        return;
+    }
+
+    pos = t->buffer + t->pos;
+    switch (t->mode)
+    {
+    case TRANSFER_SAVE:
+        memcpy(pos, tag, 4);
+        put_le32(pos + 4, payload_size);
+        if (has_address)
+        {
+            pos[8] = (uint8_t)address;
+            pos[9] = (uint8_t)(address >> 8);
+        }
+        memcpy(pos + SAVESTATE_SECTION_HEADER_SIZE + payload_size - size, data, size);
+        break;
+    case TRANSFER_CHECK:
+        if (memcmp(pos, tag, 4) || get_le32(pos + 4) != payload_size ||
+            (has_address && (pos[8] | pos[9] << 8) != address))
+        {
+            log(LERR "Save state section %.4s does not match this machine.", pos);
+            t->error = 1;
+        }
+        break;
+    case TRANSFER_LOAD:
+        memcpy(data, pos + SAVESTATE_SECTION_HEADER_SIZE + payload_size - size, size);
+        break;
+    default:
+        break;
+    }
+    t->pos += SAVESTATE_SECTION_HEADER_SIZE + payload_size;
+}
+
+static void transfer_region(uint16_t start_address, uint16_t size, uint8_t *mem, uint8_t read_only, void *arg)
+{
+    if (!read_only)
+    {
+        transfer_section((struct transfer*)arg, "MEM ", mem, size, start_address, 1);
+    }
+}
+
+static void transfer_all(struct transfer *t)
+{
+    uint8_t i;
+
+    for (i = 0; i < NUM_DEVICE_SECTIONS; i++)
+    {
+        transfer_section(t, device_sections[i].tag, (uint8_t*)device_sections[i].data, device_sections[i].size, 0, 0);
+    }
+    bus_for_each_memory(transfer_region, t);
+}
+
+static void save_events()
+{
+    uint8_t i;
+
+    for (i = 0; i < NUM_SAVED_EVENTS; i++)
+    {
+        sched_state[i] = sched_get(saved_events[i]);
+    }
+}
+
+// Bring everything derived from the restored state back in line with it.
+static void restore_derived(enum ppu_render render)
+{
+    uint8_t i;
+
+    // The render mode is a host setting, not part of the state.
+    ppu.render = render;
+    ppu_reload_oam();
+    bus_lock(dma.active ? DMA_LOCK_LIMIT : 0);
+    for (i = 0; i < NUM_SAVED_EVENTS; i++)
+    {
+        sched_set(saved_events[i], sched_state[i]);
+    }
+}
+
+uint32_t savestate_size()
+{
+    struct transfer t = {TRANSFER_SIZE, NULL, 0, SAVESTATE_HEADER_SIZE, 0};
+
+    transfer_all(&t);
+    return t.pos;
+}
+
+int savestate_save(uint8_t *buffer, uint32_t size)
+{
+    struct transfer t = {TRANSFER_SAVE, buffer, size, SAVESTATE_HEADER_SIZE, 0};
+
+    if (size < SAVESTATE_HEADER_SIZE)
+    {
+        return -1;
+    }
+
+    save_events();
+    transfer_all(&t);
+    if (t.error)
+    {
+        log(LERR "Save state buffer of %" PRIu32 " bytes is too small.", size);
+        return -1;
+    }
+
+    memcpy(buffer, SAVESTATE_MAGIC, 4);
+    buffer[4] = (uint8_t)SAVESTATE_VERSION;
+    buffer[5] = (uint8_t)(SAVESTATE_VERSION >> 8);
+    buffer[6] = 0;
+    buffer[7] = 0;
+    put_le32(buffer + 8, t.pos);
+    return 0;
+}
+
+int savestate_load(const uint8_t *buffer, uint32_t size)
+{
+    struct transfer t = {TRANSFER_CHECK, (uint8_t*)buffer, size, SAVESTATE_HEADER_SIZE, 0};
+    enum ppu_render render = ppu.render;
+
+    if (size < SAVESTATE_HEADER_SIZE || memcmp(buffer, SAVESTATE_MAGIC, 4) ||
+        (buffer[4] | buffer[5] << 8) != SAVESTATE_VERSION || get_le32(buffer + 8) != size)
+    {
+        log(LERR "Not a version %d save state.", SAVESTATE_VERSION);
+        return -1;
+    }
+
+    transfer_all(&t);
+    if (t.error || t.pos != size)
+    {
+        return -1;
+    }
+
+    t.mode = TRANSFER_LOAD;
+    t.pos = SAVESTATE_HEADER_SIZE;
+    transfer_all(&t);
+
+    restore_derived(render);
+    bus_mark_dirty(0, 0x10000);
+    return 0;
+}
+
+uint32_t savestate_devices_size()
+{
+    uint32_t size = 0;
+    uint8_t i;
+
+    for (i = 0; i < NUM_DEVICE_SECTIONS; i++)
+    {
+        size += device_sections[i].size;
+    }
+    return size;
+}
+
+void savestate_save_devices(uint8_t *buffer)
+{
+    uint8_t i;
+
+    save_events();
+    for (i = 0; i < NUM_DEVICE_SECTIONS; i++)
+    {
+        memcpy(buffer, device_sections[i].data, device_sections[i].size);
+        buffer += device_sections[i].size;
+    }
+}
+
+void savestate_load_devices(const uint8_t *buffer)
+{
+    enum ppu_render render = ppu.render;
+    uint8_t i;
+
+    for (i = 0; i < NUM_DEVICE_SECTIONS; i++)
+    {
+        memcpy(device_sections[i].data, buffer, device_sections[i].size);
+        buffer += device_sections[i].size;
+    }
+    restore_derived(render);
+}
+
+int savestate_save_file(const char *path)
+{
+    uint32_t size = savestate_size();
+    uint8_t *buffer = (uint8_t*)malloc(size);
+    FILE *file = NULL;
+    int ret = -1;
+
+    if (buffer == NULL || savestate_save(buffer, size))
+    {
+        goto out;
+    }
+
+    file = fopen(path, "wb");
+    if (file != NULL && fwrite(buffer, 1, size, file) == size)
+    {
+        ret = 0;
+    }
+    if (file != NULL && fclose(file))
+    {
+        ret = -1;
+    }
+
+out:
+    if (ret)
+        log(LERR "Failed to save state to %s", path);
+    free(buffer);
+    return ret;
+}
+
+int savestate_load_file(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    uint8_t *buffer = NULL;
+    long size;
+    int ret = -1;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 || fseek(file, 0, SEEK_SET))
+    {
+        goto out;
+    }
+
+    buffer = (uint8_t*)malloc(size + 1);
+    if (buffer != NULL && fread(buffer, 1, size, file) == (size_t)size)
+    {
+        ret = savestate_load(buffer, (uint32_t)size);
+    }
+
+out:
+    if (file != NULL)
+        fclose(file);
+    if (ret)
+        log(LERR "Failed to load state from %s", path);
+    free(buffer);
+    return ret;
+}
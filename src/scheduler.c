@@ -0,0 +1,96 @@
+#include "scheduler.h"
+#include <stddef.h>
+#include "hostprof.h"
+#include "log.h"
+
+uint64_t sched_next_cycle = SCHED_NEVER;
+
+static uint64_t sched_cycles[NUM_SCHED_EVENTS];
+static sched_callback_t sched_callbacks[NUM_SCHED_EVENTS];
+
+static inline void update_next_cycle()
+{
+    uint8_t event;
+
+    sched_next_cycle = SCHED_NEVER;
+    for (event = 0; event < NUM_SCHED_EVENTS; event++)
+    {
+        if (sched_cycles[event] < sched_next_cycle)
+        {
+            sched_next_cycle = sched_cycles[event];
+        }
+    }
+}
+
+void sched_init()
+{
+    uint8_t event;
+
+    for (event = 0; event < NUM_SCHED_EVENTS; event++)
+    {
+        sched_cycles[event] = SCHED_NEVER;
+        sched_callbacks[event] = NULL;
+    }
+    sched_next_cycle = SCHED_NEVER;
+}
+
+int sched_register(enum sched_event event, sched_callback_t callback)
+{
+    if (event >= NUM_SCHED_EVENTS)
+    {
+        log(LERR "Failed to register scheduler event %d", event);
+        return -1;
+    }
+
+    sched_callbacks[event] = callback;
+    sched_cycles[event] = SCHED_NEVER;
+    return 0;
+}
+
+void sched_set(enum sched_event event, uint64_t cycle)
+{
+    sched_cycles[event] = cycle;
+    if (cycle < sched_next_cycle)
+    {
+        sched_next_cycle = cycle;
+    }
+    else
+    {
+        update_next_cycle();
+    }
+}
+
+void sched_cancel(enum sched_event event)
+{
+    sched_cycles[event] = SCHED_NEVER;
+    update_next_cycle();
+}
+
+uint64_t sched_get(enum sched_event event)
+{
+    return sched_cycles[event];
+}
+
+// Run every event that is due. Callbacks receive the cycle they were scheduled for and may
+// re-arm their own slot.
+void sched_run(uint64_t cycle)
+{
+    uint8_t event;
+    uint64_t due;
+
+    for (event = 0; event < NUM_SCHED_EVENTS; event++)
+    {
+        due = sched_cycles[event];
+        if (due <= cycle)
+        {
+            sched_cycles[event] = SCHED_NEVER;
+            if (sched_callbacks[event] != NULL)
+            {
+                HOSTPROF_ENTER(HOSTPROF_SCHED + event);
+                sched_callbacks[event](due);
+                HOSTPROF_LEAVE();
+            }
+        }
+    }
+    update_next_cycle();
+}
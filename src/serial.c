@@ -0,0 +1,89 @@
+#include "serial.h"
+#include "bus.h"
+#include "log.h"
+#include "scheduler.h"
+#include "cpu/cpu.h"
+
+struct serial_struct serial;
+
+static serial_output_callback_t output_callback = NULL;
+static serial_input_callback_t input_callback = NULL;
+
+// End of a transfer: the byte is out and the one from the other end, or the unconnected line, is in.
+static void serial_event(uint64_t cycle)
+{
+    if (serial.output_size < SERIAL_OUTPUT_SIZE)
+    {
+        serial.output[serial.output_size++] = serial.sb;
+    }
+    if (output_callback != NULL)
+    {
+        output_callback(serial.sb);
+    }
+
+    serial.sb = input_callback != NULL ? input_callback() : 0xFF;
+    serial.sc &= ~SERIAL_SC_START;
+    cpu.if_flags.serial_irq = 1;
+}
+
+int serial_read(uint8_t *result, uint16_t addr)
+{
+    // Unused SC bits read as set.
+    *result = addr == 0 ? serial.sb : serial.sc | 0x7E;
+    return 0;
+}
+
+int serial_write(uint8_t val, uint16_t addr)
+{
+    if (addr == 0)
+    {
+        serial.sb = val;
+        return 0;
+    }
+
+    serial.sc = val & (SERIAL_SC_START | SERIAL_SC_INTERNAL);
+    if ((serial.sc & (SERIAL_SC_START | SERIAL_SC_INTERNAL)) == (SERIAL_SC_START | SERIAL_SC_INTERNAL))
+    {
+        sched_set(SCHED_SERIAL, cpu.cycle_count + SERIAL_BYTE_CYCLES);
+    }
+    else
+    {
+        sched_cancel(SCHED_SERIAL);
+    }
+    return 0;
+}
+
+void serial_set_output_callback(serial_output_callback_t callback)
+{
+    output_callback = callback;
+}
+
+void serial_set_input_callback(serial_input_callback_t callback)
+{
+    input_callback = callback;
+}
+
+void serial_clear_output()
+{
+    serial.output_size = 0;
+}
+
+int serial_init()
+{
+    serial.sb = 0;
+    serial.sc = 0;
+    serial.output_size = 0;
+
+    if (sched_register(SCHED_SERIAL, serial_event) || add_bus_connection(SERIAL_SB_ADDR, 2, serial_read, serial_write))
+    {
+        log(LERR "Failed to initialize the serial port.");
+        return -1;
+    }
+    return 0;
+}
+
+int serial_end()
+{
+    sched_cancel(SCHED_SERIAL);
+    return remove_bus_connection(SERIAL_SB_ADDR);
+}
@@ -0,0 +1,494 @@
+/*
+ * Differential testing of CPU cores.
+ *
+ * Usage:
+ *     gbdiff [-a core] [-b core] [-n instructions] [-k block] [-l state] [-o reproducer] (rom | -R seed)
+ *
+ * Two cores run the same program in lockstep from the same machine state, kept as forks: core a
+ * (default reference) runs a block of -k instructions (default 1), then core b (default cpu_run)
+ * runs the same block from the same fork, and the complete machine state both leave behind is
+ * compared: registers, cycle counts, devices and every byte of writable memory. The program is a
+ * ROM, or with -R a random one generated from seed out of valid opcodes and mapped as writable
+ * memory at 0x0000-0x7FFF, so it rewrites itself as it goes. -l starts from a save state instead
+ * of from boot.
+ *
+ * Random programs that diverge are minimized first: every executed opcode that is not needed to
+ * reach a divergence is replaced by a NOP. The diverging block is then replayed one instruction at
+ * a time, and the state right before the first diverging instruction is saved to -o (default
+ * gbdiff.state). Loaded with -l into the same machine, it diverges on its first instruction. A run
+ * started with -l only saves one when -o is given, so replaying never overwrites the state it loaded.
+ * Exits with 1 on a divergence and 0 if there was none within -n instructions (default 1000000).
+ *
+ * The reference core is the plain interpreter loop cpu_run started from. Fast paths in cpu_run,
+ * or new cores added to the table below, are checked against it.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "bus.h"
+#include "fork.h"
+#include "machine.h"
+#include "ppu.h"
+#include "savestate.h"
+#include "scheduler.h"
+#include "serial.h"
+#include "cpu/cpu.h"
+#include "cpu/opcodes.h"
+
+#define DEFAULT_INSTRUCTIONS 1000000
+#define DEFAULT_REPRODUCER "gbdiff.state"
+#define PROGRAM_SIZE 0x8000
+#define NOP_OPCODE 0x00
+
+struct core
+{
+    const char *name;
+    int (*run)(uint64_t num_cycles);
+};
+
+struct diff_options
+{
+    const char *rom_path; // NULL for a random program.
+    uint32_t seed;
+    const struct core *a;
+    const struct core *b;
+    uint64_t instructions;
+    uint32_t block;
+    const char *state_path; // NULL to start from boot.
+    const char *reproducer_path; // NULL to not save one.
+};
+
+// First block after which the cores disagree.
+struct divergence
+{
+    uint64_t instruction; // Instructions both cores ran before the block.
+    struct fork *before; // Machine before the block.
+    int ret_a; // What the cores returned for the block.
+    int ret_b;
+    struct cpu_struct cpu_a; // CPU after the block.
+    struct cpu_struct cpu_b;
+    int32_t address; // First byte of memory that differs, -1 for none.
+    uint8_t mem_a;
+    uint8_t mem_b;
+};
+
+static int reference_run(uint64_t num_cycles);
+
+static const struct core cores[] = {
+    {"reference", reference_run},
+    {"cpu_run", cpu_run}
+};
+#define NUM_CORES (sizeof(cores) / sizeof(cores[0]))
+
+static struct diff_options options = {NULL, 0, &cores[0], &cores[1], DEFAULT_INSTRUCTIONS, 1, NULL, NULL};
+static uint8_t program[PROGRAM_SIZE];
+static uint8_t executed[PROGRAM_SIZE]; // Opcodes core a fetched from the program.
+static uint8_t track_executed;
+
+static void usage()
+{
+    fprintf(stderr, "usage: gbdiff [-a core] [-b core] [-n instructions] [-k block] [-l state] [-o reproducer] (rom | -R seed)\n");
+    exit(2);
+}
+
+static const struct core *find_core(const char *name)
+{
+    uint32_t i;
+
+    for (i = 0; i < NUM_CORES; i++)
+    {
+        if (strcmp(cores[i].name, name) == 0)
+            return &cores[i];
+    }
+    fprintf(stderr, "gbdiff: unknown core %s\n", name);
+    return NULL;
+}
+
+static int parse_options(int argc, char *argv[])
+{
+    uint8_t random = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:b:n:k:l:o:R:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            if ((options.a = find_core(optarg)) == NULL)
+                return -1;
+            break;
+        case 'b':
+            if ((options.b = find_core(optarg)) == NULL)
+                return -1;
+            break;
+        case 'n':
+            options.instructions = strtoull(optarg, NULL, 0);
+            break;
+        case 'k':
+            options.block = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'l':
+            options.state_path = optarg;
+            break;
+        case 'o':
+            options.reproducer_path = optarg;
+            break;
+        case 'R':
+            options.seed = (uint32_t)strtoul(optarg, NULL, 0);
+            random = 1;
+            break;
+        default:
+            return -1;
+        }
+    }
+    if (options.block == 0 || random == (optind < argc))
+    {
+        return -1;
+    }
+    options.rom_path = random ? NULL : argv[optind];
+    if (options.reproducer_path == NULL && options.state_path == NULL)
+    {
+        options.reproducer_path = DEFAULT_REPRODUCER;
+    }
+    return 0;
+}
+
+/* ----------- Cores ----------- */
+
+// The interpreter loop of cpu_run, without hooks and without any fast path.
+static int reference_run(uint64_t num_cycles)
+{
+    struct opcode *opcode;
+    uint8_t current_opcode;
+    uint64_t end_cycle = cpu.cycle_count + num_cycles;
+
+    while (cpu.cycle_count < end_cycle)
+    {
+        if (cpu.cycles == 0)
+        {
+            if (handle_interrups(&cpu.cycles, &cpu.enable_irq, &cpu.disable_irq))
+                return -1;
+
+            if (cpu.state == STATE_NORMAL)
+            {
+                if (bus_read(&current_opcode, cpu.regs.pc))
+                    return -1;
+                opcode = &opcodes[current_opcode];
+                if (opcode->func(&cpu.regs, &cpu.state, &cpu.enable_irq, &cpu.disable_irq))
+                    return -1;
+                cpu.cycles = opcode->cycles;
+                cpu.regs.pc += opcode->size;
+            }
+        }
+
+        timer_update();
+        cpu.cycles--;
+        cpu.cycle_count++;
+
+        if (cpu.cycle_count >= sched_next_cycle)
+        {
+            sched_run(cpu.cycle_count);
+        }
+    }
+    return 0;
+}
+
+// Run a number of whole instructions. A halted CPU counts every check for an interrupt as one.
+static int step(const struct core *core, uint32_t instructions)
+{
+    uint32_t i;
+
+    for (i = 0; i < instructions; i++)
+    {
+        if (track_executed && cpu.cycles == 0 && cpu.state == STATE_NORMAL && cpu.regs.pc < PROGRAM_SIZE)
+        {
+            executed[cpu.regs.pc] = 1;
+        }
+        do
+        {
+            if (core->run(1))
+                return -1;
+        } while (cpu.cycles != 0);
+    }
+    return 0;
+}
+
+/* ----------- Machine ----------- */
+
+static int machine_init_forks()
+{
+    if (options.rom_path != NULL ? machine_init(options.rom_path) : machine_init_program(program, PROGRAM_SIZE))
+        return -1;
+    if (fork_init())
+    {
+        machine_end();
+        return -1;
+    }
+    return 0;
+}
+
+// Fill the program with registered opcodes, the rest of the table is INVAL or empty. Operands are
+// drawn from them as well, which does not matter.
+static void generate_program(uint32_t seed)
+{
+    uint32_t state = seed ? seed : 1, i;
+    uint8_t opcode;
+
+    for (i = 0; i < PROGRAM_SIZE; i++)
+    {
+        do
+        {
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            opcode = (uint8_t)(state >> 24);
+        } while (opcodes[opcode].func == NULL || opcodes[opcode].func == INVAL);
+        program[i] = opcode;
+    }
+}
+
+/* ----------- Lockstep ----------- */
+
+// Run both cores from start for up to limit instructions. Returns 1 on a divergence, which fills
+// div and leaves its state to the caller, 0 if there was none and -1 on error. Runs stop early
+// without a divergence when both cores fail on the same block. Without a divergence, div only
+// holds the instructions run and the result of the last block.
+static int run_lockstep(struct fork *start, uint64_t limit, uint32_t block, struct divergence *div)
+{
+    struct fork *current = start, *fork_a, *fork_b;
+    uint64_t i;
+    int ret_a = 0, ret_b, diverged;
+
+    for (i = 0; i < limit; i += block)
+    {
+        fork_switch(current);
+        ret_a = step(options.a, block);
+        div->cpu_a = cpu;
+        fork_a = fork_create();
+
+        fork_switch(current);
+        ret_b = step(options.b, block);
+        div->cpu_b = cpu;
+        fork_b = fork_create();
+
+        if (fork_a == NULL || fork_b == NULL)
+        {
+            fork_free(fork_a);
+            fork_free(fork_b);
+            return -1;
+        }
+
+        diverged = fork_compare(fork_a, fork_b, &div->address) || ret_a != ret_b;
+        if (diverged)
+        {
+            div->instruction = i;
+            div->before = current;
+            div->ret_a = ret_a;
+            div->ret_b = ret_b;
+            if (div->address >= 0)
+            {
+                fork_switch(fork_a);
+                div->mem_a = *bus_get_memory((uint16_t)div->address, 1);
+                fork_switch(fork_b);
+                div->mem_b = *bus_get_memory((uint16_t)div->address, 1);
+            }
+        }
+        else if (current != start)
+        {
+            fork_free(current);
+        }
+        fork_free(fork_b);
+
+        if (diverged)
+        {
+            fork_free(fork_a);
+            return 1;
+        }
+        current = fork_a;
+        if (ret_a)
+        {
+            i += block;
+            break;
+        }
+    }
+
+    div->instruction = i < limit ? i : limit;
+    div->ret_a = div->ret_b = ret_a;
+    if (current != start)
+        fork_free(current);
+    return 0;
+}
+
+static void free_divergence(struct divergence *div, struct fork *start)
+{
+    if (div->before != start)
+        fork_free(div->before);
+}
+
+// Replace every executed opcode by a NOP that the program still diverges without. start and div
+// are replaced by the minimized program and its divergence.
+static void minimize(struct fork **start, struct divergence *div)
+{
+    struct divergence candidate_div;
+    struct fork *candidate;
+    uint32_t address, kept = 0, removed = 0;
+
+    for (address = 0; address < PROGRAM_SIZE; address++)
+    {
+        if (!executed[address] || program[address] == NOP_OPCODE)
+            continue;
+
+        fork_switch(*start);
+        program[address] = NOP_OPCODE;
+        bus_mark_dirty(address, 1);
+        candidate = fork_create();
+        if (candidate == NULL)
+            return;
+
+        if (run_lockstep(candidate, div->instruction + options.block, options.block, &candidate_div) == 1)
+        {
+            free_divergence(div, *start);
+            fork_free(*start);
+            *start = candidate;
+            *div = candidate_div;
+            removed++;
+        }
+        else
+        {
+            fork_free(candidate);
+            kept++;
+        }
+    }
+    printf("minimized: %" PRIu32 " of %" PRIu32 " executed opcodes replaced by NOPs\n", removed, removed + kept);
+}
+
+/* ----------- Report ----------- */
+
+static void report_field(const char *name, uint64_t a, uint64_t b)
+{
+    printf("  %c %-12s %16" PRIx64 " %16" PRIx64 "\n", a != b ? '*' : ' ', name, a, b);
+}
+
+static void report(const struct divergence *div)
+{
+    const struct cpu_struct *a = &div->cpu_a, *b = &div->cpu_b;
+    uint8_t bytes[3] = {0};
+    char name[16];
+    uint16_t pc;
+    uint32_t i;
+
+    fork_switch(div->before);
+    pc = cpu.regs.pc;
+    for (i = 0; i < 3; i++)
+    {
+        bus_read(&bytes[i], (uint16_t)(pc + i));
+    }
+
+    printf("%s and %s diverge on instruction %" PRIu64 " (cycle %" PRIu64 "), PC %04x: %02x %02x %02x\n",
+           options.a->name, options.b->name, div->instruction, cpu.cycle_count, pc, bytes[0], bytes[1], bytes[2]);
+    printf("    %-12s %16s %16s\n", "", options.a->name, options.b->name);
+    report_field("result", (uint64_t)(int64_t)div->ret_a, (uint64_t)(int64_t)div->ret_b);
+    report_field("AF", a->regs.af, b->regs.af);
+    report_field("BC", a->regs.bc, b->regs.bc);
+    report_field("DE", a->regs.de, b->regs.de);
+    report_field("HL", a->regs.hl, b->regs.hl);
+    report_field("SP", a->regs.sp, b->regs.sp);
+    report_field("PC", a->regs.pc, b->regs.pc);
+    report_field("state", a->state, b->state);
+    report_field("IME", a->ime, b->ime);
+    report_field("EI pending", a->enable_irq, b->enable_irq);
+    report_field("DI pending", a->disable_irq, b->disable_irq);
+    report_field("cycles left", a->cycles, b->cycles);
+    report_field("cycle count", a->cycle_count, b->cycle_count);
+    report_field("IF", *(uint8_t*)&a->if_flags, *(uint8_t*)&b->if_flags);
+    report_field("IE", *(uint8_t*)&a->ie_flags, *(uint8_t*)&b->ie_flags);
+    report_field("DIV", a->timer_regs.div, b->timer_regs.div);
+    report_field("TIMA", a->timer_regs.tima, b->timer_regs.tima);
+    report_field("TMA", a->timer_regs.tma, b->timer_regs.tma);
+    report_field("TAC", a->timer_regs.tac, b->timer_regs.tac);
+
+    if (div->address >= 0)
+    {
+        snprintf(name, sizeof(name), "memory %04x", (uint16_t)div->address);
+        report_field(name, div->mem_a, div->mem_b);
+    }
+    else if (memcmp(a, b, sizeof(*a)) == 0)
+    {
+        printf("  * other device state\n");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct divergence div, single;
+    struct fork *start;
+    int ret;
+
+    if (parse_options(argc, argv))
+        usage();
+
+    if (machine_init_forks())
+    {
+        fprintf(stderr, "gbdiff: failed to set up the machine\n");
+        return 1;
+    }
+    if (options.rom_path == NULL)
+    {
+        generate_program(options.seed);
+    }
+    if (options.state_path != NULL && savestate_load_file(options.state_path))
+    {
+        fprintf(stderr, "gbdiff: failed to load %s\n", options.state_path);
+        return 1;
+    }
+
+    start = fork_create();
+    if (start == NULL)
+        return 1;
+
+    track_executed = options.rom_path == NULL;
+    ret = run_lockstep(start, options.instructions, options.block, &div);
+    track_executed = 0;
+    if (ret < 0)
+        return 1;
+    if (ret == 0)
+    {
+        printf("%s and %s agree on %" PRIu64 " instructions up to cycle %" PRIu64 "%s\n", options.a->name,
+               options.b->name, div.instruction, cpu.cycle_count, div.ret_a ? ", where both failed" : "");
+        return 0;
+    }
+
+    if (options.rom_path == NULL)
+    {
+        minimize(&start, &div);
+    }
+
+    // Find the instruction in the block that diverges first.
+    if (options.block > 1 && run_lockstep(div.before, options.block, 1, &single) == 1)
+    {
+        single.instruction += div.instruction;
+        if (single.before != div.before)
+            free_divergence(&div, start);
+        div = single;
+    }
+
+    report(&div);
+    if (options.reproducer_path == NULL)
+    {
+        return 1;
+    }
+    fork_switch(div.before);
+    if (savestate_save_file(options.reproducer_path))
+    {
+        fprintf(stderr, "gbdiff: failed to save %s\n", options.reproducer_path);
+        return 1;
+    }
+    printf("reproducer saved to %s, replay with: gbdiff -a %s -b %s -l %s -n 1 ", options.reproducer_path,
+           options.a->name, options.b->name, options.reproducer_path);
+    if (options.rom_path != NULL)
+        printf("%s\n", options.rom_path);
+    else
+        printf("-R %" PRIu32 "\n", options.seed);
+    return 1;
+}
@@ -0,0 +1,317 @@
+/*
+ * Fork server for fuzzing a ROM through its joypad and serial port with AFL++.
+ *
+ * Usage:
+ *     gbfuzz [-c boot_cycles | -p boot_pc] [-t run_cycles] [-n runs] rom [testcase]
+ *
+ * The ROM is booted once, up to a number of cycles or until PC first reaches an address, and that
+ * point is kept as a fork. Every testcase then starts from it: a single process runs them one
+ * after the other, restoring the fork in between, and stops itself after each one so the fork
+ * server can report it (AFL++ persistent mode). The testcase is read from the given path, or from
+ * stdin without one. Every two bytes of it are one input: the number of scanlines to wait since
+ * the previous one, then the buttons to hold. With the high bit of the first byte set, the second
+ * one is instead the next byte the serial port receives, one per transfer in testcase order (0xFF
+ * once they run out), and no time passes.
+ *
+ * Edge coverage of the guest code after boot goes to the map of afl-fuzz. Run outside of it, the
+ * testcase is run -n times (default once) into a private map, and the number of edges hit and the
+ * average time per run are printed, which includes restoring the fork.
+ */
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "bus.h"
+#include "coverage.h"
+#include "fork.h"
+#include "hosttime.h"
+#include "joypad.h"
+#include "machine.h"
+#include "ppu.h"
+#include "serial.h"
+#include "cpu/cpu.h"
+
+#define FORKSRV_CTL_FD 198
+#define FORKSRV_ST_FD  199
+
+#define DEFAULT_BOOT_CYCLES (10 * FRAME_CYCLES)
+#define DEFAULT_RUN_CYCLES  (10 * FRAME_CYCLES)
+#define BOOT_PC_LIMIT       (60ULL * CPU_FREQ) // Give up waiting for the boot PC after a minute.
+#define PERSISTENT_RUNS     100000 // Runs before the process is replaced by a fresh one.
+#define MAX_TESTCASE_SIZE   (2 * JOYPAD_QUEUE_SIZE)
+#define SERIAL_RECORD       0x80 // Wait byte flag of serial records.
+
+// Tells afl-fuzz that the target runs in persistent mode.
+const char *afl_persistent_signature = "##SIG_AFL_PERSISTENT##";
+
+struct fuzz_options
+{
+    const char *rom_path;
+    const char *testcase_path; // NULL for stdin.
+    uint64_t boot_cycles;
+    int32_t boot_pc; // -1 to boot by cycles.
+    uint64_t run_cycles;
+    uint32_t runs;
+};
+
+static struct fuzz_options options = {NULL, NULL, DEFAULT_BOOT_CYCLES, -1, DEFAULT_RUN_CYCLES, 1};
+static struct fork *boot_fork;
+static uint64_t boot_cycle;
+static uint8_t coverage_map[COVERAGE_MAP_SIZE];
+static uint8_t serial_input[MAX_TESTCASE_SIZE / 2];
+static uint32_t serial_input_size;
+static uint32_t serial_input_pos;
+
+static void usage()
+{
+    fprintf(stderr, "usage: gbfuzz [-c boot_cycles | -p boot_pc] [-t run_cycles] [-n runs] rom [testcase]\n");
+    exit(2);
+}
+
+static int parse_options(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:p:t:n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'c':
+            options.boot_cycles = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            options.boot_pc = (int32_t)strtol(optarg, NULL, 16);
+            break;
+        case 't':
+            options.run_cycles = strtoull(optarg, NULL, 0);
+            break;
+        case 'n':
+            options.runs = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        default:
+            return -1;
+        }
+    }
+    if (optind >= argc)
+    {
+        return -1;
+    }
+    options.rom_path = argv[optind];
+    options.testcase_path = optind + 1 < argc ? argv[optind + 1] : NULL;
+    return 0;
+}
+
+/* ----------- Machine ----------- */
+
+static int machine_init_forks()
+{
+    if (machine_init(options.rom_path))
+        return -1;
+    if (fork_init())
+    {
+        machine_end();
+        return -1;
+    }
+    return 0;
+}
+
+static int boot()
+{
+    if (options.boot_pc < 0)
+    {
+        return cpu_run(options.boot_cycles);
+    }
+
+    // Step whole instructions until the boot address is about to be executed.
+    while (cpu.regs.pc != options.boot_pc || cpu.cycles != 0)
+    {
+        if (cpu.cycle_count >= BOOT_PC_LIMIT || cpu_run(1))
+        {
+            fprintf(stderr, "gbfuzz: PC never reached %04x\n", options.boot_pc);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/* ----------- Testcases ----------- */
+
+static int read_testcase(uint8_t *data, size_t *size)
+{
+    ssize_t got;
+    int fd;
+
+    if (options.testcase_path != NULL)
+    {
+        fd = open(options.testcase_path, O_RDONLY);
+        if (fd < 0)
+            return -1;
+    }
+    else
+    {
+        // afl-fuzz rewrites the file behind stdin for every testcase.
+        fd = STDIN_FILENO;
+        lseek(fd, 0, SEEK_SET);
+    }
+
+    *size = 0;
+    while (*size < MAX_TESTCASE_SIZE && (got = read(fd, data + *size, MAX_TESTCASE_SIZE - *size)) > 0)
+    {
+        *size += got;
+    }
+
+    if (fd != STDIN_FILENO)
+        close(fd);
+    return 0;
+}
+
+static uint8_t next_serial_input()
+{
+    return serial_input_pos < serial_input_size ? serial_input[serial_input_pos++] : 0xFF;
+}
+
+// Restore the boot fork and run one testcase from it. Emulation errors are crashes.
+static void run_testcase(const uint8_t *data, size_t size)
+{
+    uint64_t cycle;
+    size_t i;
+
+    fork_switch(boot_fork);
+    joypad_clear_queue();
+    serial_input_size = 0;
+    serial_input_pos = 0;
+
+    cycle = cpu.cycle_count;
+    for (i = 0; i + 1 < size; i += 2)
+    {
+        if (data[i] & SERIAL_RECORD)
+        {
+            serial_input[serial_input_size++] = data[i + 1];
+            continue;
+        }
+        cycle += (uint64_t)data[i] * LINE_CYCLES;
+        joypad_queue(cycle, data[i + 1]);
+    }
+
+    if (cpu_run(options.run_cycles))
+    {
+        abort();
+    }
+}
+
+static void persistent_loop()
+{
+    uint8_t data[MAX_TESTCASE_SIZE];
+    size_t size;
+    uint32_t runs;
+
+    for (runs = 0; runs < PERSISTENT_RUNS; runs++)
+    {
+        if (read_testcase(data, &size))
+            exit(1);
+        run_testcase(data, size);
+        raise(SIGSTOP);
+    }
+    exit(0);
+}
+
+/* ----------- Fork server ----------- */
+
+// Serve afl-fuzz over the fork server pipes. Returns -1 right away when not run by afl-fuzz.
+static int fork_server()
+{
+    uint32_t hello = 0, was_killed;
+    int status;
+    pid_t child = -1;
+    uint8_t stopped = 0;
+
+    if (write(FORKSRV_ST_FD, &hello, 4) != 4)
+    {
+        return -1;
+    }
+
+    while (read(FORKSRV_CTL_FD, &was_killed, 4) == 4)
+    {
+        // A stopped child that was killed for taking too long has to be reaped first.
+        if (stopped && was_killed)
+        {
+            stopped = 0;
+            waitpid(child, &status, 0);
+        }
+
+        if (stopped)
+        {
+            kill(child, SIGCONT);
+            stopped = 0;
+        }
+        else
+        {
+            child = fork();
+            if (child < 0)
+                exit(1);
+            if (child == 0)
+            {
+                close(FORKSRV_CTL_FD);
+                close(FORKSRV_ST_FD);
+                persistent_loop();
+            }
+        }
+
+        if (write(FORKSRV_ST_FD, &child, 4) != 4 || waitpid(child, &status, WUNTRACED) < 0)
+            exit(1);
+        if (WIFSTOPPED(status))
+            stopped = 1;
+        if (write(FORKSRV_ST_FD, &status, 4) != 4)
+            exit(1);
+    }
+    exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    uint8_t data[MAX_TESTCASE_SIZE];
+    size_t size;
+    double start;
+    uint32_t i;
+
+    if (parse_options(argc, argv))
+        usage();
+
+    if (machine_init_forks() || boot())
+    {
+        fprintf(stderr, "gbfuzz: failed to boot %s\n", options.rom_path);
+        return 1;
+    }
+
+    // Set after boot, so booting sees the unconnected line.
+    serial_set_input_callback(next_serial_input);
+    boot_cycle = cpu.cycle_count;
+    boot_fork = fork_create();
+    if (boot_fork == NULL)
+        return 1;
+
+    if (coverage_attach_afl() && coverage_enable(coverage_map, COVERAGE_MAP_SIZE))
+        return 1;
+
+    fork_server();
+
+    // Not run by afl-fuzz, run the testcase directly.
+    if (read_testcase(data, &size))
+    {
+        fprintf(stderr, "gbfuzz: failed to read testcase\n");
+        return 1;
+    }
+
+    start = host_time();
+    for (i = 0; i < options.runs; i++)
+    {
+        run_testcase(data, size);
+    }
+    start = host_time() - start;
+
+    printf("booted to cycle %" PRIu64 ", %" PRIu32 " runs of %" PRIu64 " cycles: %.1f us/run, %" PRIu32 " edges\n",
+           boot_cycle, options.runs, options.run_cycles, start * 1e6 / options.runs, coverage_count());
+    return 0;
+}
@@ -0,0 +1,258 @@
+/*
+ * Profiler for running a ROM without a display.
+ *
+ * Usage:
+ *     gbprof [-t cycles] [-o opcodes.csv|opcodes.json] [-s interval] [-y rom.sym] [-f folded]
+ *            [-g callgraph_folded] [-T] [-m heatmap.csv | -M heatmap.csv] [-b] rom
+ *
+ * Runs the ROM for a number of cycles (default one minute of emulated time) and reports where the
+ * guest spends them. With -o, executions and cycles per opcode are dumped to the given file as
+ * JSON if it ends in .json and CSV otherwise.
+ *
+ * The PC is sampled every -s cycles (default every 1000) and the hottest functions of the RGBDS
+ * symbol file given with -y are printed, or the hottest addresses without one. -f also writes the
+ * samples as folded stacks, for flamegraph.pl and similar tools.
+ *
+ * -g follows calls, returns and interrupts, prints the functions with the most inclusive cycles
+ * and writes the exclusive cycles of every call chain to the given file as folded stacks.
+ *
+ * -T prints how much host time each emulator subsystem took, when built with
+ * make tools RELEASE_DEFINES=HOSTPROF.
+ *
+ * -m writes the bus reads and writes of the run per 256 byte page and per I/O register as CSV,
+ * -M does the same for every frame, labelled with the frame number.
+ *
+ * -b records the LD B,B and LD D,D markers the guest executes and prints the cycles between them.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "bus.h"
+#include "callgraph.h"
+#include "heatmap.h"
+#include "machine.h"
+#include "markers.h"
+#include "hostprof.h"
+#include "opstats.h"
+#include "profiler.h"
+#include "ppu.h"
+#include "serial.h"
+#include "cpu/cpu.h"
+
+#define DEFAULT_RUN_CYCLES (60ULL * CPU_FREQ)
+#define DEFAULT_SAMPLE_INTERVAL 1000
+#define REPORT_ENTRIES 20
+
+struct prof_options
+{
+    const char *rom_path;
+    const char *opstats_path; // NULL to not count opcodes.
+    const char *symbols_path;
+    const char *folded_path;
+    const char *callgraph_path; // NULL to not follow calls.
+    uint8_t host_time;
+    const char *heatmap_path; // NULL to not count bus accesses.
+    uint8_t heatmap_per_frame;
+    uint8_t markers;
+    uint64_t run_cycles;
+    uint32_t sample_interval;
+};
+
+static struct prof_options options = {NULL, NULL, NULL, NULL, NULL, 0, NULL, 0, 0, DEFAULT_RUN_CYCLES, DEFAULT_SAMPLE_INTERVAL};
+
+static void usage()
+{
+    fprintf(stderr, "usage: gbprof [-t cycles] [-o opcodes.csv|opcodes.json] [-s interval] [-y rom.sym] [-f folded] [-g callgraph_folded] [-T]\n"
+                    "              [-m heatmap.csv | -M heatmap.csv] [-b] rom\n");
+    exit(2);
+}
+
+static int parse_options(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:o:s:y:f:g:Tm:M:b")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            options.run_cycles = strtoull(optarg, NULL, 0);
+            break;
+        case 'o':
+            options.opstats_path = optarg;
+            break;
+        case 's':
+            options.sample_interval = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'y':
+            options.symbols_path = optarg;
+            break;
+        case 'f':
+            options.folded_path = optarg;
+            break;
+        case 'g':
+            options.callgraph_path = optarg;
+            break;
+        case 'T':
+            options.host_time = 1;
+            break;
+        case 'm':
+        case 'M':
+            options.heatmap_path = optarg;
+            options.heatmap_per_frame = opt == 'M';
+            break;
+        case 'b':
+            options.markers = 1;
+            break;
+        default:
+            return -1;
+        }
+    }
+    if (optind != argc - 1)
+    {
+        return -1;
+    }
+    options.rom_path = argv[optind];
+    return 0;
+}
+
+static FILE *heatmap_file;
+
+static void heatmap_frame(const uint8_t *framebuffer)
+{
+    heatmap_write_csv(heatmap_file, ppu.frames, 0);
+    heatmap_clear();
+}
+
+static int heatmap_start()
+{
+    heatmap_file = fopen(options.heatmap_path, "w");
+    if (heatmap_file == NULL)
+        return -1;
+    if (heatmap_enable() || heatmap_write_csv(heatmap_file, 0, 1))
+    {
+        fclose(heatmap_file);
+        heatmap_file = NULL;
+        return -1;
+    }
+    if (options.heatmap_per_frame)
+        ppu_set_frame_callback(heatmap_frame);
+    return 0;
+}
+
+// Write what is left of the run, or all of it.
+static int heatmap_finish()
+{
+    int ret;
+
+    ppu_set_frame_callback(NULL);
+    ret = heatmap_write_csv(heatmap_file, options.heatmap_per_frame ? ppu.frames : 0, 0);
+    if (fclose(heatmap_file))
+        ret = -1;
+    heatmap_disable();
+    return ret;
+}
+
+static int write_folded(const char *path, int (*write)(FILE *file))
+{
+    FILE *file = fopen(path, "w");
+    int ret;
+
+    if (file == NULL)
+        return -1;
+    ret = write(file);
+    if (fclose(file))
+        ret = -1;
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    int ret = 0;
+
+    if (parse_options(argc, argv))
+        usage();
+
+    if (machine_init(options.rom_path))
+    {
+        fprintf(stderr, "gbprof: failed to load %s\n", options.rom_path);
+        return 1;
+    }
+
+    // Dumped on exit, so the counts survive an emulation error too.
+    if (options.opstats_path != NULL && opstats_enable(options.opstats_path))
+    {
+        ret = 1;
+        goto out;
+    }
+
+    // Printed on exit.
+    if (options.host_time && hostprof_start())
+    {
+        fprintf(stderr, "gbprof: host time accounting is not built in\n");
+        ret = 1;
+        goto out;
+    }
+
+    if (options.heatmap_path != NULL && heatmap_start())
+    {
+        fprintf(stderr, "gbprof: failed to write %s\n", options.heatmap_path);
+        ret = 1;
+        goto out;
+    }
+
+    if ((options.symbols_path != NULL && profiler_load_symbols(options.symbols_path)) ||
+        profiler_start(options.sample_interval) || (options.callgraph_path != NULL && callgraph_start()) ||
+        (options.markers && markers_start()))
+    {
+        fprintf(stderr, "gbprof: failed to start the profiler\n");
+        ret = 1;
+        goto out;
+    }
+
+    if (cpu_run(options.run_cycles))
+    {
+        fprintf(stderr, "gbprof: emulation failed at cycle %" PRIu64 ", PC %04x\n", cpu.cycle_count, cpu.regs.pc);
+        ret = 1;
+    }
+    profiler_stop();
+    callgraph_stop();
+    markers_stop();
+    if (options.heatmap_path != NULL && heatmap_finish())
+    {
+        fprintf(stderr, "gbprof: failed to write %s\n", options.heatmap_path);
+        ret = 1;
+    }
+
+    profiler_report(stdout, REPORT_ENTRIES);
+    if (options.folded_path != NULL && write_folded(options.folded_path, profiler_write_folded))
+    {
+        fprintf(stderr, "gbprof: failed to write %s\n", options.folded_path);
+        ret = 1;
+    }
+
+    if (options.callgraph_path != NULL)
+    {
+        printf("\n");
+        callgraph_report(stdout, REPORT_ENTRIES);
+        if (write_folded(options.callgraph_path, callgraph_write_folded))
+        {
+            fprintf(stderr, "gbprof: failed to write %s\n", options.callgraph_path);
+            ret = 1;
+        }
+    }
+
+    if (options.markers)
+    {
+        printf("\n");
+        markers_report(stdout);
+    }
+
+out:
+    markers_end();
+    heatmap_disable();
+    callgraph_end();
+    profiler_end();
+    machine_end();
+    return ret;
+}
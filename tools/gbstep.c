@@ -0,0 +1,680 @@
+/*
+ * Runner for single-step CPU test vectors, such as the SM83 ones of SingleStepTests.
+ *
+ * Usage:
+ *     gbstep [-j workers] [-m failures] [-P] [-v] (file.json | directory) ...
+ *
+ * Every vector file is an array of cases, each with a name, an initial and a final state and the
+ * bus cycles of the instruction:
+ *     {"name": "...", "initial": {"pc": ..., "sp": ..., "a": ..., "b": ..., "c": ..., "d": ...,
+ *      "e": ..., "f": ..., "h": ..., "l": ..., "ime": ..., "ie": ..., "ram": [[address, value], ...]},
+ *      "final": {...}, "cycles": [...]}
+ * A case loads the initial state into the CPU and into a flat 64 KiB test bus, runs the one
+ * instruction at PC through opcodes[] like cpu_run does, and compares the registers, IME, IE, the
+ * memory of the final state and the cycles of the instruction, four clock cycles per bus cycle.
+ * Writes to addresses the final state does not list fail as well. With -P, PC in the vectors
+ * points past the opcode, which was fetched with the previous instruction.
+ *
+ * Directories are searched for .json files. The files are split over -j worker processes (default
+ * one per CPU), which print the first -m mismatches of every file (default 1) and, with -v, a
+ * line for every file. Exits with 1 if any case failed.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "bus.h"
+#include "hosttime.h"
+#include "cpu/cpu.h"
+#include "cpu/opcodes.h"
+
+#define MAX_FILES 4096
+#define MAX_RAM 64 // Entries of a state's RAM list.
+#define MAX_WRITES 64
+#define BUS_CYCLE 4 // Clock cycles per bus cycle.
+#define IE_ADDR 0xFFFF
+
+struct step_options
+{
+    uint32_t workers;
+    uint32_t max_failures;
+    uint8_t prefetched;
+    uint8_t verbose;
+};
+
+struct ram_entry
+{
+    uint16_t address;
+    uint8_t value;
+};
+
+struct step_state
+{
+    uint16_t pc;
+    uint16_t sp;
+    uint8_t a, b, c, d, e, f, h, l;
+    uint8_t ime;
+    int16_t ie; // -1 if the state does not have it.
+    struct ram_entry ram[MAX_RAM];
+    uint32_t num_ram;
+};
+
+struct step_case
+{
+    char name[64];
+    struct step_state initial;
+    struct step_state final;
+    uint32_t bus_cycles;
+};
+
+// Results a worker sends back.
+struct step_results
+{
+    uint64_t cases;
+    uint64_t failed;
+    uint32_t files;
+    uint32_t bad_files; // Files that could not be read or parsed.
+};
+
+struct parser
+{
+    const char *pos;
+    const char *end;
+    int error;
+};
+
+static struct step_options options = {0, 1, 0, 0};
+static char *files[MAX_FILES];
+static uint32_t num_files;
+
+static uint8_t flat[0x10000];
+static uint16_t writes[MAX_WRITES];
+static uint32_t num_writes;
+
+static void usage()
+{
+    fprintf(stderr, "usage: gbstep [-j workers] [-m failures] [-P] [-v] (file.json | directory) ...\n");
+    exit(2);
+}
+
+/* ----------- Test bus ----------- */
+
+static void record_write(uint16_t address)
+{
+    if (num_writes < MAX_WRITES)
+        writes[num_writes++] = address;
+}
+
+static int flat_write(uint8_t val, uint16_t addr)
+{
+    flat[addr] = val;
+    record_write(addr);
+    return 0;
+}
+
+// The bus can not map 0x10000 bytes as one region, IE gets its own.
+static int flat_write_ie(uint8_t val, uint16_t addr)
+{
+    flat[IE_ADDR] = val;
+    record_write(IE_ADDR);
+    return 0;
+}
+
+static int bus_setup()
+{
+    if (add_bus_memory(0, IE_ADDR, flat, flat_write))
+        return -1;
+    if (add_bus_memory(IE_ADDR, 1, &flat[IE_ADDR], flat_write_ie))
+    {
+        remove_bus_connection(0);
+        return -1;
+    }
+    return 0;
+}
+
+/* ----------- JSON ----------- */
+
+// Only what the vectors use: objects, arrays, numbers, strings without escapes that matter, null.
+static void skip_space(struct parser *p)
+{
+    while (p->pos < p->end && (*p->pos == ' ' || *p->pos == '\n' || *p->pos == '\r' || *p->pos == '\t'))
+        p->pos++;
+}
+
+static int accept(struct parser *p, char c)
+{
+    skip_space(p);
+    if (p->pos < p->end && *p->pos == c)
+    {
+        p->pos++;
+        return 1;
+    }
+    return 0;
+}
+
+static void expect(struct parser *p, char c)
+{
+    if (!accept(p, c))
+        p->error = 1;
+}
+
+static void parse_string(struct parser *p, char *buffer, size_t size)
+{
+    size_t len = 0;
+
+    expect(p, '"');
+    while (!p->error && p->pos < p->end && *p->pos != '"')
+    {
+        if (*p->pos == '\\')
+            p->pos++;
+        if (buffer != NULL && len + 1 < size)
+            buffer[len++] = *p->pos;
+        p->pos++;
+    }
+    if (buffer != NULL && size > 0)
+        buffer[len] = '\0';
+    if (p->pos >= p->end)
+        p->error = 1;
+    p->pos++;
+}
+
+static int64_t parse_number(struct parser *p)
+{
+    char *number_end;
+    int64_t val;
+
+    skip_space(p);
+    val = strtoll(p->pos, &number_end, 10);
+    if (number_end == p->pos)
+        p->error = 1;
+    p->pos = number_end;
+    return val;
+}
+
+static void skip_value(struct parser *p)
+{
+    skip_space(p);
+    if (p->pos >= p->end)
+    {
+        p->error = 1;
+        return;
+    }
+
+    switch (*p->pos)
+    {
+    case '"':
+        parse_string(p, NULL, 0);
+        break;
+    case '[':
+        p->pos++;
+        if (accept(p, ']'))
+            break;
+        do
+        {
+            skip_value(p);
+        } while (!p->error && accept(p, ','));
+        expect(p, ']');
+        break;
+    case '{':
+        p->pos++;
+        if (accept(p, '}'))
+            break;
+        do
+        {
+            parse_string(p, NULL, 0);
+            expect(p, ':');
+            skip_value(p);
+        } while (!p->error && accept(p, ','));
+        expect(p, '}');
+        break;
+    case 'n':
+    case 't':
+    case 'f':
+        while (p->pos < p->end && *p->pos >= 'a' && *p->pos <= 'z')
+            p->pos++;
+        break;
+    default:
+        parse_number(p);
+        break;
+    }
+}
+
+static void parse_ram(struct parser *p, struct step_state *state)
+{
+    struct ram_entry entry;
+
+    expect(p, '[');
+    if (accept(p, ']'))
+        return;
+    do
+    {
+        expect(p, '[');
+        entry.address = (uint16_t)parse_number(p);
+        expect(p, ',');
+        entry.value = (uint8_t)parse_number(p);
+        expect(p, ']');
+        if (state->num_ram < MAX_RAM)
+            state->ram[state->num_ram++] = entry;
+        else
+            p->error = 1;
+    } while (!p->error && accept(p, ','));
+    expect(p, ']');
+}
+
+static void parse_state(struct parser *p, struct step_state *state)
+{
+    static const char *const registers[] = {"a", "b", "c", "d", "e", "f", "h", "l"};
+    uint8_t *const fields[] = {&state->a, &state->b, &state->c, &state->d, &state->e, &state->f, &state->h, &state->l};
+    char key[16];
+    uint32_t i;
+
+    memset(state, 0, sizeof(*state));
+    state->ie = -1;
+    expect(p, '{');
+    do
+    {
+        parse_string(p, key, sizeof(key));
+        expect(p, ':');
+        if (p->error)
+            return;
+
+        if (strcmp(key, "pc") == 0)
+            state->pc = (uint16_t)parse_number(p);
+        else if (strcmp(key, "sp") == 0)
+            state->sp = (uint16_t)parse_number(p);
+        else if (strcmp(key, "ime") == 0)
+            state->ime = (uint8_t)parse_number(p);
+        else if (strcmp(key, "ie") == 0)
+            state->ie = (int16_t)(parse_number(p) & 0xFF);
+        else if (strcmp(key, "ram") == 0)
+            parse_ram(p, state);
+        else
+        {
+            for (i = 0; i < 8 && strcmp(key, registers[i]); i++);
+            if (i < 8)
+                *fields[i] = (uint8_t)parse_number(p);
+            else
+                skip_value(p);
+        }
+    } while (!p->error && accept(p, ','));
+    expect(p, '}');
+}
+
+// Count the elements of the cycles array without looking at them.
+static uint32_t parse_cycles(struct parser *p)
+{
+    uint32_t count = 0;
+
+    expect(p, '[');
+    if (accept(p, ']'))
+        return 0;
+    do
+    {
+        skip_value(p);
+        count++;
+    } while (!p->error && accept(p, ','));
+    expect(p, ']');
+    return count;
+}
+
+// Parse the next case of the array. Returns 1 for a case, 0 at the end of the array.
+static int parse_case(struct parser *p, struct step_case *test, int first)
+{
+    char key[16];
+
+    if (first ? accept(p, ']') : !accept(p, ','))
+    {
+        if (!first)
+            expect(p, ']');
+        return 0;
+    }
+
+    memset(test, 0, sizeof(*test));
+    expect(p, '{');
+    do
+    {
+        parse_string(p, key, sizeof(key));
+        expect(p, ':');
+        if (p->error)
+            return 0;
+
+        if (strcmp(key, "name") == 0)
+            parse_string(p, test->name, sizeof(test->name));
+        else if (strcmp(key, "initial") == 0)
+            parse_state(p, &test->initial);
+        else if (strcmp(key, "final") == 0)
+            parse_state(p, &test->final);
+        else if (strcmp(key, "cycles") == 0)
+            test->bus_cycles = parse_cycles(p);
+        else
+            skip_value(p);
+    } while (!p->error && accept(p, ','));
+    expect(p, '}');
+    return !p->error;
+}
+
+/* ----------- Cases ----------- */
+
+static void load_state(const struct step_state *state)
+{
+    uint32_t i;
+
+    cpu.regs.pc = state->pc - (options.prefetched ? 1 : 0);
+    cpu.regs.sp = state->sp;
+    cpu.regs.af = (uint16_t)(state->a << 8 | state->f);
+    cpu.regs.bc = (uint16_t)(state->b << 8 | state->c);
+    cpu.regs.de = (uint16_t)(state->d << 8 | state->e);
+    cpu.regs.hl = (uint16_t)(state->h << 8 | state->l);
+    cpu.state = STATE_NORMAL;
+    cpu.ime = state->ime;
+    cpu.enable_irq = 0;
+    cpu.disable_irq = 0;
+
+    if (state->ie >= 0)
+        flat[IE_ADDR] = (uint8_t)state->ie;
+    for (i = 0; i < state->num_ram; i++)
+    {
+        flat[state->ram[i].address] = state->ram[i].value;
+    }
+    num_writes = 0;
+}
+
+// Zero everything the case touched for the next one.
+static void clear_state(const struct step_state *state)
+{
+    uint32_t i;
+
+    for (i = 0; i < state->num_ram; i++)
+    {
+        flat[state->ram[i].address] = 0;
+    }
+    for (i = 0; i < num_writes; i++)
+    {
+        flat[writes[i]] = 0;
+    }
+    flat[IE_ADDR] = 0;
+}
+
+static int check(const char *file, const struct step_case *test, const char *what, uint32_t expected, uint32_t got, uint32_t *failures)
+{
+    if (expected == got)
+        return 0;
+    if (*failures < options.max_failures)
+        printf("%s: %s: %s expected %02x got %02x\n", file, test->name, what, expected, got);
+    (*failures)++;
+    return 1;
+}
+
+// Run one case. Returns 1 if it failed, failures counts the mismatches of the file.
+static int run_case(const char *file, const struct step_case *test, uint32_t *failures)
+{
+    const struct step_state *final = &test->final;
+    struct opcode *opcode;
+    uint8_t current_opcode;
+    uint32_t i, j;
+    int failed = 0;
+    char what[32];
+
+    load_state(&test->initial);
+
+    bus_read(&current_opcode, cpu.regs.pc);
+    opcode = &opcodes[current_opcode];
+    if (opcode->func == NULL || opcode->func(&cpu.regs, &cpu.state, &cpu.enable_irq, &cpu.disable_irq))
+    {
+        failed = check(file, test, "opcode failed", 0, 1, failures);
+    }
+    else
+    {
+        cpu.regs.pc += opcode->size;
+        failed |= check(file, test, "A", final->a, cpu.regs.a, failures);
+        failed |= check(file, test, "F", final->f, (uint8_t)cpu.regs.af, failures);
+        failed |= check(file, test, "B", final->b, cpu.regs.b, failures);
+        failed |= check(file, test, "C", final->c, cpu.regs.c, failures);
+        failed |= check(file, test, "D", final->d, cpu.regs.d, failures);
+        failed |= check(file, test, "E", final->e, cpu.regs.e, failures);
+        failed |= check(file, test, "H", final->h, cpu.regs.h, failures);
+        failed |= check(file, test, "L", final->l, cpu.regs.l, failures);
+        failed |= check(file, test, "SP", final->sp, cpu.regs.sp, failures);
+        failed |= check(file, test, "PC", final->pc - (options.prefetched ? 1 : 0), cpu.regs.pc, failures);
+        failed |= check(file, test, "IME", final->ime, cpu.ime, failures);
+        if (final->ie >= 0)
+            failed |= check(file, test, "IE", (uint32_t)final->ie, flat[IE_ADDR], failures);
+        failed |= check(file, test, "cycles", test->bus_cycles * BUS_CYCLE, opcode->cycles, failures);
+
+        for (i = 0; i < final->num_ram; i++)
+        {
+            snprintf(what, sizeof(what), "[%04x]", final->ram[i].address);
+            failed |= check(file, test, what, final->ram[i].value, flat[final->ram[i].address], failures);
+        }
+        for (i = 0; i < num_writes; i++)
+        {
+            for (j = 0; j < final->num_ram && final->ram[j].address != writes[i]; j++);
+            if (j == final->num_ram && writes[i] != IE_ADDR)
+            {
+                snprintf(what, sizeof(what), "write to [%04x]", writes[i]);
+                failed |= check(file, test, what, 0, 1, failures);
+            }
+        }
+    }
+
+    clear_state(&test->initial);
+    return failed;
+}
+
+static char *read_file(const char *path, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    char *data = NULL;
+    long length;
+
+    if (file == NULL || fseek(file, 0, SEEK_END) || (length = ftell(file)) < 0 || fseek(file, 0, SEEK_SET))
+        goto error;
+
+    data = (char*)malloc(length + 1);
+    if (data == NULL || fread(data, 1, length, file) != (size_t)length)
+        goto error;
+    data[length] = '\0';
+    *size = (size_t)length;
+    fclose(file);
+    return data;
+
+error:
+    if (file != NULL)
+        fclose(file);
+    free(data);
+    return NULL;
+}
+
+static void run_file(const char *path, struct step_results *results)
+{
+    static struct step_case test;
+    struct parser p;
+    uint64_t cases = 0, failed = 0;
+    uint32_t failures = 0;
+    const char *name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+    size_t size;
+    char *data;
+    int first = 1;
+
+    data = read_file(path, &size);
+    if (data == NULL)
+    {
+        printf("%s: failed to read\n", path);
+        results->bad_files++;
+        return;
+    }
+
+    p = (struct parser){data, data + size, 0};
+    expect(&p, '[');
+    while (!p.error && parse_case(&p, &test, first))
+    {
+        first = 0;
+        cases++;
+        failed += run_case(name, &test, &failures);
+    }
+    free(data);
+
+    if (p.error)
+    {
+        printf("%s: parse error after %" PRIu64 " cases\n", path, cases);
+        results->bad_files++;
+    }
+    else if (failed || options.verbose)
+    {
+        printf("%s: %" PRIu64 " of %" PRIu64 " cases failed\n", name, failed, cases);
+    }
+    results->cases += cases;
+    results->failed += failed;
+    results->files++;
+}
+
+/* ----------- Workers ----------- */
+
+static int is_json(const char *name)
+{
+    size_t len = strlen(name);
+
+    return len > 5 && strcmp(name + len - 5, ".json") == 0;
+}
+
+static int add_file(const char *path)
+{
+    if (num_files == MAX_FILES || (files[num_files] = strdup(path)) == NULL)
+        return -1;
+    num_files++;
+    return 0;
+}
+
+static int collect(const char *path)
+{
+    struct dirent *entry;
+    struct stat st;
+    char child[4096];
+    DIR *dir;
+    int ret = 0;
+
+    if (stat(path, &st))
+    {
+        fprintf(stderr, "gbstep: can not open %s\n", path);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        return add_file(path);
+    }
+
+    dir = opendir(path);
+    if (dir == NULL)
+        return -1;
+    while (ret == 0 && (entry = readdir(dir)) != NULL)
+    {
+        if (is_json(entry->d_name))
+        {
+            snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+            ret = add_file(child);
+        }
+    }
+    closedir(dir);
+    return ret;
+}
+
+// Run every workers-th file starting at index and send the results through fd.
+static void worker(uint32_t index, uint32_t workers, int fd)
+{
+    struct step_results results = {0};
+    uint32_t i;
+
+    for (i = index; i < num_files; i += workers)
+    {
+        run_file(files[i], &results);
+    }
+    fflush(stdout);
+    if (write(fd, &results, sizeof(results)) != sizeof(results))
+        exit(1);
+    exit(0);
+}
+
+int main(int argc, char *argv[])
+{
+    struct step_results total = {0}, results;
+    uint32_t i, started = 0;
+    int opt, fds[2];
+    double start;
+
+    while ((opt = getopt(argc, argv, "j:m:Pv")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            options.workers = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'm':
+            options.max_failures = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'P':
+            options.prefetched = 1;
+            break;
+        case 'v':
+            options.verbose = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind >= argc)
+        usage();
+
+    for (i = optind; i < (uint32_t)argc; i++)
+    {
+        if (collect(argv[i]))
+            return 1;
+    }
+    if (options.workers == 0)
+        options.workers = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    if (options.workers > num_files)
+        options.workers = num_files ? num_files : 1;
+
+    // Workers inherit the test bus and the opcode table. Lines are printed whole so workers do
+    // not mix their output.
+    register_opcodes();
+    if (bus_setup() || pipe(fds))
+        return 1;
+    setvbuf(stdout, NULL, _IOLBF, 0);
+
+    start = host_time();
+    for (i = 0; i < options.workers; i++)
+    {
+        pid_t pid = fork();
+
+        if (pid < 0)
+            break;
+        if (pid == 0)
+        {
+            close(fds[0]);
+            worker(i, options.workers, fds[1]);
+        }
+        started++;
+    }
+    close(fds[1]);
+
+    for (i = 0; i < started && read(fds[0], &results, sizeof(results)) == sizeof(results); i++)
+    {
+        total.cases += results.cases;
+        total.failed += results.failed;
+        total.files += results.files;
+        total.bad_files += results.bad_files;
+    }
+    while (wait(NULL) > 0);
+
+    printf("%" PRIu64 " of %" PRIu64 " cases failed in %" PRIu32 " files, %.2f s on %" PRIu32 " workers\n",
+           total.failed, total.cases, total.files, host_time() - start, started);
+    if (i < options.workers)
+    {
+        fprintf(stderr, "gbstep: %" PRIu32 " workers did not finish\n", options.workers - i);
+        return 1;
+    }
+    return total.failed || total.bad_files ? 1 : 0;
+}
@@ -0,0 +1,278 @@
+/*
+ * Harness for test ROMs that report through the serial port, like Blargg's.
+ *
+ * Usage:
+ *     gbtest [-j workers] [-t timeout_cycles] [-p pass] [-f fail] [-v] (rom | directory) ...
+ *
+ * Every ROM runs in its own process, up to -j of them at once (default one per CPU), until the
+ * bytes it sent through the serial port contain the pass string (default "Passed") or the fail
+ * string (default "Failed"), or until the timeout (default two minutes of emulated time). A ROM
+ * that crashes the emulator only takes its own process down. Directories are searched for .gb
+ * files.
+ *
+ * One line is printed per ROM, followed by its serial output unless it passed, or always with -v.
+ * Exits with 1 unless every ROM passed.
+ */
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "bus.h"
+#include "hosttime.h"
+#include "machine.h"
+#include "ppu.h"
+#include "serial.h"
+#include "cpu/cpu.h"
+
+#define DEFAULT_TIMEOUT (120ULL * CPU_FREQ)
+#define MAX_ROMS 4096
+#define REPORT_SIZE (SERIAL_OUTPUT_SIZE + 512)
+
+enum test_result
+{
+    TEST_PASS,
+    TEST_FAIL,
+    TEST_TIMEOUT,
+    TEST_ERROR, // The ROM did not load or the emulator failed running it.
+    TEST_CRASH, // The process running the ROM died.
+    NUM_TEST_RESULTS
+};
+
+static const char *result_names[NUM_TEST_RESULTS] = {"PASS", "FAIL", "TIMEOUT", "ERROR", "CRASH"};
+
+struct test_options
+{
+    uint32_t workers;
+    uint64_t timeout;
+    const char *pass;
+    const char *fail;
+    uint8_t verbose;
+};
+
+
+static struct test_options options = {0, DEFAULT_TIMEOUT, "Passed", "Failed", 0};
+static char *roms[MAX_ROMS];
+static uint32_t num_roms;
+
+static void usage()
+{
+    fprintf(stderr, "usage: gbtest [-j workers] [-t timeout_cycles] [-p pass] [-f fail] [-v] (rom | directory) ...\n");
+    exit(2);
+}
+
+/* ----------- ROMs ----------- */
+
+static int is_rom(const char *name)
+{
+    size_t len = strlen(name);
+
+    return len > 3 && strcmp(name + len - 3, ".gb") == 0;
+}
+
+static int add_rom(const char *path)
+{
+    if (num_roms == MAX_ROMS || (roms[num_roms] = strdup(path)) == NULL)
+        return -1;
+    num_roms++;
+    return 0;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+    return strcmp(*(char *const*)a, *(char *const*)b);
+}
+
+static int collect(const char *path)
+{
+    struct dirent *entry;
+    struct stat st;
+    char child[4096];
+    DIR *dir;
+    int ret = 0;
+
+    if (stat(path, &st))
+    {
+        fprintf(stderr, "gbtest: can not open %s\n", path);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        return add_rom(path);
+    }
+
+    dir = opendir(path);
+    if (dir == NULL)
+        return -1;
+    while (ret == 0 && (entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        snprintf(child, sizeof(child), "%s/%s", path, entry->d_name);
+        if (is_rom(entry->d_name) || (stat(child, &st) == 0 && S_ISDIR(st.st_mode)))
+            ret = collect(child);
+    }
+    closedir(dir);
+    return ret;
+}
+
+/* ----------- Machine ----------- */
+
+static int output_contains(const char *text)
+{
+    size_t len = strlen(text), i;
+
+    for (i = 0; i + len <= serial.output_size; i++)
+    {
+        if (memcmp(&serial.output[i], text, len) == 0)
+            return 1;
+    }
+    return 0;
+}
+
+// Run the ROM a frame at a time until it reports, the output is checked in between.
+static enum test_result run_rom(const char *path)
+{
+    if (machine_init(path))
+        return TEST_ERROR;
+
+    while (cpu.cycle_count < options.timeout)
+    {
+        if (cpu_run(FRAME_CYCLES))
+            return TEST_ERROR;
+        if (output_contains(options.fail))
+            return TEST_FAIL;
+        if (output_contains(options.pass))
+            return TEST_PASS;
+    }
+    return TEST_TIMEOUT;
+}
+
+// Print the result line and the output in one write, so processes do not mix their lines.
+static void print_result(const char *path, enum test_result result, uint64_t cycles, uint8_t with_output)
+{
+    static char report[REPORT_SIZE];
+    int len;
+
+    len = snprintf(report, sizeof(report), "%-7s %s (%.1f s)\n", result_names[result], path, (double)cycles / CPU_FREQ);
+    if (with_output && serial.output_size > 0 && len < REPORT_SIZE)
+    {
+        len += snprintf(report + len, sizeof(report) - len, "%.*s%s", (int)serial.output_size, serial.output,
+                        serial.output[serial.output_size - 1] == '\n' ? "" : "\n");
+    }
+    if (len > REPORT_SIZE - 1)
+        len = REPORT_SIZE - 1;
+    if (write(STDOUT_FILENO, report, len) != len)
+        exit(1);
+}
+
+// Run a ROM and send its result through fd.
+static void run_child(uint32_t index, int fd)
+{
+    enum test_result result = run_rom(roms[index]);
+
+    print_result(roms[index], result, cpu.cycle_count, result != TEST_PASS || options.verbose);
+    if (write(fd, &result, sizeof(result)) != sizeof(result))
+        exit(1);
+    exit(0);
+}
+
+/* ----------- Scheduling ----------- */
+
+int main(int argc, char *argv[])
+{
+    uint32_t counts[NUM_TEST_RESULTS] = {0};
+    enum test_result result;
+    pid_t *pids;
+    uint32_t i, next = 0, running = 0;
+    int opt, fds[2], status;
+    double start;
+    pid_t pid;
+
+    while ((opt = getopt(argc, argv, "j:t:p:f:v")) != -1)
+    {
+        switch (opt)
+        {
+        case 'j':
+            options.workers = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            options.timeout = strtoull(optarg, NULL, 0);
+            break;
+        case 'p':
+            options.pass = optarg;
+            break;
+        case 'f':
+            options.fail = optarg;
+            break;
+        case 'v':
+            options.verbose = 1;
+            break;
+        default:
+            usage();
+        }
+    }
+    if (optind >= argc)
+        usage();
+
+    for (i = optind; i < (uint32_t)argc; i++)
+    {
+        if (collect(argv[i]))
+            return 1;
+    }
+    qsort(roms, num_roms, sizeof(roms[0]), compare_paths);
+    if (options.workers == 0)
+        options.workers = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+
+    pids = (pid_t*)calloc(num_roms + 1, sizeof(pid_t));
+    if (pids == NULL || pipe(fds))
+        return 1;
+
+    start = host_time();
+    while (next < num_roms || running > 0)
+    {
+        if (next < num_roms && running < options.workers)
+        {
+            fflush(stdout);
+            pid = fork();
+            if (pid < 0)
+                return 1;
+            if (pid == 0)
+            {
+                close(fds[0]);
+                run_child(next, fds[1]);
+            }
+            pids[next++] = pid;
+            running++;
+            continue;
+        }
+
+        pid = wait(&status);
+        if (pid < 0)
+            break;
+        running--;
+
+        // A process that exits cleanly wrote its result first. The one read may belong to another
+        // process that was not waited for yet, which then finds this one in the pipe.
+        if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        {
+            if (read(fds[0], &result, sizeof(result)) == sizeof(result))
+                counts[result]++;
+            continue;
+        }
+        for (i = 0; i < num_roms && pids[i] != pid; i++);
+        if (i < num_roms)
+        {
+            printf("%-7s %s\n", result_names[TEST_CRASH], roms[i]);
+            fflush(stdout);
+            counts[TEST_CRASH]++;
+        }
+    }
+
+    printf("%" PRIu32 " passed, %" PRIu32 " failed, %" PRIu32 " timed out, %" PRIu32 " errors, %" PRIu32 " crashed"
+           " of %" PRIu32 " ROMs in %.2f s on %" PRIu32 " workers\n", counts[TEST_PASS], counts[TEST_FAIL],
+           counts[TEST_TIMEOUT], counts[TEST_ERROR], counts[TEST_CRASH], num_roms, host_time() - start, options.workers);
+    return counts[TEST_PASS] == num_roms ? 0 : 1;
+}